@@ -0,0 +1,277 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Batch search: tiled multi-query scan, query loading and the combined results file.
+//
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+#include "batch.h"
+#include "utils.h"
+#include "p2.h"
+
+namespace cr = std::chrono;
+
+
+int batch_search(const std::vector<BatchQuery>& queries, const std::vector<const FeatureMatrix*>& matrices,
+                 const std::vector<double>& weights, size_t k, std::vector<std::vector<ScoredRow>>& out) {
+    size_t nq = queries.size();
+    out.assign(nq, std::vector<ScoredRow>());
+    if (nq == 0 || matrices.empty()) {
+        return 0;
+    }
+    size_t rows = matrices[0]->rows;
+    size_t row_bytes = 0;
+    for (const FeatureMatrix* m : matrices) {
+        row_bytes += std::max<size_t>(1, m->dims) * sizeof(float);
+    }
+    size_t tile_rows = std::max(batch_min_tile_rows, batch_tile_bytes / row_bytes);
+    std::vector<TopK> tops(nq, TopK(k));
+
+    DistanceMetric metric = queries[0].parts[0].get_metric();
+    bool from_dot = matrices.size() == 1 && !matrices[0]->sparse && metric_from_dot(metric);
+    for (const BatchQuery& q : queries) {
+        from_dot = from_dot && q.parts[0].get_metric() == metric;
+    }
+
+    if (from_dot) {
+        // Dense single part: blocks of dot products, query tile x row tile.
+        const FeatureMatrix& fm = *matrices[0];
+        size_t n = fm.dims;
+        std::vector<float> packed(nq * n);
+        for (size_t q = 0; q < nq; q++) {
+            std::memcpy(packed.data() + q * n, queries[q].parts[0].vector().data(), n * sizeof(float));
+        }
+        std::vector<double> dots(batch_query_tile * tile_rows);
+        for (size_t r0 = 0; r0 < rows; r0 += tile_rows) {
+            size_t nr = std::min(tile_rows, rows - r0);
+            for (size_t q0 = 0; q0 < nq; q0 += batch_query_tile) {
+                size_t qn = std::min(batch_query_tile, nq - q0);
+                kernel_dot_tile(packed.data() + q0 * n, qn, fm.row(r0), nr, n, dots.data());
+                for (size_t qi = 0; qi < qn; qi++) {
+                    const RowStats& qs = queries[q0 + qi].parts[0].stats();
+                    const double* d = dots.data() + qi * nr;
+                    TopK& top = tops[q0 + qi];
+                    for (size_t j = 0; j < nr; j++) {
+                        top.push(distance_from_dot(metric, d[j], n, qs, fm.stats[r0 + j]), r0 + j);
+                    }
+                }
+            }
+        }
+    } else {
+        std::vector<std::vector<WeightedPart>> parts(nq);
+        for (size_t q = 0; q < nq; q++) {
+            for (size_t p = 0; p < matrices.size(); p++) {
+                parts[q].push_back({&queries[q].parts[p], matrices[p], weights[p]});
+            }
+            order_parts_by_cost(parts[q]);
+        }
+        PruneStats stats;
+        for (size_t r0 = 0; r0 < rows; r0 += tile_rows) {
+            size_t r1 = std::min(rows, r0 + tile_rows);
+            for (size_t q = 0; q < nq; q++) {
+                pruned_scan(parts[q], r0, r1, tops[q], stats);
+            }
+        }
+        std::cout << "Pruned batch scan: " << stats.skipped << " query x image pairs rejected by bounds, " << stats.abandoned << " abandoned part way." << std::endl;
+    }
+    for (size_t q = 0; q < nq; q++) {
+        out[q] = tops[q].sorted();
+    }
+    return 0;
+}
+
+
+Batch::Batch(const fs::path& query_file, char mode, const std::string& spec, const std::vector<fs::path>& vf, size_t k, const fs::path& op_file)
+    : query_file(query_file), mode(mode), spec(spec), vec_files(vf), k(k), op_file(op_file) {
+    if (this->op_file.empty()) {
+        this->op_file = fs::current_path() / (batch_op_file_name + std::to_string(get_time_instant()) + op_file_format);
+    }
+    this->prep_configs();
+}
+
+int Batch::prep_configs() {
+    double total_weights = 0.0;
+    size_t num_parts = this->mode == 'm' ? this->spec.size() / config_size : 1;
+    for (size_t i = 0; i < num_parts; i++) {
+        PartConfig p;
+        if (this->mode == 'm') {
+            const char* cfg = this->spec.c_str() + i * config_size;
+            p.part_name = parse_part_name(cfg[0]);
+            p.hist_type = parse_hist_type(cfg[1]);
+            p.metric = parse_distance_metric(cfg[2]);
+            p.weight = cfg[3] - '0';
+        } else {
+            p.part_name = "W";  // only used by -b-
+            p.hist_type = HistogramType::BASIC_BOX;
+            p.metric = parse_distance_metric(this->spec[0]);
+            p.weight = 1.0;
+        }
+        total_weights += p.weight;
+        p.feature_file = this->vec_files[i];
+        this->pc.push_back(p);
+    }
+    if (total_weights <= 0.0) {
+        std::cout << "At least one part needs a non-zero weight." << std::endl;
+        std::exit(-1);
+    }
+    for (PartConfig& p : this->pc) {
+        p.weight /= total_weights;
+    }
+    return 0;
+}
+
+int Batch::load_features() {
+    for (PartConfig& pcfg : this->pc) {
+        std::vector<std::vector<float>> img_vecs;
+        int read_resp = read_image_data_csv(pcfg.feature_file.string().c_str(), pcfg.img_names, img_vecs);
+        int version = read_resp == 0 ? take_feature_version(pcfg.img_names, img_vecs) : 0;
+        if (read_resp != 0 || img_vecs.empty() || build_feature_matrix(img_vecs, pcfg.matrix) != 0) {
+            std::cout << "Unable to read file containing feature vectors: " << pcfg.feature_file << std::endl;
+            std::exit(-1);
+        }
+        if (this->mode == 'm' && version != feature_version) {
+            std::cout << "Feature file was written by a different version of p1 (" << version << ", expected " << feature_version
+                      << "). Regenerate it with ./p1 -m-: " << pcfg.feature_file << std::endl;
+            std::exit(-1);
+        }
+        if (this->mode == 'b' && pcfg.matrix.dims != static_cast<size_t>(basic_box_vector_size)) {
+            std::cout << "Feature file has no precomputed vectors. Re-run ./p1 -b- for batch search: " << pcfg.feature_file << std::endl;
+            std::exit(-1);
+        }
+    }
+    const PartConfig& first = this->pc[0];
+    for (const PartConfig& pcfg : this->pc) {
+        if (pcfg.img_names.size() != first.img_names.size()) {
+            std::cout << "Not all configs have the same number of images!" << std::endl;
+            std::exit(-1);
+        }
+        for (size_t i = 0; i < first.img_names.size(); i++) {
+            if (std::strcmp(pcfg.img_names[i], first.img_names[i]) != 0) {
+                std::cout << "Image order mismatch at index " << i << ": " << first.img_names[i] << " vs " << pcfg.img_names[i] << std::endl;
+                std::exit(-1);
+            }
+        }
+    }
+    std::cout << "Number of images to be compared: " << first.img_names.size() << std::endl;
+    return 0;
+}
+
+int Batch::load_queries() {
+    size_t skipped = 0;
+    if (this->query_file.extension() == op_file_format) {
+        if (this->pc.size() != 1) {
+            std::cout << "A query CSV holds one vector per image, so it only works with single-part specs." << std::endl;
+            std::exit(-1);
+        }
+        std::vector<char*> names;
+        std::vector<std::vector<float>> vecs;
+        if (read_image_data_csv(this->query_file.string().c_str(), names, vecs) != 0) {
+            std::cout << "Unable to read query file: " << this->query_file << std::endl;
+            std::exit(-1);
+        }
+        int version = take_feature_version(names, vecs);
+        if (version != 0 && version != feature_version) {
+            std::cout << "Query file was written by a different version of p1 (" << version << ", expected " << feature_version
+                      << "): " << this->query_file << std::endl;
+            std::exit(-1);
+        }
+        const PartConfig& p = this->pc[0];
+        for (size_t i = 0; i < vecs.size(); i++) {
+            if (vecs[i].size() != p.matrix.dims) {
+                std::cout << "Skipping query " << names[i] << ": vector does not match the feature file." << std::endl;
+                skipped++;
+                continue;
+            }
+            BatchQuery bq;
+            bq.name = names[i];
+            EmdShape shape = this->mode == 'm' ? emd_shape_for(p.hist_type, p.matrix.dims) : EmdShape();
+            bq.parts.emplace_back(vecs[i], p.metric, shape);
+            this->queries.push_back(std::move(bq));
+        }
+    } else {
+        if (this->mode == 'd') {
+            std::cout << "DNN batch queries need a CSV of embeddings (name + vector per line)." << std::endl;
+            std::exit(-1);
+        }
+        std::ifstream ip(this->query_file);
+        std::string line;
+        std::vector<float> vec;
+        while (std::getline(ip, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty()) {
+                continue;
+            }
+            ImagePlanes planes(fs::absolute(line));  // Shared by every part of this query
+            BatchQuery bq;
+            bq.name = line;
+            for (PartConfig& p : this->pc) {
+                if (compute_histogram(planes, vec, p.hist_type, p.part_name) != 0 || vec.size() != p.matrix.dims) {
+                    break;
+                }
+                EmdShape shape = this->mode == 'm' ? emd_shape_for(p.hist_type, p.matrix.dims) : EmdShape();
+                bq.parts.emplace_back(vec, p.metric, shape);
+            }
+            if (bq.parts.size() != this->pc.size()) {
+                std::cout << "Skipping query " << line << ": histograms could not be computed." << std::endl;
+                skipped++;
+                continue;
+            }
+            this->queries.push_back(std::move(bq));
+        }
+    }
+    if (this->queries.empty()) {
+        std::cout << "No usable queries in " << this->query_file << std::endl;
+        std::exit(-1);
+    }
+    std::cout << "Queries: " << this->queries.size() << " (" << skipped << " skipped)" << std::endl;
+    return 0;
+}
+
+int Batch::run() {
+    this->load_features();
+    cr::steady_clock::time_point t0 = cr::steady_clock::now();
+    this->load_queries();
+    cr::steady_clock::time_point t1 = cr::steady_clock::now();
+
+    std::vector<const FeatureMatrix*> matrices;
+    std::vector<double> weights;
+    for (const PartConfig& p : this->pc) {
+        matrices.push_back(&p.matrix);
+        weights.push_back(p.weight);
+    }
+    std::vector<std::vector<ScoredRow>> results;
+    batch_search(this->queries, matrices, weights, this->k, results);
+    cr::steady_clock::time_point t2 = cr::steady_clock::now();
+
+    std::ofstream op(this->op_file);
+    if (!op) {
+        std::cout << "Unable to open results file for writing: " << this->op_file << std::endl;
+        std::exit(-1);
+    }
+    op << "query,rank,image,distance\n" << std::setprecision(10);
+    const std::vector<char*>& names = this->pc[0].img_names;
+    for (size_t q = 0; q < this->queries.size(); q++) {
+        for (size_t r = 0; r < results[q].size(); r++) {
+            fs::path img(names[results[q][r].row]);
+            if (this->mode == 'b') {
+                img = fs::absolute(img);  // as printed by ./p2 -b-
+            }
+            op << this->queries[q].name << "," << (r + 1) << "," << img.string() << "," << results[q][r].dist << "\n";
+        }
+    }
+    if (!op) {
+        std::cout << "Error writing results file: " << this->op_file << std::endl;
+        std::exit(-1);
+    }
+    double build_ms = cr::duration<double, std::milli>(t1 - t0).count();
+    double scan_ms = cr::duration<double, std::milli>(t2 - t1).count();
+    std::cout << "Built " << this->queries.size() << " queries in " << build_ms << " ms, scanned in " << scan_ms
+              << " ms (" << scan_ms / this->queries.size() << " ms per query)." << std::endl;
+    std::cout << "Top " << this->k << " results of every query written to " << this->op_file << std::endl;
+    return 0;
+}
@@ -0,0 +1,107 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Header file for batch.cpp. Batch search for p2 (./p2 --batch): many queries against the same feature files in
+// one pass over the database. The database is walked one tile of rows at a time and every query is scored against
+// the tile while it is still in cache, each query keeping its own TopK. Single-part SSD, cosine and correlation
+// searches compute a whole query tile x row tile block of dot products at once (kernel_dot_tile), the rest run the
+// pruned scan of the classic mode tile by tile.
+//
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "dist_utils.h"
+
+namespace fs = std::filesystem;
+
+const size_t batch_query_tile = 32;             // Queries scored together against a row tile
+const size_t batch_tile_bytes = 256 << 10;      // Bytes of feature rows per tile (sized for L2)
+const size_t batch_min_tile_rows = 64;          // Smallest row tile, for very long vectors
+const std::string batch_op_file_name = "batch_results_";  // Output file prefix, followed by a timestamp
+
+/**
+ * One query of a batch: its name and one DistanceQuery per part of the spec (same order as the parts).
+ */
+struct BatchQuery {
+    std::string name;
+    std::vector<DistanceQuery> parts;
+};
+
+/**
+ * Tiled search of many queries against the same parts.
+ *
+ * @param queries queries, each with one DistanceQuery per part
+ * @param matrices feature matrix of every part (same number of rows)
+ * @param weights normalized weight of every part
+ * @param k results per query
+ * @param out output, best first for every query (same order as queries)
+ * @return 0 if successful
+ */
+int batch_search(const std::vector<BatchQuery>& queries, const std::vector<const FeatureMatrix*>& matrices,
+                 const std::vector<double>& weights, size_t k, std::vector<std::vector<ScoredRow>>& out);
+
+/**
+ * Handles BATCH runs: reads the feature files once, builds every query, runs batch_search and writes all result
+ * lists to one CSV (query, rank, image, distance).
+ */
+class Batch {
+private:
+    fs::path query_file;                            // Query CSV (name + vector per line) or list of image paths
+    char mode;                                      // p2 mode character: b, m or d
+    std::string spec;                               // Specification string after the mode flag
+    std::vector<fs::path> vec_files;                // Feature files (one per part)
+    size_t k;                                       // Results per query
+    fs::path op_file;                               // Output CSV
+    std::vector<PartConfig> pc;                     // Parsed configuration and features of each part
+    std::vector<BatchQuery> queries;                // Queries that could be built
+
+    /**
+     * Parses the spec into PartConfig entries and normalizes the weights.
+     *
+     * @return 0 if successful
+     */
+    int prep_configs();
+
+    /**
+     * Reads every feature file and checks that they list the same images.
+     *
+     * @return 0 if successful, exits otherwise
+     */
+    int load_features();
+
+    /**
+     * Builds the queries. A .csv query file holds precomputed vectors (single-part specs only); any other file
+     * lists one target image per line, whose histograms are computed here. Queries that fail are skipped.
+     *
+     * @return 0 if successful, exits if no query could be built
+     */
+    int load_queries();
+
+public:
+    /**
+     * Constructor for Batch class.
+     *
+     * @param query_file query CSV or image list
+     * @param mode p2 mode character (b, m or d)
+     * @param spec specification string after the mode flag
+     * @param vf feature files (must match spec order)
+     * @param k results per query
+     * @param op_file output CSV (empty = batch_results_<timestamp>.csv in the working directory)
+     */
+    Batch(const fs::path& query_file, char mode, const std::string& spec, const std::vector<fs::path>& vf, size_t k, const fs::path& op_file);
+
+    /**
+     * Runs the whole batch and writes the results.
+     *
+     * @return 0 if successful
+     */
+    int run();
+};
+
+#endif //BATCH_H
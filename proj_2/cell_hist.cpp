@@ -0,0 +1,150 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Grid of per-cell histograms and part histogram assembly.
+//
+
+#include <algorithm>
+#include <thread>
+
+#include "cell_hist.h"
+#include "hist_kernels.h"
+
+
+CellHistograms::CellHistograms() : bins(0), grid(0) {}
+
+int CellHistograms::build(const cv::Mat& bin_plane, int bins, int grid) {
+    if (bin_plane.empty() || bin_plane.type() != CV_16UC1 || bins <= 0 || grid <= 0) {
+        return -1;
+    }
+    this->bin_plane = bin_plane;
+    this->bins = bins;
+    this->grid = std::min({grid, bin_plane.rows, bin_plane.cols});
+    int g = this->grid;
+    this->row_edges.resize(g + 1);
+    this->col_edges.resize(g + 1);
+    for (int i = 0; i <= g; i++) {
+        this->row_edges[i] = (i * bin_plane.rows) / g;
+        this->col_edges[i] = (i * bin_plane.cols) / g;
+    }
+
+    // Cell counts, one pass over the pixels. Even and odd columns count into separate copies so that runs of
+    // equal bins do not wait on one counter. Each row of cells is independent, so large images split them
+    // across threads.
+    size_t row_cells = static_cast<size_t>(g) * bins;
+    std::vector<uint32_t> copies(2 * g * row_cells, 0);   // [gy][copy][gx][bin]
+    std::vector<int> col_cell(bin_plane.cols);
+    for (int gx = 0; gx < g; gx++) {
+        std::fill(col_cell.begin() + this->col_edges[gx], col_cell.begin() + this->col_edges[gx + 1], gx);
+    }
+    auto count_cells = [&](int gy_begin, int gy_end) {
+        for (int gy = gy_begin; gy < gy_end; gy++) {
+            uint32_t* even = copies.data() + 2 * gy * row_cells;
+            uint32_t* odd = even + row_cells;
+            for (int i = this->row_edges[gy]; i < this->row_edges[gy + 1]; i++) {
+                const uint16_t* ptr = bin_plane.ptr<uint16_t>(i);
+                int j = 0;
+                for (; j + 2 <= bin_plane.cols; j += 2) {
+                    even[col_cell[j] * bins + ptr[j]]++;
+                    odd[col_cell[j + 1] * bins + ptr[j + 1]]++;
+                }
+                for (; j < bin_plane.cols; j++) {
+                    even[col_cell[j] * bins + ptr[j]]++;
+                }
+            }
+        }
+    };
+    size_t num_shards = std::min<size_t>(g, hist_num_threads(static_cast<size_t>(bin_plane.rows) * bin_plane.cols, bin_plane.rows));
+    if (num_shards <= 1) {
+        count_cells(0, g);
+    } else {
+        std::vector<std::thread> workers;
+        int shard_rows = (g + num_shards - 1) / num_shards;
+        for (size_t s = 0; s < num_shards; s++) {
+            int begin = std::min(g, static_cast<int>(s) * shard_rows);
+            workers.emplace_back(count_cells, begin, std::min(g, begin + shard_rows));
+        }
+        for (std::thread& t : workers) {
+            t.join();
+        }
+    }
+    std::vector<uint32_t> cells(g * row_cells);
+    for (int gy = 0; gy < g; gy++) {
+        const uint32_t* even = copies.data() + 2 * gy * row_cells;
+        const uint32_t* odd = even + row_cells;
+        for (size_t k = 0; k < row_cells; k++) {
+            cells[gy * row_cells + k] = even[k] + odd[k];
+        }
+    }
+
+    // Summed-area table over the cells.
+    int stride = g + 1;
+    this->table.assign(static_cast<size_t>(stride) * stride * bins, 0);
+    for (int gy = 0; gy < g; gy++) {
+        for (int gx = 0; gx < g; gx++) {
+            const uint32_t* c = cells.data() + (static_cast<size_t>(gy) * g + gx) * bins;
+            const uint32_t* up = this->table.data() + (static_cast<size_t>(gy) * stride + gx + 1) * bins;
+            const uint32_t* left = this->table.data() + (static_cast<size_t>(gy + 1) * stride + gx) * bins;
+            const uint32_t* diag = this->table.data() + (static_cast<size_t>(gy) * stride + gx) * bins;
+            uint32_t* dst = this->table.data() + (static_cast<size_t>(gy + 1) * stride + gx + 1) * bins;
+            for (int b = 0; b < bins; b++) {
+                dst[b] = c[b] + up[b] + left[b] - diag[b];
+            }
+        }
+    }
+    return 0;
+}
+
+void CellHistograms::add_pixels(int y0, int y1, int x0, int x1, std::vector<uint32_t>& counts) const {
+    for (int i = y0; i < y1; i++) {
+        const uint16_t* ptr = this->bin_plane.ptr<uint16_t>(i);
+        for (int j = x0; j < x1; j++) {
+            counts[ptr[j]]++;
+        }
+    }
+}
+
+int CellHistograms::part_histogram(const cv::Rect& roi, std::vector<float>& vec) const {
+    cv::Rect r = roi & cv::Rect(0, 0, this->cols(), this->rows());
+    if (this->empty() || r.area() == 0) {
+        return -1;
+    }
+    int x0 = r.x;
+    int x1 = r.x + r.width;
+    int y0 = r.y;
+    int y1 = r.y + r.height;
+
+    // Largest block of whole cells inside the part.
+    int gx0 = std::lower_bound(this->col_edges.begin(), this->col_edges.end(), x0) - this->col_edges.begin();
+    int gx1 = std::upper_bound(this->col_edges.begin(), this->col_edges.end(), x1) - this->col_edges.begin() - 1;
+    int gy0 = std::lower_bound(this->row_edges.begin(), this->row_edges.end(), y0) - this->row_edges.begin();
+    int gy1 = std::upper_bound(this->row_edges.begin(), this->row_edges.end(), y1) - this->row_edges.begin() - 1;
+
+    std::vector<uint32_t> counts(this->bins, 0);
+    if (gx0 < gx1 && gy0 < gy1) {
+        int stride = this->grid + 1;
+        const uint32_t* a = this->table.data() + (static_cast<size_t>(gy1) * stride + gx1) * this->bins;
+        const uint32_t* b = this->table.data() + (static_cast<size_t>(gy0) * stride + gx1) * this->bins;
+        const uint32_t* c = this->table.data() + (static_cast<size_t>(gy1) * stride + gx0) * this->bins;
+        const uint32_t* d = this->table.data() + (static_cast<size_t>(gy0) * stride + gx0) * this->bins;
+        for (int k = 0; k < this->bins; k++) {
+            counts[k] = a[k] - b[k] - c[k] + d[k];
+        }
+        int cy0 = this->row_edges[gy0];
+        int cy1 = this->row_edges[gy1];
+        this->add_pixels(y0, cy0, x0, x1, counts);                         // strip above the cells
+        this->add_pixels(cy1, y1, x0, x1, counts);                         // strip below the cells
+        this->add_pixels(cy0, cy1, x0, this->col_edges[gx0], counts);      // strip left of the cells
+        this->add_pixels(cy0, cy1, this->col_edges[gx1], x1, counts);      // strip right of the cells
+    } else {
+        this->add_pixels(y0, y1, x0, x1, counts);                          // part smaller than a cell
+    }
+
+    vec.clear();
+    vec.resize(this->bins);
+    float total = static_cast<float>(r.area());
+    for (int k = 0; k < this->bins; k++) {
+        vec[k] = counts[k] / total;
+    }
+    return 0;
+}
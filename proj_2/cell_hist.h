@@ -0,0 +1,64 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Header file for cell_hist.cpp. Grid of per-cell histograms with a summed-area table over the cells.
+// Each pixel is binned once; the histogram of any rectangular part is then the sum of the cells it covers
+// (four table lookups per bin) plus the pixels of the part that fall outside whole cells.
+//
+
+#ifndef CELL_HIST_H
+#define CELL_HIST_H
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <vector>
+
+const int cell_grid_size = 8;   // Cells per side. Multiples of 4 keep the halves, quadrants and centre cell-aligned
+
+/**
+ * Summed-area table of cell histograms built from a plane of per-pixel bin indices.
+ */
+class CellHistograms {
+private:
+    cv::Mat bin_plane;                 // 16UC1 bin index of every pixel, kept for the unaligned edges of a part
+    int bins;                          // Number of bins
+    int grid;                          // Cells per side
+    std::vector<int> row_edges;        // grid + 1 row boundaries
+    std::vector<int> col_edges;        // grid + 1 column boundaries
+    std::vector<uint32_t> table;       // (grid + 1) x (grid + 1) x bins; entry (gy, gx) counts all cells above and left
+
+    /**
+     * Adds the bins of the pixels in rows [y0, y1) and columns [x0, x1) to counts.
+     */
+    void add_pixels(int y0, int y1, int x0, int x1, std::vector<uint32_t>& counts) const;
+
+public:
+    CellHistograms();
+
+    /**
+     * Bins every pixel into its cell and builds the summed-area table.
+     *
+     * @param bin_plane 16UC1 plane of bin indices in [0, bins)
+     * @param bins number of bins
+     * @param grid cells per side
+     * @return 0 if successful, -1 if the plane is empty or of the wrong type
+     */
+    int build(const cv::Mat& bin_plane, int bins, int grid=cell_grid_size);
+
+    bool empty() const { return this->table.empty(); }
+    int rows() const { return this->bin_plane.rows; }
+    int cols() const { return this->bin_plane.cols; }
+
+    /**
+     * Normalised histogram of a rectangular part. Exact for any rectangle: whole cells come from the table,
+     * the remaining strips along the edges of the part are binned from the bin plane.
+     *
+     * @param roi part of the image
+     * @param vec output vector (bins values, summing to 1)
+     * @return 0 if successful, -1 if the part is empty
+     */
+    int part_histogram(const cv::Rect& roi, std::vector<float>& vec) const;
+};
+
+#endif //CELL_HIST_H
@@ -210,3 +210,65 @@ int read_image_data_csv( const char *filename, std::vector<char *> &filenames, s
 
   return(0);
 }
+
+/*
+  Scans a file in the format above and returns the byte offset at
+  which each row starts.
+
+  The function returns a non-zero value if something goes wrong.
+ */
+int index_image_data_csv( const char *filename, std::vector<long> &offsets ) {
+  FILE *fp;
+  char buffer[65536];
+  long pos = 0;
+  int at_line_start = 1;
+
+  fp = fopen(filename, "r");
+  if( !fp ) {
+    printf("Unable to open feature file\n");
+    return(-1);
+  }
+
+  offsets.clear();
+  for(;;) {
+    size_t n = fread( buffer, sizeof(char), sizeof(buffer), fp );
+    if( n == 0 ) break;
+    for(size_t i=0;i<n;i++) {
+      if( at_line_start && buffer[i] != '\n' ) {
+        offsets.push_back( pos + i );
+        at_line_start = 0;
+      }
+      if( buffer[i] == '\n' ) {
+        at_line_start = 1;
+      }
+    }
+    pos += n;
+  }
+  fclose(fp);
+
+  return(0);
+}
+
+/*
+  Reads the row starting at byte offset `offset` of an open CSV file.
+
+  The function returns a non-zero value if something goes wrong.
+ */
+int read_image_data_csv_row( FILE *fp, long offset, char *image_filename, std::vector<float> &data ) {
+  float fval;
+
+  if( fseek( fp, offset, SEEK_SET ) != 0 ) {
+    return(-1);
+  }
+  data.clear();
+  if( getstring( fp, image_filename ) ) {
+    return(-1);
+  }
+  for(;;) {
+    float eol = getfloat( fp, &fval );
+    data.push_back( fval );
+    if( eol ) break;
+  }
+
+  return(0);
+}
@@ -10,6 +10,9 @@
 #ifndef CVS_UTIL_H
 #define CVS_UTIL_H
 
+#include <cstdio>
+#include <vector>
+
 /*
   Given a filename, and image filename, and the image features, by
   default the function will append a line of data to the CSV format
@@ -41,4 +44,22 @@ int append_image_data_csv( const char *filename, const char *image_filename, std
  */
 int read_image_data_csv( const char *filename, std::vector<char *> &filenames, std::vector<std::vector<float>> &data, int echo_file = 0 );
 
+/*
+  Scans a file in the format above and returns the byte offset at
+  which each row starts, so that single rows can later be read back
+  with read_image_data_csv_row without loading the whole file.
+
+  The function returns a non-zero value if something goes wrong.
+ */
+int index_image_data_csv( const char *filename, std::vector<long> &offsets );
+
+/*
+  Reads the row starting at byte offset `offset` of an open CSV file.
+  The image filename is copied into image_filename (which must hold at
+  least 256 chars) and the features replace the contents of data.
+
+  The function returns a non-zero value if something goes wrong.
+ */
+int read_image_data_csv_row( FILE *fp, long offset, char *image_filename, std::vector<float> &data );
+
 #endif
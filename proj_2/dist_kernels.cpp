@@ -0,0 +1,573 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// SIMD reduction kernels for the distance metrics. Each kernel is written once against a small vector-ops
+// interface and instantiated for AVX-512, AVX2+FMA, NEON or plain scalar code depending on the target.
+// Four independent accumulators hide the add/FMA latency. Every kernel_block elements the float lanes are
+// flushed into a double total.
+//
+
+#include <algorithm>
+#include <cmath>
+
+#include "dist_kernels.h"
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define DIST_KERNELS_AVX512 1
+#elif defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define DIST_KERNELS_AVX2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define DIST_KERNELS_NEON 1
+#endif
+
+namespace {
+
+const float chi_squared_eps = 0.0001f;  // Bins whose combined mass is below this are skipped (matches compute_chi_squared)
+
+/**
+ * Scalar fallback. Also used for the tail of every vectorised loop.
+ */
+struct ScalarOps {
+    typedef float V;
+    static constexpr size_t width = 1;
+    static V zero() { return 0.0f; }
+    static V load(const float* p) { return *p; }
+    static V add(V a, V b) { return a + b; }
+    static V sub(V a, V b) { return a - b; }
+    static V mul(V a, V b) { return a * b; }
+    static V fma(V a, V b, V acc) { return acc + a * b; }
+    static V min(V a, V b) { return a < b ? a : b; }
+    static V abs(V a) { return std::fabs(a); }
+    static V sqrt(V a) { return std::sqrt(a); }
+    static V div(V a, V b) { return a / b; }
+    static V keep_if_gt(V a, float thr, V v) { return a > thr ? v : 0.0f; }
+    static float hsum(V a) { return a; }
+};
+
+#if defined(DIST_KERNELS_AVX512)
+struct SimdOps {
+    typedef __m512 V;
+    static constexpr size_t width = 16;
+    static V zero() { return _mm512_setzero_ps(); }
+    static V load(const float* p) { return _mm512_loadu_ps(p); }
+    static V add(V a, V b) { return _mm512_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm512_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm512_mul_ps(a, b); }
+    static V fma(V a, V b, V acc) { return _mm512_fmadd_ps(a, b, acc); }
+    static V min(V a, V b) { return _mm512_min_ps(a, b); }
+    static V abs(V a) { return _mm512_abs_ps(a); }
+    static V sqrt(V a) { return _mm512_sqrt_ps(a); }
+    static V div(V a, V b) { return _mm512_div_ps(a, b); }
+    static V keep_if_gt(V a, float thr, V v) {
+        return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(a, _mm512_set1_ps(thr), _CMP_GT_OQ), v);
+    }
+    static float hsum(V a) { return _mm512_reduce_add_ps(a); }
+};
+const char* const isa_name = "avx512";
+#elif defined(DIST_KERNELS_AVX2)
+struct SimdOps {
+    typedef __m256 V;
+    static constexpr size_t width = 8;
+    static V zero() { return _mm256_setzero_ps(); }
+    static V load(const float* p) { return _mm256_loadu_ps(p); }
+    static V add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V fma(V a, V b, V acc) { return _mm256_fmadd_ps(a, b, acc); }
+    static V min(V a, V b) { return _mm256_min_ps(a, b); }
+    static V abs(V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static V sqrt(V a) { return _mm256_sqrt_ps(a); }
+    static V div(V a, V b) { return _mm256_div_ps(a, b); }
+    static V keep_if_gt(V a, float thr, V v) {
+        return _mm256_and_ps(_mm256_cmp_ps(a, _mm256_set1_ps(thr), _CMP_GT_OQ), v);
+    }
+    static float hsum(V a) {
+        __m128 lo = _mm256_castps256_ps128(a);
+        __m128 hi = _mm256_extractf128_ps(a, 1);
+        lo = _mm_add_ps(lo, hi);
+        lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+        lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 0x55));
+        return _mm_cvtss_f32(lo);
+    }
+};
+const char* const isa_name = "avx2";
+#elif defined(DIST_KERNELS_NEON)
+struct SimdOps {
+    typedef float32x4_t V;
+    static constexpr size_t width = 4;
+    static V zero() { return vdupq_n_f32(0.0f); }
+    static V load(const float* p) { return vld1q_f32(p); }
+    static V add(V a, V b) { return vaddq_f32(a, b); }
+    static V sub(V a, V b) { return vsubq_f32(a, b); }
+    static V mul(V a, V b) { return vmulq_f32(a, b); }
+    static V fma(V a, V b, V acc) { return vfmaq_f32(acc, a, b); }
+    static V min(V a, V b) { return vminq_f32(a, b); }
+    static V abs(V a) { return vabsq_f32(a); }
+    static V sqrt(V a) { return vsqrtq_f32(a); }
+    static V div(V a, V b) { return vdivq_f32(a, b); }
+    static V keep_if_gt(V a, float thr, V v) {
+        return vbslq_f32(vcgtq_f32(a, vdupq_n_f32(thr)), v, vdupq_n_f32(0.0f));
+    }
+    static float hsum(V a) { return vaddvq_f32(a); }
+};
+const char* const isa_name = "neon";
+#else
+typedef ScalarOps SimdOps;
+const char* const isa_name = "scalar";
+#endif
+
+// One reduction step per metric. acc is updated with the contribution of lanes a (from x) and b (from y).
+struct SqDiffStep {
+    template<typename Ops> static typename Ops::V apply(typename Ops::V acc, typename Ops::V a, typename Ops::V b) {
+        typename Ops::V d = Ops::sub(a, b);
+        return Ops::fma(d, d, acc);
+    }
+};
+
+struct AbsDiffStep {
+    template<typename Ops> static typename Ops::V apply(typename Ops::V acc, typename Ops::V a, typename Ops::V b) {
+        return Ops::add(acc, Ops::abs(Ops::sub(a, b)));
+    }
+};
+
+struct MinStep {
+    template<typename Ops> static typename Ops::V apply(typename Ops::V acc, typename Ops::V a, typename Ops::V b) {
+        return Ops::add(acc, Ops::min(a, b));
+    }
+};
+
+struct ChiSquaredStep {
+    template<typename Ops> static typename Ops::V apply(typename Ops::V acc, typename Ops::V a, typename Ops::V b) {
+        typename Ops::V s = Ops::add(a, b);
+        typename Ops::V d = Ops::sub(a, b);
+        // Lanes with s <= eps can hold 0/0 = NaN here; keep_if_gt zeroes them before they reach the accumulator.
+        return Ops::add(acc, Ops::keep_if_gt(s, chi_squared_eps, Ops::div(Ops::mul(d, d), s)));
+    }
+};
+
+struct DotStep {
+    template<typename Ops> static typename Ops::V apply(typename Ops::V acc, typename Ops::V a, typename Ops::V b) {
+        return Ops::fma(a, b, acc);
+    }
+};
+
+struct SqrtProdStep {
+    template<typename Ops> static typename Ops::V apply(typename Ops::V acc, typename Ops::V a, typename Ops::V b) {
+        return Ops::add(acc, Ops::sqrt(Ops::mul(a, b)));
+    }
+};
+
+/**
+ * Blocked reduction shared by all kernels. Runs four vector accumulators over each block of kernel_block
+ * elements, folds them into a double, and finishes the last partial vector with scalar code.
+ */
+template<typename Step>
+double reduce(const float* x, const float* y, size_t n) {
+    typedef SimdOps Ops;
+    constexpr size_t w = Ops::width;
+    double total = 0.0;
+    size_t i = 0;
+    while (i < n) {
+        const size_t end = std::min(n, i + kernel_block);
+        typename Ops::V a0 = Ops::zero();
+        typename Ops::V a1 = Ops::zero();
+        typename Ops::V a2 = Ops::zero();
+        typename Ops::V a3 = Ops::zero();
+        for (; i + 4 * w <= end; i += 4 * w) {
+            a0 = Step::template apply<Ops>(a0, Ops::load(x + i), Ops::load(y + i));
+            a1 = Step::template apply<Ops>(a1, Ops::load(x + i + w), Ops::load(y + i + w));
+            a2 = Step::template apply<Ops>(a2, Ops::load(x + i + 2 * w), Ops::load(y + i + 2 * w));
+            a3 = Step::template apply<Ops>(a3, Ops::load(x + i + 3 * w), Ops::load(y + i + 3 * w));
+        }
+        for (; i + w <= end; i += w) {
+            a0 = Step::template apply<Ops>(a0, Ops::load(x + i), Ops::load(y + i));
+        }
+        float tail = 0.0f;
+        for (; i < end; i++) {
+            tail = Step::template apply<ScalarOps>(tail, x[i], y[i]);
+        }
+        total += Ops::hsum(Ops::add(Ops::add(a0, a1), Ops::add(a2, a3)));
+        total += tail;
+    }
+    return total;
+}
+
+/**
+ * Dot products of 2 queries against 4 rows in one pass over the vectors (8 accumulators), folded into doubles
+ * every kernel_block elements like reduce.
+ */
+void dot_2x4(const float* q0, const float* q1, const float* const* x, size_t n, double* o0, double* o1) {
+    typedef SimdOps Ops;
+    constexpr size_t w = Ops::width;
+    for (size_t r = 0; r < 4; r++) {
+        o0[r] = 0.0;
+        o1[r] = 0.0;
+    }
+    size_t i = 0;
+    while (i < n) {
+        const size_t end = std::min(n, i + kernel_block);
+        typename Ops::V a[2][4];
+        for (size_t r = 0; r < 4; r++) {
+            a[0][r] = Ops::zero();
+            a[1][r] = Ops::zero();
+        }
+        for (; i + w <= end; i += w) {
+            typename Ops::V v0 = Ops::load(q0 + i);
+            typename Ops::V v1 = Ops::load(q1 + i);
+            for (size_t r = 0; r < 4; r++) {
+                typename Ops::V xv = Ops::load(x[r] + i);
+                a[0][r] = Ops::fma(v0, xv, a[0][r]);
+                a[1][r] = Ops::fma(v1, xv, a[1][r]);
+            }
+        }
+        for (size_t r = 0; r < 4; r++) {
+            float t0 = 0.0f;
+            float t1 = 0.0f;
+            for (size_t j = i; j < end; j++) {
+                t0 += q0[j] * x[r][j];
+                t1 += q1[j] * x[r][j];
+            }
+            o0[r] += static_cast<double>(Ops::hsum(a[0][r])) + t0;
+            o1[r] += static_cast<double>(Ops::hsum(a[1][r])) + t1;
+        }
+        i = end;
+    }
+}
+
+/**
+ * Sum of one abandon_block chunk [i, end). Same accumulator layout as reduce, but without the block loop.
+ */
+template<typename Step>
+double reduce_chunk(const float* x, const float* y, size_t i, size_t end) {
+    typedef SimdOps Ops;
+    constexpr size_t w = Ops::width;
+    typename Ops::V a0 = Ops::zero();
+    typename Ops::V a1 = Ops::zero();
+    for (; i + 2 * w <= end; i += 2 * w) {
+        a0 = Step::template apply<Ops>(a0, Ops::load(x + i), Ops::load(y + i));
+        a1 = Step::template apply<Ops>(a1, Ops::load(x + i + w), Ops::load(y + i + w));
+    }
+    for (; i + w <= end; i += w) {
+        a0 = Step::template apply<Ops>(a0, Ops::load(x + i), Ops::load(y + i));
+    }
+    float tail = 0.0f;
+    for (; i < end; i++) {
+        tail = Step::template apply<ScalarOps>(tail, x[i], y[i]);
+    }
+    return static_cast<double>(Ops::hsum(Ops::add(a0, a1))) + tail;
+}
+
+/**
+ * Reduction for steps whose terms are never negative, checked against the budget after every chunk.
+ * The chunking does not depend on the budget, so a scan that runs to the end returns the same value for any budget.
+ */
+template<typename Step>
+double reduce_bounded(const float* x, const float* y, size_t n, double budget) {
+    double total = 0.0;
+    for (size_t i = 0; i < n; i += abandon_block) {
+        total += reduce_chunk<Step>(x, y, i, std::min(n, i + abandon_block));
+        if (total > budget) {
+            return total;
+        }
+    }
+    return total;
+}
+
+}  // namespace
+
+
+RowStats compute_row_stats(const float* x, size_t n) {
+    RowStats s;
+    s.sq_norm = reduce<DotStep>(x, x, n);
+    s.sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        s.sum += x[i];
+    }
+    return s;
+}
+
+int build_feature_matrix(const std::vector<std::vector<float>>& vecs, FeatureMatrix& fm, bool allow_sparse) {
+    fm.rows = vecs.size();
+    fm.dims = vecs.empty() ? 0 : vecs[0].size();
+    fm.data.clear();
+    fm.offsets.clear();
+    fm.index.clear();
+    fm.value.clear();
+    fm.stats.clear();
+    fm.stats.reserve(fm.rows);
+    size_t nnz = 0;
+    for (const std::vector<float>& v : vecs) {
+        if (v.size() != fm.dims) {
+            return -1;
+        }
+        nnz += fm.dims - std::count(v.begin(), v.end(), 0.0f);
+        fm.stats.push_back(compute_row_stats(v.data(), fm.dims));
+    }
+    fm.sparse = allow_sparse && fm.dims >= sparse_min_dims && nnz < sparse_density_threshold * fm.rows * fm.dims;
+    if (!fm.sparse) {
+        fm.data.reserve(fm.rows * fm.dims);
+        for (const std::vector<float>& v : vecs) {
+            fm.data.insert(fm.data.end(), v.begin(), v.end());
+        }
+        return 0;
+    }
+    fm.offsets.reserve(fm.rows + 1);
+    fm.index.reserve(nnz);
+    fm.value.reserve(nnz);
+    fm.offsets.push_back(0);
+    for (const std::vector<float>& v : vecs) {
+        for (size_t i = 0; i < fm.dims; i++) {
+            if (v[i] != 0.0f) {
+                fm.index.push_back(static_cast<uint32_t>(i));
+                fm.value.push_back(v[i]);
+            }
+        }
+        fm.offsets.push_back(fm.index.size());
+    }
+    return 0;
+}
+
+void slice_feature_matrix(const FeatureMatrix& src, size_t begin, size_t end, FeatureMatrix& out) {
+    out.rows = end - begin;
+    out.dims = src.dims;
+    out.sparse = src.sparse;
+    out.stats.assign(src.stats.begin() + begin, src.stats.begin() + end);
+    if (!src.sparse) {
+        out.data.assign(src.data.begin() + begin * src.dims, src.data.begin() + end * src.dims);
+        return;
+    }
+    uint64_t first = src.offsets[begin];
+    uint64_t last = src.offsets[end];
+    out.offsets.resize(out.rows + 1);
+    for (size_t i = 0; i <= out.rows; i++) {
+        out.offsets[i] = src.offsets[begin + i] - first;
+    }
+    out.index.assign(src.index.begin() + first, src.index.begin() + last);
+    out.value.assign(src.value.begin() + first, src.value.begin() + last);
+}
+
+double kernel_sum_sq_diff(const float* x, const float* y, size_t n) {
+    return reduce<SqDiffStep>(x, y, n);
+}
+
+double kernel_sum_abs_diff(const float* x, const float* y, size_t n) {
+    return reduce<AbsDiffStep>(x, y, n);
+}
+
+double kernel_sum_min(const float* x, const float* y, size_t n) {
+    return reduce<MinStep>(x, y, n);
+}
+
+double kernel_sum_chi_squared(const float* x, const float* y, size_t n) {
+    return reduce<ChiSquaredStep>(x, y, n);
+}
+
+double kernel_dot(const float* x, const float* y, size_t n) {
+    return reduce<DotStep>(x, y, n);
+}
+
+void kernel_dot_tile(const float* q, size_t nq, const float* x, size_t nx, size_t n, double* out) {
+    size_t i = 0;
+    for (; i + 2 <= nq; i += 2) {
+        const float* q0 = q + i * n;
+        const float* q1 = q0 + n;
+        size_t j = 0;
+        for (; j + 4 <= nx; j += 4) {
+            const float* rows[4] = {x + j * n, x + (j + 1) * n, x + (j + 2) * n, x + (j + 3) * n};
+            dot_2x4(q0, q1, rows, n, out + i * nx + j, out + (i + 1) * nx + j);
+        }
+        for (; j < nx; j++) {
+            out[i * nx + j] = reduce<DotStep>(q0, x + j * n, n);
+            out[(i + 1) * nx + j] = reduce<DotStep>(q1, x + j * n, n);
+        }
+    }
+    for (; i < nq; i++) {
+        for (size_t j = 0; j < nx; j++) {
+            out[i * nx + j] = reduce<DotStep>(q + i * n, x + j * n, n);
+        }
+    }
+}
+
+double kernel_sum_sqrt_prod(const float* x, const float* y, size_t n) {
+    return reduce<SqrtProdStep>(x, y, n);
+}
+
+double kernel_sum_sq_diff_bounded(const float* x, const float* y, size_t n, double budget) {
+    return reduce_bounded<SqDiffStep>(x, y, n, budget);
+}
+
+double kernel_sum_abs_diff_bounded(const float* x, const float* y, size_t n, double budget) {
+    return reduce_bounded<AbsDiffStep>(x, y, n, budget);
+}
+
+double kernel_sum_chi_squared_bounded(const float* x, const float* y, size_t n, double budget) {
+    return reduce_bounded<ChiSquaredStep>(x, y, n, budget);
+}
+
+void chunk_suffix_sums(const float* x, size_t n, std::vector<double>& rest) {
+    size_t num_chunks = (n + abandon_block - 1) / abandon_block;
+    rest.assign(num_chunks + 1, 0.0);
+    for (size_t c = num_chunks; c-- > 0;) {
+        double chunk = 0.0;
+        for (size_t i = c * abandon_block; i < std::min(n, (c + 1) * abandon_block); i++) {
+            chunk += x[i];
+        }
+        rest[c] = rest[c + 1] + chunk;
+    }
+}
+
+double kernel_sum_min_bounded(const float* x, const float* y, size_t n, const std::vector<double>& rest, double floor) {
+    double total = 0.0;
+    size_t c = 0;
+    for (size_t i = 0; i < n; i += abandon_block, c++) {
+        if (total + rest[c] < floor) {
+            return total + rest[c];
+        }
+        total += reduce_chunk<MinStep>(x, y, i, std::min(n, i + abandon_block));
+    }
+    return total;
+}
+
+void make_sparse_vector(const float* x, size_t n, SparseVector& sv) {
+    sv.index.clear();
+    sv.value.clear();
+    for (size_t i = 0; i < n; i++) {
+        if (x[i] != 0.0f) {
+            sv.index.push_back(static_cast<uint32_t>(i));
+            sv.value.push_back(x[i]);
+        }
+    }
+}
+
+namespace {
+
+/**
+ * Chi-squared term of one bin, 0 where the bin holds (almost) no mass in either vector.
+ */
+inline double chi_squared_term(double x, double y) {
+    double s = x + y;
+    if (s <= chi_squared_eps) {
+        return 0.0;
+    }
+    double d = x - y;
+    return d * d / s;
+}
+
+/**
+ * Walks the union of the bins of a and (idx, val), calling step(a_value, row_value) once per bin that is non-zero
+ * in either. Bins that are zero in both contribute nothing to any of the merged kernels.
+ */
+template<typename Step>
+double merge_sum(const SparseVector& a, const uint32_t* idx, const float* val, size_t nnz, Step step) {
+    double total = 0.0;
+    size_t i = 0;
+    size_t j = 0;
+    size_t na = a.index.size();
+    while (i < na && j < nnz) {
+        if (a.index[i] == idx[j]) {
+            total += step(a.value[i++], val[j++]);
+        } else if (a.index[i] < idx[j]) {
+            total += step(a.value[i++], 0.0f);
+        } else {
+            total += step(0.0f, val[j++]);
+        }
+    }
+    for (; i < na; i++) {
+        total += step(a.value[i], 0.0f);
+    }
+    for (; j < nnz; j++) {
+        total += step(0.0f, val[j]);
+    }
+    return total;
+}
+
+}  // namespace
+
+ZeroRowSums compute_zero_row_sums(const float* q, size_t n) {
+    ZeroRowSums z{0.0, 0.0, 0.0, 0.0};
+    for (size_t i = 0; i < n; i++) {
+        double v = q[i];
+        z.sq += v * v;
+        z.abs += std::abs(v);
+        z.min += std::min(v, 0.0);
+        z.chi += chi_squared_term(v, 0.0);
+    }
+    return z;
+}
+
+double sparse_dense_sum_sq_diff(const float* q, const ZeroRowSums& z, const uint32_t* idx, const float* val, size_t nnz) {
+    double total = z.sq;
+    for (size_t k = 0; k < nnz; k++) {
+        double a = q[idx[k]];
+        double d = a - val[k];
+        total += d * d - a * a;
+    }
+    return std::max(total, 0.0);
+}
+
+double sparse_dense_sum_abs_diff(const float* q, const ZeroRowSums& z, const uint32_t* idx, const float* val, size_t nnz) {
+    double total = z.abs;
+    for (size_t k = 0; k < nnz; k++) {
+        double a = q[idx[k]];
+        total += std::abs(a - val[k]) - std::abs(a);
+    }
+    return std::max(total, 0.0);
+}
+
+double sparse_dense_sum_min(const float* q, const ZeroRowSums& z, const uint32_t* idx, const float* val, size_t nnz) {
+    double total = z.min;
+    for (size_t k = 0; k < nnz; k++) {
+        double a = q[idx[k]];
+        total += std::min<double>(a, val[k]) - std::min(a, 0.0);
+    }
+    return total;
+}
+
+double sparse_dense_sum_chi_squared(const float* q, const ZeroRowSums& z, const uint32_t* idx, const float* val, size_t nnz) {
+    double total = z.chi;
+    for (size_t k = 0; k < nnz; k++) {
+        double a = q[idx[k]];
+        total += chi_squared_term(a, val[k]) - chi_squared_term(a, 0.0);
+    }
+    return std::max(total, 0.0);
+}
+
+double sparse_dense_dot(const float* q, const uint32_t* idx, const float* val, size_t nnz) {
+    double total = 0.0;
+    for (size_t k = 0; k < nnz; k++) {
+        total += static_cast<double>(q[idx[k]]) * val[k];
+    }
+    return total;
+}
+
+double sparse_dense_sum_sqrt_prod(const float* q, const uint32_t* idx, const float* val, size_t nnz) {
+    double total = 0.0;
+    for (size_t k = 0; k < nnz; k++) {
+        total += std::sqrt(static_cast<double>(q[idx[k]]) * val[k]);
+    }
+    return total;
+}
+
+double sparse_sum_sq_diff(const SparseVector& a, const uint32_t* idx, const float* val, size_t nnz) {
+    return merge_sum(a, idx, val, nnz, [](double x, double y) { return (x - y) * (x - y); });
+}
+
+double sparse_sum_abs_diff(const SparseVector& a, const uint32_t* idx, const float* val, size_t nnz) {
+    return merge_sum(a, idx, val, nnz, [](double x, double y) { return std::abs(x - y); });
+}
+
+double sparse_sum_min(const SparseVector& a, const uint32_t* idx, const float* val, size_t nnz) {
+    // Bins missing from one side still add min(x, 0), which only matters for signed vectors.
+    return merge_sum(a, idx, val, nnz, [](double x, double y) { return std::min(x, y); });
+}
+
+double sparse_sum_chi_squared(const SparseVector& a, const uint32_t* idx, const float* val, size_t nnz) {
+    return merge_sum(a, idx, val, nnz, [](double x, double y) { return chi_squared_term(x, y); });
+}
+
+const char* kernel_isa_name() {
+    return isa_name;
+}
@@ -0,0 +1,274 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Header file for dist_kernels.cpp. Declares the contiguous feature matrix used for brute-force search and the
+// SIMD reduction kernels that the distance metrics in dist_utils are built on.
+//
+
+#ifndef DIST_KERNELS_H
+#define DIST_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Number of floats reduced in single precision vector accumulators before the partial sum is flushed into a double.
+ * Keeps the fast float lanes while bounding the rounding error on the 32768-dim RGB histograms.
+ */
+const size_t kernel_block = 1024;
+
+/**
+ * Number of floats between budget checks in the early-abandon kernels. Small enough that a 256-bin histogram is
+ * checked a few times, large enough that the check does not show up next to the arithmetic.
+ */
+const size_t abandon_block = 64;
+
+/**
+ * A feature file is stored sparse when fewer than this fraction of its values are non-zero. A sparse entry costs
+ * 8 bytes (index + value) against 4 for a dense one, so below a quarter the matrix is at least half the size and
+ * the per-row work drops with it.
+ */
+const double sparse_density_threshold = 0.25;
+
+/**
+ * Vectors shorter than this are always stored dense; the bookkeeping would outweigh the saving.
+ */
+const size_t sparse_min_dims = 64;
+
+/**
+ * Largest dense query (in floats) that sparse rows are compared against directly. 65536 floats is 256 KB, about
+ * what stays in L2 while the rows stream past. Longer queries are made sparse as well and rows are merged with them.
+ */
+const size_t sparse_dense_query_max_dims = 65536;
+
+/**
+ * Per-vector statistics that are computed once and reused by every comparison against that vector.
+ * Cosine needs the squared norm, correlation additionally needs the sum (mean = sum / dims).
+ */
+struct RowStats {
+    double sum;       // Sum of all elements
+    double sq_norm;   // Sum of squared elements
+};
+
+/**
+ * Feature vectors of all database images stored row-major in one contiguous block.
+ * Replaces vector<vector<float>> for scanning so that rows are streamed through cache without pointer chasing.
+ * Mostly empty histograms (e.g. RGB) are kept in compressed sparse row form instead: the non-zero values of every
+ * row with their sorted bin indices, one row after another.
+ */
+struct FeatureMatrix {
+    size_t rows = 0;                // Number of images
+    size_t dims = 0;                // Length of each feature vector
+    bool sparse = false;            // Rows are stored as (index, value) pairs instead of in data
+    std::vector<float> data;        // rows x dims values (dense only)
+    std::vector<uint64_t> offsets;  // rows + 1 offsets into index and value (sparse only)
+    std::vector<uint32_t> index;    // Bin index of each non-zero value, ascending within a row (sparse only)
+    std::vector<float> value;       // Non-zero values (sparse only)
+    std::vector<RowStats> stats;    // Precomputed statistics for each row
+
+    /**
+     * Returns a pointer to the first element of the given row (dense only).
+     *
+     * @param i row index
+     * @return pointer to dims contiguous floats
+     */
+    const float* row(size_t i) const { return this->data.data() + i * this->dims; }
+
+    /**
+     * Sparse rows: number of non-zero values, their bin indices and the values themselves.
+     */
+    size_t nnz(size_t i) const { return this->offsets[i + 1] - this->offsets[i]; }
+    const uint32_t* row_index(size_t i) const { return this->index.data() + this->offsets[i]; }
+    const float* row_value(size_t i) const { return this->value.data() + this->offsets[i]; }
+
+    /**
+     * Average number of values a distance computation touches per row: dims when dense, non-zeros when sparse.
+     */
+    double row_cost() const { return this->sparse && this->rows > 0 ? static_cast<double>(this->index.size()) / this->rows : this->dims; }
+};
+
+/**
+ * Copies the feature vectors read from a CSV into a FeatureMatrix and precomputes row statistics.
+ * The matrix is stored sparse when the vectors are at least sparse_min_dims long and fewer than
+ * sparse_density_threshold of all values are non-zero; otherwise dense.
+ *
+ * @param vecs feature vectors (all must be the same length)
+ * @param fm output feature matrix
+ * @param allow_sparse false to always store dense
+ * @return 0 if successful, -1 if the vectors do not all have the same length
+ */
+int build_feature_matrix(const std::vector<std::vector<float>>& vecs, FeatureMatrix& fm, bool allow_sparse=true);
+
+/**
+ * Copies rows [begin, end) of a matrix into a new matrix with the same layout. The copy is allocated and written by
+ * the calling thread, so on a NUMA machine its pages land on that thread's node.
+ *
+ * @param src source matrix
+ * @param begin first row
+ * @param end one past the last row
+ * @param out output matrix with end - begin rows
+ */
+void slice_feature_matrix(const FeatureMatrix& src, size_t begin, size_t end, FeatureMatrix& out);
+
+/**
+ * A single vector in sparse form (sorted bin indices and their non-zero values).
+ */
+struct SparseVector {
+    std::vector<uint32_t> index;
+    std::vector<float> value;
+};
+
+/**
+ * Keeps the non-zero values of a dense vector.
+ *
+ * @param x dense vector
+ * @param n number of elements
+ * @param sv output sparse vector
+ */
+void make_sparse_vector(const float* x, size_t n, SparseVector& sv);
+
+/**
+ * What a dense query contributes against an all-zero row, per kernel. The distance to a sparse row is this baseline
+ * corrected on the row's non-zero bins only, so the work per row is proportional to its non-zero count.
+ */
+struct ZeroRowSums {
+    double sq;     // Sum of q^2                 (sum of squared differences)
+    double abs;    // Sum of |q|                 (sum of absolute differences)
+    double min;    // Sum of min(q, 0)           (intersection)
+    double chi;    // Sum of the chi-squared terms (q - 0)^2 / (q + 0)
+};
+
+/**
+ * Computes the zero-row baselines of a dense query.
+ *
+ * @param q dense query
+ * @param n number of elements
+ * @return baselines for the sparse-vs-dense kernels
+ */
+ZeroRowSums compute_zero_row_sums(const float* q, size_t n);
+
+/**
+ * Sparse-vs-dense kernels: q is a dense query with baselines z, the row has nnz values val at bins idx.
+ * Each returns the same sum as its dense counterpart over all dims elements.
+ */
+double sparse_dense_sum_sq_diff(const float* q, const ZeroRowSums& z, const uint32_t* idx, const float* val, size_t nnz);
+double sparse_dense_sum_abs_diff(const float* q, const ZeroRowSums& z, const uint32_t* idx, const float* val, size_t nnz);
+double sparse_dense_sum_min(const float* q, const ZeroRowSums& z, const uint32_t* idx, const float* val, size_t nnz);
+double sparse_dense_sum_chi_squared(const float* q, const ZeroRowSums& z, const uint32_t* idx, const float* val, size_t nnz);
+double sparse_dense_dot(const float* q, const uint32_t* idx, const float* val, size_t nnz);
+double sparse_dense_sum_sqrt_prod(const float* q, const uint32_t* idx, const float* val, size_t nnz);
+
+/**
+ * Sparse-vs-sparse kernels: a single merge over the two sorted index lists. Each returns the same sum as its dense
+ * counterpart.
+ */
+double sparse_sum_sq_diff(const SparseVector& a, const uint32_t* idx, const float* val, size_t nnz);
+double sparse_sum_abs_diff(const SparseVector& a, const uint32_t* idx, const float* val, size_t nnz);
+double sparse_sum_min(const SparseVector& a, const uint32_t* idx, const float* val, size_t nnz);
+double sparse_sum_chi_squared(const SparseVector& a, const uint32_t* idx, const float* val, size_t nnz);
+
+/**
+ * Computes sum and squared norm of a vector.
+ *
+ * @param x pointer to the vector
+ * @param n number of elements
+ * @return statistics of the vector
+ */
+RowStats compute_row_stats(const float* x, size_t n);
+
+/**
+ * Sum over i of (x[i] - y[i])^2.
+ */
+double kernel_sum_sq_diff(const float* x, const float* y, size_t n);
+
+/**
+ * Sum over i of |x[i] - y[i]|.
+ */
+double kernel_sum_abs_diff(const float* x, const float* y, size_t n);
+
+/**
+ * Sum over i of min(x[i], y[i]).
+ */
+double kernel_sum_min(const float* x, const float* y, size_t n);
+
+/**
+ * Sum over i of (x[i] - y[i])^2 / (x[i] + y[i]), skipping bins where x[i] + y[i] <= 0.0001.
+ */
+double kernel_sum_chi_squared(const float* x, const float* y, size_t n);
+
+/**
+ * Sum over i of x[i] * y[i].
+ */
+double kernel_dot(const float* x, const float* y, size_t n);
+
+/**
+ * Dot products of a tile of queries against a tile of rows: out[i * nx + j] = kernel_dot(q_i, x_j).
+ * Register blocked over 2 queries x 4 rows, so every loaded value feeds several FMAs and each row is read once
+ * per query pair instead of once per query.
+ *
+ * @param q nq x n queries, row major
+ * @param nq number of queries
+ * @param x nx x n rows, row major
+ * @param nx number of rows
+ * @param n values per vector
+ * @param out nq x nx dot products
+ */
+void kernel_dot_tile(const float* q, size_t nq, const float* x, size_t nx, size_t n, double* out);
+
+/**
+ * Sum over i of sqrt(x[i] * y[i]).
+ */
+double kernel_sum_sqrt_prod(const float* x, const float* y, size_t n);
+
+/**
+ * Early-abandon version of kernel_sum_sq_diff. Stops as soon as the running sum exceeds the budget.
+ *
+ * @param x first vector
+ * @param y second vector
+ * @param n number of elements
+ * @param budget largest sum the caller is still interested in
+ * @return the exact sum if it is <= budget, otherwise some partial sum > budget
+ */
+double kernel_sum_sq_diff_bounded(const float* x, const float* y, size_t n, double budget);
+
+/**
+ * Early-abandon version of kernel_sum_abs_diff. Same contract as kernel_sum_sq_diff_bounded.
+ */
+double kernel_sum_abs_diff_bounded(const float* x, const float* y, size_t n, double budget);
+
+/**
+ * Early-abandon version of kernel_sum_chi_squared. Same contract as kernel_sum_sq_diff_bounded.
+ */
+double kernel_sum_chi_squared_bounded(const float* x, const float* y, size_t n, double budget);
+
+/**
+ * Sums of x over every abandon_block chunk to the end of the vector: rest[c] = sum of x[c * abandon_block ...].
+ * Used by kernel_sum_min_bounded as the most the remaining chunks can still add.
+ *
+ * @param x vector (the query)
+ * @param n number of elements
+ * @param rest output, one entry per chunk plus a trailing 0
+ */
+void chunk_suffix_sums(const float* x, size_t n, std::vector<double>& rest);
+
+/**
+ * Early-abandon version of kernel_sum_min for a falling target. Since min(x[i], y[i]) <= x[i], the final sum can
+ * never exceed the running sum plus rest[c]; once that falls below floor the scan stops.
+ *
+ * @param x first vector (the one rest was computed for)
+ * @param y second vector
+ * @param n number of elements
+ * @param rest output of chunk_suffix_sums for x
+ * @param floor smallest sum the caller is still interested in
+ * @return the exact sum if it can reach floor, otherwise an upper bound on it that is < floor
+ */
+double kernel_sum_min_bounded(const float* x, const float* y, size_t n, const std::vector<double>& rest, double floor);
+
+/**
+ * Name of the instruction set the kernels were compiled for (avx512, avx2, neon or scalar).
+ * Printed by p2 so that a slow run can be traced back to a build without -mavx2.
+ */
+const char* kernel_isa_name();
+
+#endif //DIST_KERNELS_H
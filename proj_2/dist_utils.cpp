@@ -2,6 +2,9 @@
 // Created by Ajey K on 09/02/26.
 //
 
+#include <cstring>
+#include <limits>
+
 #include "dist_utils.h"
 
 #include "p2.h"
@@ -25,6 +28,84 @@ DistanceMetric parse_distance_metric(char c) {
     }
 }
 
+// Row kernels used by DistanceQuery. They apply the same final transform as the compute_* functions below but take
+// raw pointers and precomputed statistics so that nothing is allocated or recomputed per database row.
+
+static double row_ssd(const float* q, const float* x, size_t n, const RowStats& qs, const RowStats& xs) {
+    return kernel_sum_sq_diff(q, x, n) / n;
+}
+
+static double row_intersection(const float* q, const float* x, size_t n, const RowStats& qs, const RowStats& xs) {
+    return 1.0 - kernel_sum_min(q, x, n);
+}
+
+static double row_chi_squared(const float* q, const float* x, size_t n, const RowStats& qs, const RowStats& xs) {
+    return kernel_sum_chi_squared(q, x, n);
+}
+
+static double cosine_from_dot(double dot, const RowStats& qs, const RowStats& xs) {
+    double cosine = dot / (std::sqrt(qs.sq_norm) * std::sqrt(xs.sq_norm));
+    return 1.0 - cosine;  // Since normalized, all vectors are in a single quadrant. Therefore, cosine similarity will be between 0 and 1. So subtracting from 1 will make it distance.
+}
+
+static double row_cosine(const float* q, const float* x, size_t n, const RowStats& qs, const RowStats& xs) {
+    return cosine_from_dot(kernel_dot(q, x, n), qs, xs);
+}
+
+static double corelation_from_dot(double dot, size_t n, const RowStats& qs, const RowStats& xs) {
+    // sum((q - mq)(x - mx)) = dot - n*mq*mx and sum((q - mq)^2) = |q|^2 - n*mq^2, so only the dot product
+    // has to be computed per row.
+    double mean1 = qs.sum / n;
+    double mean2 = xs.sum / n;
+    double numerator = dot - n * mean1 * mean2;
+    double sum_sq1 = qs.sq_norm - n * mean1 * mean1;
+    double sum_sq2 = xs.sq_norm - n * mean2 * mean2;
+    double corelation = numerator / (std::sqrt(sum_sq1) * std::sqrt(sum_sq2));
+    return 1.0 - corelation;
+}
+
+static double row_corelation(const float* q, const float* x, size_t n, const RowStats& qs, const RowStats& xs) {
+    return corelation_from_dot(kernel_dot(q, x, n), n, qs, xs);
+}
+
+static double row_bhattacharya(const float* q, const float* x, size_t n, const RowStats& qs, const RowStats& xs) {
+    return -std::log(kernel_sum_sqrt_prod(q, x, n));
+}
+
+static double row_manhattan(const float* q, const float* x, size_t n, const RowStats& qs, const RowStats& xs) {
+    return kernel_sum_abs_diff(q, x, n);
+}
+
+/**
+ * Metrics that have a row kernel. Anything else (earth mover, custom metrics) falls back to compute_distance.
+ */
+static const std::map<DistanceMetric, RowDistanceFunction> row_distance_functions = {
+    {SSD, row_ssd},
+    {INTERSECTION, row_intersection},
+    {CHI_SQUARED, row_chi_squared},
+    {COSINE, row_cosine},
+    {CORELATION, row_corelation},
+    {BHATTACHARYA, row_bhattacharya},
+    {MANHATTAN, row_manhattan}
+};
+
+bool metric_from_dot(DistanceMetric metric) {
+    return metric == SSD || metric == COSINE || metric == CORELATION;
+}
+
+double distance_from_dot(DistanceMetric metric, double dot, size_t n, const RowStats& qs, const RowStats& xs) {
+    switch (metric) {
+        case SSD:
+            return std::max(0.0, qs.sq_norm + xs.sq_norm - 2.0 * dot) / n;
+        case COSINE:
+            return cosine_from_dot(dot, qs, xs);
+        case CORELATION:
+            return corelation_from_dot(dot, n, qs, xs);
+        default:
+            return 0.0;
+    }
+}
+
 double compute_distance(std::vector<float> const &x, std::vector<float> const &y, const DistanceMetric& metric) {
     std::map<DistanceMetric, DistanceFunction>::const_iterator it = distance_functions.find(metric);
     double ret = 0.0;
@@ -37,129 +118,232 @@ double compute_distance(std::vector<float> const &x, std::vector<float> const &y
 }
 
 double compute_ssd(const std::vector<float> &x, const std::vector<float> &y) {
-    double sum = 0.0;
-    for (size_t i = 0; i < x.size(); i++) {
-        double diff = x[i] - y[i];
-        sum += diff * diff;
-    }
+    double sum = kernel_sum_sq_diff(x.data(), y.data(), x.size());
     return sum / x.size();  // Lower => more similar
 }
 
 double compute_intersection(const std::vector<float> &x, const std::vector<float> &y) {
-    double intersection = 0.0;
-    for (size_t i = 0; i < x.size(); i++) {
-        intersection += std::min(x[i], y[i]);
-    }
+    double intersection = kernel_sum_min(x.data(), y.data(), x.size());
     return 1.0 - intersection;  // Convert to distance (0 = identical)
     // Lower = more similar
 }
 
 double compute_chi_squared(const std::vector<float> &x, const std::vector<float> &y) {
-    double chi_squared = 0.0;
-    for (size_t i = 0; i < x.size(); i++) {
-        float sum = x[i] + y[i];
-        if (sum > 0.0001) {
-            float diff = x[i] - y[i];
-            chi_squared += (diff * diff) / sum;
+    double chi_squared = kernel_sum_chi_squared(x.data(), y.data(), x.size());
+    return chi_squared;  // Lower => more similar
+}
+
+EmdShape emd_shape_for(HistogramType hist_type, size_t length) {
+    EmdShape shape;
+    switch (hist_type) {
+        case RG_CHROMATICITY:
+        case HS: {
+            size_t b = static_cast<size_t>(std::lround(std::sqrt(static_cast<double>(length))));
+            shape.dims = {b, b};
+            break;
+        }
+        case RGB: {
+            size_t b = static_cast<size_t>(std::lround(std::cbrt(static_cast<double>(length))));
+            shape.dims = {b, b, b};
+            break;
         }
+        case SOBEL_MAGvORN_2D:
+            shape.dims = {length / angle_bins, angle_bins};
+            break;
+        case LAW:
+            shape.blocks = std::size(laws_filters);
+            shape.dims = {length / shape.blocks};
+            break;
+        default:
+            shape.dims = {length};
+            break;
     }
-    return chi_squared;  // Lower => more similar
+    if (shape.blocks * shape.block_size() != length) {
+        shape.blocks = 1;
+        shape.dims = {length};
+    }
+    return shape;
 }
 
-double compute_emd_approx(const std::vector<float> &x, const std::vector<float> &y) {
-    // TODO
-    return 0.0;
+double compute_emd_approx(const std::vector<float> &x, const std::vector<float> &y, const EmdShape& shape) {
+    const EmdGround& ground = emd_ground(shape);
+    if (x.size() != ground.length() || y.size() != ground.length()) {
+        return compute_earth_mover(x, y);
+    }
+    return ground.distance(x.data(), y.data());
 }
 
 double compute_earth_mover(const std::vector<float> &x, const std::vector<float> &y) {
-    size_t n  = x.size();
-    if (n > 32) {
-        compute_emd_approx(x, y);
-        return 0;
-    }
-    std::vector<double> cdf1(n);
-    std::vector<double> cdf2(n);
+    return emd_1d(x.data(), y.data(), std::min(x.size(), y.size()));
+}
 
-    cdf1[0] = x[0];
-    cdf2[0] = y[0];
+double compute_cosine_similarity(const std::vector<float> &x, const std::vector<float> &y) {
+    RowStats xs = compute_row_stats(x.data(), x.size());
+    RowStats ys = compute_row_stats(y.data(), y.size());
+    return row_cosine(x.data(), y.data(), x.size(), xs, ys);
+}
 
-    for (size_t i = 1; i < n; i++) {
-        cdf1[i] = cdf1[i - 1] + x[i];
-        cdf2[i] = cdf2[i - 1] + y[i];
-    }
-    double sum = 0.0;
-    for (size_t i = 0; i < n; i++) {
-        sum += std::abs(cdf1[i] - cdf2[i]);
-    }
-    return sum;
+double compute_corelation(const std::vector<float> &x, const std::vector<float> &y) {
+    RowStats xs = compute_row_stats(x.data(), x.size());
+    RowStats ys = compute_row_stats(y.data(), y.size());
+    return row_corelation(x.data(), y.data(), x.size(), xs, ys);
+}
 
+double compute_bhattacharya(const std::vector<float> &x, const std::vector<float> &y) {
+    double b = kernel_sum_sqrt_prod(x.data(), y.data(), x.size());
+    return -std::log(b);  // Lower = more similar
 }
 
-double compute_cosine_similarity(const std::vector<float> &x, const std::vector<float> &y) {
-    double dot = 0.0;
-    double mag1 = 0.0;
-    double mag2 = 0.0;
+double compute_manhattan(const std::vector<float> &x, const std::vector<float> &y) {
+    double sum = kernel_sum_abs_diff(x.data(), y.data(), x.size());
+    return sum;  // Lower => similar
+}
 
-    for (size_t i = 0; i < x.size(); i++) {
-        dot += x[i] * y[i];
-        mag1 += x[i] * x[i];
-        mag2 += y[i] * y[i];
-    }
-    double cosine = dot / (std::sqrt(mag1) * std::sqrt(mag2));
-    return 1.0 - cosine;  // Since normalized, all vectors are in a single quadrant. Therefore, cosine similarity will be between 0 and 1. So subtracting from 1 will make it distance.
+double compute_custom_perceptual_distance(const std::vector<float> &x, const std::vector<float> &y) {
+    return 0;  // TODO
 }
 
-double compute_corelation(const std::vector<float> &x, const std::vector<float> &y) {
-    int n = x.size();
+double compute_custom_weighted_combo(const std::vector<float> &x, const std::vector<float> &y) {
+    return 0;  // TODO
+}
 
-    double mean1 = 0.0;
-    double mean2 = 0.0;
-    for (int i = 0; i < n; i++) {
-        mean1 += x[i];
-        mean2 += y[i];
+DistanceQuery::DistanceQuery(const std::vector<float>& query, DistanceMetric metric, const EmdShape& shape) : query(query), metric(metric), emd(nullptr) {
+    this->query_stats = compute_row_stats(this->query.data(), this->query.size());
+    this->query_zero = compute_zero_row_sums(this->query.data(), this->query.size());
+    if (this->query.size() > sparse_dense_query_max_dims) {
+        make_sparse_vector(this->query.data(), this->query.size(), this->query_sparse);
     }
-    mean1 /= n;
-    mean2 /= n;
-
-    double numerator = 0.0;
-    double sum_sq1 = 0.0;
-    double sum_sq2 = 0.0;
-
-    for (int i = 0; i < n; i++) {
-        double diff1 = x[i] - mean1;
-        double diff2 = y[i] - mean2;
+    std::map<DistanceMetric, RowDistanceFunction>::const_iterator it = row_distance_functions.find(metric);
+    this->row_fn = (it == row_distance_functions.end()) ? nullptr : it->second;
+    if (metric == INTERSECTION) {
+        chunk_suffix_sums(this->query.data(), this->query.size(), this->query_rest);
+    }
+    if (metric == EARTH_MOVER && (shape.blocks > 1 || shape.dims.size() > 1) && shape.blocks * shape.block_size() == this->query.size()) {
+        this->emd = &emd_ground(shape);
+    }
+}
 
-        numerator += diff1 * diff2;
-        sum_sq1 += diff1 * diff1;
-        sum_sq2 += diff2 * diff2;
+double DistanceQuery::emd_distance(const float* x) const {
+    if (this->emd == nullptr) {
+        return emd_1d(this->query.data(), x, this->query.size());
     }
-    double corelation = numerator / (sqrt(sum_sq1) * sqrt(sum_sq2));
-    return 1.0 - corelation;
+    return this->emd->distance(this->query.data(), x);
 }
 
-double compute_bhattacharya(const std::vector<float> &x, const std::vector<float> &y) {
-    double b = 0.0;
-    for (size_t i = 0; i < x.size(); i++) {
-        b += std::sqrt(x[i] * y[i]);
+double DistanceQuery::sparse_distance(const FeatureMatrix& fm, size_t row) const {
+    const float* q = this->query.data();
+    const uint32_t* idx = fm.row_index(row);
+    const float* val = fm.row_value(row);
+    size_t nnz = fm.nnz(row);
+    size_t n = fm.dims;
+    bool merge = n > sparse_dense_query_max_dims;
+    const SparseVector& qs = this->query_sparse;
+    switch (this->metric) {
+        case SSD:
+            return (merge ? sparse_sum_sq_diff(qs, idx, val, nnz) : sparse_dense_sum_sq_diff(q, this->query_zero, idx, val, nnz)) / n;
+        case MANHATTAN:
+            return merge ? sparse_sum_abs_diff(qs, idx, val, nnz) : sparse_dense_sum_abs_diff(q, this->query_zero, idx, val, nnz);
+        case INTERSECTION:
+            return 1.0 - (merge ? sparse_sum_min(qs, idx, val, nnz) : sparse_dense_sum_min(q, this->query_zero, idx, val, nnz));
+        case CHI_SQUARED:
+            return merge ? sparse_sum_chi_squared(qs, idx, val, nnz) : sparse_dense_sum_chi_squared(q, this->query_zero, idx, val, nnz);
+        case COSINE:
+            return cosine_from_dot(sparse_dense_dot(q, idx, val, nnz), this->query_stats, fm.stats[row]);
+        case CORELATION:
+            return corelation_from_dot(sparse_dense_dot(q, idx, val, nnz), n, this->query_stats, fm.stats[row]);
+        case BHATTACHARYA:
+            return -std::log(sparse_dense_sum_sqrt_prod(q, idx, val, nnz));
+        default: {
+            std::vector<float> x(n, 0.0f);
+            for (size_t k = 0; k < nnz; k++) {
+                x[idx[k]] = val[k];
+            }
+            if (this->metric == EARTH_MOVER) {
+                return this->emd_distance(x.data());
+            }
+            return compute_distance(this->query, x, this->metric);
+        }
     }
+}
 
-    return -std::log(b);  // Lower = more similar
+double DistanceQuery::distance(const FeatureMatrix& fm, size_t row) const {
+    if (fm.sparse) {
+        return this->sparse_distance(fm, row);
+    }
+    if (this->metric == EARTH_MOVER) {
+        return this->emd_distance(fm.row(row));
+    }
+    if (this->row_fn == nullptr) {
+        std::vector<float> x(fm.row(row), fm.row(row) + fm.dims);
+        return compute_distance(this->query, x, this->metric);
+    }
+    return this->row_fn(this->query.data(), fm.row(row), fm.dims, this->query_stats, fm.stats[row]);
 }
 
-double compute_manhattan(const std::vector<float> &x, const std::vector<float> &y) {
-    double sum = 0.0;
-    for (size_t i = 0; i < x.size(); i++) {
-        sum += std::abs(y[i] - x[i]);
+int DistanceQuery::distances(const FeatureMatrix& fm, std::vector<double>& out) const {
+    if (fm.rows > 0 && fm.dims != this->query.size()) {
+        std::cout << "Query vector has " << this->query.size() << " values but the feature matrix has " << fm.dims << std::endl;
+        return -1;
     }
-    return sum;  // Lower => similar
+    out.resize(fm.rows);
+    for (size_t i = 0; i < fm.rows; i++) {
+        out[i] = this->distance(fm, i);
+    }
+    return 0;
 }
 
-double compute_custom_perceptual_distance(const std::vector<float> &x, const std::vector<float> &y) {
-    return 0;  // TODO
+double DistanceQuery::lower_bound(const FeatureMatrix& fm, size_t row) const {
+    const RowStats& xs = fm.stats[row];
+    const RowStats& qs = this->query_stats;
+    double lb = 0.0;
+    switch (this->metric) {
+        case SSD: {
+            double d = std::sqrt(qs.sq_norm) - std::sqrt(xs.sq_norm);
+            lb = d * d / fm.dims;
+            break;
+        }
+        case MANHATTAN:
+            lb = std::abs(qs.sum - xs.sum);
+            break;
+        case INTERSECTION:
+            lb = 1.0 - std::min(qs.sum, xs.sum);
+            break;
+        case BHATTACHARYA:
+            if (qs.sum > 0.0 && xs.sum > 0.0) {
+                lb = -0.5 * std::log(qs.sum * xs.sum);
+            }
+            break;
+        case EARTH_MOVER:
+            if (this->emd == nullptr || fm.sparse) {
+                return 0.0;
+            }
+            lb = this->emd->lower_bound(this->query.data(), fm.row(row));
+            break;
+        default:
+            return 0.0;
+    }
+    return lb - bound_slack * std::abs(lb);
 }
 
-double compute_custom_weighted_combo(const std::vector<float> &x, const std::vector<float> &y) {
-    return 0;  // TODO
+double DistanceQuery::distance_bounded(const FeatureMatrix& fm, size_t row, double budget) const {
+    if (fm.sparse) {
+        return this->sparse_distance(fm, row);  // already proportional to the row's non-zero count
+    }
+    const float* q = this->query.data();
+    const float* x = fm.row(row);
+    size_t n = fm.dims;
+    switch (this->metric) {
+        case SSD:
+            return kernel_sum_sq_diff_bounded(q, x, n, budget * n) / n;
+        case MANHATTAN:
+            return kernel_sum_abs_diff_bounded(q, x, n, budget);
+        case CHI_SQUARED:
+            return kernel_sum_chi_squared_bounded(q, x, n, budget);
+        case INTERSECTION:
+            return 1.0 - kernel_sum_min_bounded(q, x, n, this->query_rest, 1.0 - budget);
+        default:
+            return this->distance(fm, row);
+    }
 }
 
 int Distance::prep_configs() {
@@ -186,7 +370,7 @@ int Distance::prep_configs() {
     return 0;
 }
 
-Distance::Distance(fs::path& tgt_file, std::string& spec, std::vector<fs::path>& vf, std::vector<std::pair<double, fs::path>>& op) : tgt_file(tgt_file), spec(spec), vec_files(vf), op(op) {
+Distance::Distance(fs::path& tgt_file, std::string& spec, std::vector<fs::path>& vf, SearchResults& op, size_t k, bool use_cache) : tgt_file(tgt_file), spec(spec), vec_files(vf), num_images(0), op(op), k(k), shown(0), cache(use_cache), loaded(false) {
     // this->tgt_file = tgt_file;
     // this->spec = spec;
     // this->vec_files = vf;
@@ -196,48 +380,95 @@ Distance::Distance(fs::path& tgt_file, std::string& spec, std::vector<fs::path>&
     //           << " part configs" << std::endl;
 }
 
+size_t append_result_rows(const std::vector<ScoredRow>& rows, size_t from, const std::vector<char*>& names, bool absolute, SearchResults& op) {
+    for (size_t i = from; i < rows.size(); i++) {
+        fs::path p(names[rows[i].row]);
+        if (absolute) {
+            p = fs::absolute(p);
+        }
+        op.emplace_back(rows[i].dist, p);
+    }
+    return rows.size() > from ? rows.size() - from : 0;
+}
+
+size_t append_result_page(RankedPager& pager, size_t k, const std::vector<char*>& names, bool absolute, SearchResults& op) {
+    std::vector<ScoredRow> page;
+    pager.next(k, page);
+    return append_result_rows(page, 0, names, absolute, op);
+}
+
 int Distance::calculate_classic() {
+    if (this->cache.enabled() && hash_file(this->tgt_file, this->tgt_hash) == 0) {
+        this->ranking_key = "classic|" + std::to_string(feature_version) + "|" + this->tgt_hash + "|" + this->spec;
+        for (const fs::path& f : this->vec_files) {
+            this->ranking_key += "|" + store_version(f);
+        }
+        if (this->cache.load_ranking(this->ranking_key, this->ranking) && !this->ranking.rows.empty()) {
+            std::cout << "Query cache hit: " << this->ranking.rows.size() << " ranked results of " << this->ranking.total << " images." << std::endl;
+            this->num_images = this->ranking.total;
+            this->next_page();
+            return 0;
+        }
+    }
+    this->load_parts();
+    this->next_page();
+    return 0;
+}
+
+int Distance::load_parts() {
     this->num_images = 0;
+    this->queries.clear();
+    ImagePlanes tgt_planes(this->tgt_file);  // Shared by every part of the target, decoded only on a cache miss
     for (PartConfig& pcfg : this->pc) {
         std::cout << "Working on:\nPart: " << pcfg.part_name << "\nHistogram_type: " << HISTOGRAM_NAMES.at(pcfg.hist_type) << "\nDistance Metric: " << DISTMETRIC_NAMES.at(pcfg.metric) << "\nWeight: " << pcfg.weight << std::endl;
-        std::vector<char*> db_imgs;
-        int read_resp = read_image_data_csv(pcfg.feature_file.string().c_str(), db_imgs, pcfg.img_vecs);
-        if (read_resp != 0) {
+        std::vector<std::vector<float>> img_vecs;
+        int read_resp = read_image_data_csv(pcfg.feature_file.string().c_str(), pcfg.img_names, img_vecs);
+        int version = read_resp == 0 ? take_feature_version(pcfg.img_names, img_vecs) : 0;
+        if (read_resp != 0 || build_feature_matrix(img_vecs, pcfg.matrix) != 0) {
             std::cout << "Unable to read file containing feature vectors: " << pcfg.feature_file << std::endl;
             std::exit(-1);
         }
-        std::cout << "Images to be compared." << std::endl;
-        for (const char* p : db_imgs) {
-            std::cout << p << std::endl;
-            fs::path tp(p);
-            pcfg.img_names.push_back(tp);
+        if (version != feature_version) {
+            std::cout << "Feature file was written by a different version of p1 (" << version << ", expected " << feature_version
+                      << "). Regenerate it with ./p1 -m-: " << pcfg.feature_file << std::endl;
+            std::exit(-1);
         }
         size_t num_imgs_in_part_cfg = pcfg.img_names.size();
         std::cout << "Number of images in this part: " << num_imgs_in_part_cfg << std::endl;
+        if (pcfg.matrix.sparse) {
+            std::cout << "Stored sparse: " << pcfg.matrix.row_cost() << " of " << pcfg.matrix.dims << " values non-zero per image on average" << std::endl;
+        }
         if (this->num_images == 0) {
             this->num_images = num_imgs_in_part_cfg;
         }
         if (this->num_images != num_imgs_in_part_cfg) {
             std::cout << "Not all configs have the same number of images!\nSize 1 = " << this->num_images << "\nSize in this PartConfig = " << num_imgs_in_part_cfg << std::endl;
-        }
-        int res = compute_histogram(this->tgt_file, pcfg.target_vector, pcfg.hist_type, pcfg.part_name);
-        if (res != 0) {
-            std::cout << "Error computing histogram for target image." << std::endl;
             std::exit(-1);
         }
-        for (size_t i = 0; i < pcfg.img_names.size(); i++) {
-            double diff = compute_distance(pcfg.target_vector, pcfg.img_vecs[i], pcfg.metric);
-            // diff *= pcfg.weight;
-            std::pair<double, fs::path> tmp_pair(diff, pcfg.img_names[i]);
-            pcfg.diff_values.push_back(tmp_pair);
+        std::string hist_key = "hist|" + std::to_string(feature_version) + "|" + this->tgt_hash + "|" + pcfg.part_name + "|"
+                               + std::to_string(static_cast<int>(pcfg.hist_type)) + "|" + store_version(pcfg.feature_file);
+        if (this->tgt_hash.empty() || !this->cache.load_histogram(hist_key, pcfg.target_vector)) {
+            int res = compute_histogram(tgt_planes, pcfg.target_vector, pcfg.hist_type, pcfg.part_name);
+            if (res != 0) {
+                std::cout << "Error computing histogram for target image." << std::endl;
+                std::exit(-1);
+            }
+            if (!this->tgt_hash.empty()) {
+                this->cache.save_histogram(hist_key, pcfg.target_vector);
+            }
         }
+        if (pcfg.target_vector.size() != pcfg.matrix.dims) {
+            std::cout << "Target histogram does not match the feature file: " << pcfg.feature_file << std::endl;
+            std::exit(-1);
+        }
+        this->queries.emplace_back(pcfg.target_vector, pcfg.metric, emd_shape_for(pcfg.hist_type, pcfg.matrix.dims));
     }
     std::cout << "Validating all CSVs have same images..." << std::endl;
     for (size_t i = 0; i < this->num_images; i++) {
-        fs::path reference = this->pc[0].img_names[i];
+        const char* reference = this->pc[0].img_names[i];
 
         for (const PartConfig& pcfg : this->pc) {
-            if (pcfg.img_names[i] != reference) {
+            if (std::strcmp(pcfg.img_names[i], reference) != 0) {
                 std::cout << "Image order mismatch at index " << i << std::endl;
                 std::cout << "Expected: " << reference << std::endl;
                 std::cout << "Got: " << pcfg.img_names[i] << std::endl;
@@ -246,28 +477,161 @@ int Distance::calculate_classic() {
         }
     }
     std::cout << "Validation passed!" << std::endl;
-    for (int i = 0; i < this->num_images; i++) {
-        // std::cout << i << std::endl;
-        double total_diff = 0.0;
-        fs::path tmp;
+
+    std::vector<WeightedPart> parts;
+    for (size_t p = 0; p < this->pc.size(); p++) {
+        parts.push_back({&this->queries[p], &this->pc[p].matrix, this->pc[p].weight});
+    }
+    order_parts_by_cost(parts);
+    this->scan.prepare(parts, this->num_images);
+    if (this->scan.shards() > 1) {
+        std::cout << "Scanning in " << this->scan.shards() << " shards." << std::endl;
         for (PartConfig& pcfg : this->pc) {
-            // std::cout << "Part: " << pcfg.part_name << std::endl;
-            // std::cout << std::setprecision(10) << pcfg.diff_values[i].first << std::endl;
-            total_diff += pcfg.diff_values[i].first * pcfg.weight;
-            if (tmp.empty()) {
-                tmp = pcfg.img_names[i];
-            }
-            if (tmp != pcfg.img_names[i]) {
-                std::cout << "Filenames do not match." << std::endl;
-                std::exit(-1);
+            pcfg.matrix = FeatureMatrix();  // The shards hold their own copies
+        }
+    }
+    this->loaded = true;
+    return 0;
+}
+
+void order_parts_by_cost(std::vector<WeightedPart>& parts) {
+    std::erase_if(parts, [](const WeightedPart& p) {return p.weight <= 0.0;});
+    std::ranges::sort(parts, [](const WeightedPart& a, const WeightedPart& b) {
+        return a.matrix->row_cost() / a.weight < b.matrix->row_cost() / b.weight;
+    });
+}
+
+int pruned_scan(const std::vector<WeightedPart>& parts, size_t begin, size_t end, TopK& top, PruneStats& stats) {
+    size_t num_parts = parts.size();
+    std::vector<double> bounds(num_parts);
+    for (size_t i = begin; i < end; i++) {
+        double threshold = top.threshold();
+        double remaining = 0.0;
+        for (size_t j = 0; j < num_parts; j++) {
+            bounds[j] = parts[j].weight * parts[j].query->lower_bound(*parts[j].matrix, i);
+            remaining += bounds[j];
+        }
+        if (remaining > threshold) {
+            stats.skipped++;
+            continue;
+        }
+        double total = 0.0;
+        bool dropped = false;
+        for (size_t j = 0; j < num_parts; j++) {
+            double w = parts[j].weight;
+            remaining -= bounds[j];
+            double budget = (threshold - total - remaining) / w;
+            total += w * parts[j].query->distance_bounded(*parts[j].matrix, i, budget);
+            if (total + remaining > threshold) {
+                dropped = true;
+                break;
             }
         }
-        std::pair<double, fs::path> tmp_pair(total_diff, tmp);
-        this->op.push_back(tmp_pair);
+        if (dropped) {
+            stats.abandoned++;
+            continue;
+        }
+        top.push(total, i);
+    }
+    return 0;
+}
+
+int pruned_search(const std::vector<WeightedPart>& parts, size_t rows, size_t want, std::vector<ScoredRow>& out, PruneStats& stats) {
+    TopK top(want);
+    pruned_scan(parts, 0, rows, top, stats);
+    out = top.sorted();
+    return 0;
+}
+
+int ShardedScan::prepare(const std::vector<WeightedPart>& parts, size_t rows) {
+    this->rows = rows;
+    this->parts = parts;
+    size_t num_shards = shard_count(rows);
+    this->pool.reset();
+    this->local.clear();
+    this->shard_parts.clear();
+    this->bounds.clear();
+    if (num_shards <= 1) {
+        return 0;
+    }
+    for (size_t s = 0; s <= num_shards; s++) {
+        this->bounds.push_back(rows * s / num_shards);
+    }
+    this->local.resize(num_shards);
+    this->shard_parts.assign(num_shards, parts);
+    this->pool = std::make_unique<ShardPool>(num_shards);
+    this->pool->run([this](size_t s) {
+        // First touch: the copy is allocated and written by the worker that will scan it.
+        std::vector<FeatureMatrix>& mine = this->local[s];
+        mine.resize(this->parts.size());
+        for (size_t p = 0; p < this->parts.size(); p++) {
+            slice_feature_matrix(*this->parts[p].matrix, this->bounds[s], this->bounds[s + 1], mine[p]);
+            this->shard_parts[s][p].matrix = &mine[p];
+        }
+    });
+    return 0;
+}
+
+size_t ShardedScan::shards() const {
+    return this->pool ? this->pool->size() : 1;
+}
+
+int ShardedScan::search(size_t want, std::vector<ScoredRow>& out, PruneStats& stats) {
+    if (!this->pool) {
+        return pruned_search(this->parts, this->rows, want, out, stats);
+    }
+    size_t num_shards = this->pool->size();
+    std::vector<TopK> tops(num_shards, TopK(want));
+    std::vector<PruneStats> shard_stats(num_shards);
+    this->pool->run([&](size_t s) {
+        pruned_scan(this->shard_parts[s], 0, this->bounds[s + 1] - this->bounds[s], tops[s], shard_stats[s]);
+    });
+    TopK top(want);
+    for (size_t s = 0; s < num_shards; s++) {
+        for (const ScoredRow& r : tops[s].sorted()) {
+            top.push(r.dist, r.row + this->bounds[s]);  // Shard rows are numbered from 0
+        }
+        stats.skipped += shard_stats[s].skipped;
+        stats.abandoned += shard_stats[s].abandoned;
     }
-    std::ranges::sort(this->op);
+    out = top.sorted();
     return 0;
+}
 
+int Distance::search(size_t want, std::vector<ScoredRow>& out) {
+    PruneStats stats;
+    this->scan.search(want, out, stats);
+    std::cout << "Pruned search for top " << want << ": " << stats.skipped << " images rejected by bounds, " << stats.abandoned << " abandoned part way, " << (this->num_images - stats.skipped - stats.abandoned) << " fully evaluated." << std::endl;
+    return 0;
+}
+
+size_t Distance::next_page() {
+    if (this->shown >= this->num_images) {
+        return 0;
+    }
+    size_t want = std::min(this->shown + this->k, this->num_images);
+    if (this->ranking.rows.size() < want) {
+        if (!this->loaded) {
+            this->load_parts();
+        }
+        std::vector<ScoredRow> best;
+        this->search(want, best);
+        this->ranking.total = this->num_images;
+        this->ranking.rows.clear();
+        for (const ScoredRow& r : best) {
+            this->ranking.rows.emplace_back(r.dist, this->pc[0].img_names[r.row]);
+        }
+        if (!this->ranking_key.empty()) {
+            this->cache.save_ranking(this->ranking_key, this->ranking);
+        }
+    }
+    size_t added = 0;
+    for (size_t i = this->shown; i < std::min(want, this->ranking.rows.size()); i++) {
+        this->op.emplace_back(this->ranking.rows[i].first, fs::path(this->ranking.rows[i].second));
+        added++;
+    }
+    this->shown += added;
+    return added;
 }
 
 int MyDNN::prep_config() {
@@ -277,7 +641,7 @@ int MyDNN::prep_config() {
 }
 
 MyDNN::MyDNN(fs::path &tgt_file, std::string &spec, std::vector<fs::path> &vf,
-             std::vector<std::pair<double, fs::path>>& op) : tgt_file(tgt_file), spec(spec), vec_files(vf), op(op) {
+             SearchResults& op, size_t k, const AnnOptions& ann) : tgt_file(tgt_file), spec(spec), vec_files(vf), op(op), k(k), ann(ann), use_index(false), shown(0) {
     // this->tgt_file = tgt_file;
     // this->spec = spec;
     // this->vec_files = vf;
@@ -287,53 +651,113 @@ MyDNN::MyDNN(fs::path &tgt_file, std::string &spec, std::vector<fs::path> &vf,
 
 int MyDNN::calculate_dnn() {
     std::cout << "Running Distance Metric: " << DISTMETRIC_NAMES.at(this->metric) << " for DNN embeddings." << std::endl;
-    std::vector<char*> db_imgs;
-    int target_read_resp = read_image_data_csv(tgt_file.string().c_str(), db_imgs, this->img_vecs);
-    if (target_read_resp != 0 || this->img_vecs.empty()) {
+    std::vector<char*> tgt_imgs;
+    std::vector<std::vector<float>> tgt_vecs;
+    int target_read_resp = read_image_data_csv(tgt_file.string().c_str(), tgt_imgs, tgt_vecs);
+    if (target_read_resp != 0 || tgt_vecs.empty()) {
         std::cout << "Unable to read Target file containing feature vectors: " << this->tgt_file << std::endl;
         std::exit(-1);
     }
-    fs::path tgt_img_name(db_imgs[0]);
-    this->tgt_vector = this->img_vecs[0];
+    fs::path tgt_img_name(tgt_imgs[0]);
+    this->tgt_vector = tgt_vecs[0];
     std::cout << "Target image name: " << tgt_img_name << std::endl;
 
-    db_imgs.clear();
-    this->img_vecs.clear();
+    if (vec_files[0].extension() == ivf_file_format) {
+        this->use_index = true;
+        this->prepare_index();
+        this->next_page();
+        return 0;
+    }
+
     // std::cout << "First five values Target vector: " << std::endl;
     // for (int i = 0; i  < 5; i++) {
     //     std::cout << this->tgt_vector[i] << std::endl;
     // }
-    // Ensure img_vecs is empty.
-    std::cout << "Size of image_vecs after clearing = " << this->img_vecs.size() << std::endl;
-    if (this->img_vecs.size() != 0) {
-        std::cout << "image_vecs after clearing is not empty!" << std::endl;
+    std::vector<std::vector<float>> db_vecs;
+    int read_resp = read_image_data_csv(vec_files[0].string().c_str(), this->img_names, db_vecs);
+    if (read_resp != 0 || build_feature_matrix(db_vecs, this->img_vecs) != 0) {
+        std::cout << "Unable to read file containing feature vectors: " << vec_files[0] << std::endl;
         std::exit(-1);
     }
-    int read_resp = read_image_data_csv(vec_files[0].string().c_str(), db_imgs, this->img_vecs);
-    if (read_resp != 0) {
-        std::cout << "Unable to read file containing feature vectors: " << vec_files[0] << std::endl;
+    std::cout << "Number of images to be compared: " << this->img_names.size() << std::endl;
+
+    DistanceQuery query(this->tgt_vector, this->metric);
+    if (query.distances(this->img_vecs, this->diffs) != 0) {
+        std::cout << "Target embedding does not match the embeddings file: " << vec_files[0] << std::endl;
         std::exit(-1);
     }
-    std::cout << "Images to be compared." << std::endl;
-    for (const char* p : db_imgs) {
-        std::cout << p << std::endl;
-        fs::path tp(p);
-        this->img_names.push_back(tp);
+    this->pager.reset(this->diffs);
+    this->next_page();
+    return 0;
+}
+
+/**
+ * Fraction of the exact top-K rows that also appear in an approximate top-K.
+ */
+static double recall_at_k(const std::vector<ScoredRow>& approx, const std::vector<ScoredRow>& exact) {
+    std::set<size_t> exact_rows;
+    for (const ScoredRow& s : exact) {
+        exact_rows.insert(s.row);
+    }
+    size_t hits = 0;
+    for (const ScoredRow& s : approx) {
+        hits += exact_rows.count(s.row);
     }
-    size_t num_imgs = this->img_names.size();
+    return exact.empty() ? 1.0 : static_cast<double>(hits) / exact.size();
+}
 
-    for (size_t i = 0; i < num_imgs; i++) {
-        double diff = compute_distance(this->tgt_vector, this->img_vecs[i], this->metric);
-        std::pair<double, fs::path> tmp_pair(diff, this->img_names[i]);
-        this->op.push_back(tmp_pair);
+int MyDNN::prepare_index() {
+    if (this->index.open(vec_files[0]) != 0) {
+        std::exit(-1);
+    }
+    IvfMetric wanted;
+    if (parse_ivf_metric(this->spec[0], wanted) != 0 || wanted != this->index.metric()) {
+        std::cout << "Index " << vec_files[0] << " was built for a different metric than -d-" << this->spec << std::endl;
+        std::exit(-1);
+    }
+    if (this->index.dims() != this->tgt_vector.size()) {
+        std::cout << "Target embedding does not match the index: " << vec_files[0] << std::endl;
+        std::exit(-1);
     }
-    std::ranges::sort(this->op);
+    std::cout << "Searching index with " << this->index.rows() << " embeddings in " << this->index.nlist() << " lists, nprobe = " << this->ann.nprobe << std::endl;
+    if (!this->ann.verify) {
+        return 0;
+    }
+
+    std::vector<ScoredRow> approx;
+    std::vector<ScoredRow> exact;
+    cr::steady_clock::time_point t0 = cr::steady_clock::now();
+    this->index.search(this->tgt_vector, this->k, this->ann.nprobe, approx);
+    cr::steady_clock::time_point t1 = cr::steady_clock::now();
+    this->index.search_exact(this->tgt_vector, this->k, exact);
+    cr::steady_clock::time_point t2 = cr::steady_clock::now();
+
+    std::cout << "Verify: recall@" << this->k << " = " << recall_at_k(approx, exact)
+              << " (approximate " << cr::duration<double, std::milli>(t1 - t0).count() << " ms, brute force "
+              << cr::duration<double, std::milli>(t2 - t1).count() << " ms)" << std::endl;
     return 0;
 }
 
+size_t MyDNN::next_page() {
+    if (!this->use_index) {
+        return append_result_page(this->pager, this->k, this->img_names, false, this->op);
+    }
+    if (this->shown >= this->index.rows()) {
+        return 0;
+    }
+    std::vector<ScoredRow> best;
+    this->index.search(this->tgt_vector, this->shown + std::min(this->k, this->index.rows()), this->ann.nprobe, best);
+    for (size_t i = this->shown; i < best.size(); i++) {
+        this->op.emplace_back(best[i].dist, fs::path(this->index.name(best[i].row)));
+    }
+    size_t added = best.size() > this->shown ? best.size() - this->shown : 0;
+    this->shown += added;
+    return added;
+}
+
 
 Basic::Basic(fs::path &tgt_file, std::string &spec, std::vector<fs::path> &vf,
-             std::vector<std::pair<double, fs::path>>& op) : tgt_file(tgt_file), spec(spec), vec_files(vf), op(op) {
+             SearchResults& op, size_t k) : tgt_file(tgt_file), spec(spec), vec_files(vf), op(op), k(k) {
     // this->tgt_file = tgt_file;
     // this->spec = spec;
     // this->vec_files = vf;
@@ -343,42 +767,58 @@ Basic::Basic(fs::path &tgt_file, std::string &spec, std::vector<fs::path> &vf,
 
 int Basic::calculate_basic() {
     std::cout << "Running Distance Metric: " << DISTMETRIC_NAMES.at(this->metric) << " for Basic matching." << std::endl;
-    std::vector<char*> db_imgs;
-    std::vector<std::vector<float>> dummy;
-    int csv_read_resp = read_image_data_csv(vec_files[0].string().c_str(), db_imgs, dummy);
-    if (csv_read_resp != 0 || db_imgs.empty()) {
+    std::vector<std::vector<float>> db_vecs;
+    int csv_read_resp = read_image_data_csv(vec_files[0].string().c_str(), this->img_paths, db_vecs);
+    if (csv_read_resp != 0 || this->img_paths.empty()) {
         std::cout << "Unable to read CSV file containing feature vectors: " << vec_files[0] << std::endl;
         std::exit(-1);
     }
-    std::cout << "Images to be compared." << std::endl;
-    for (const char* p : db_imgs) {
-        std::cout << p << std::endl;
-        fs::path tp(fs::absolute(p));
-        this->img_paths.push_back(tp);
-    }
+    std::cout << "Number of images to be compared: " << this->img_paths.size() << std::endl;
 
     std::string basic_box_part_name = "W";
-    compute_histogram(this->tgt_file, this->tgt_vector, HistogramType::BASIC_BOX, basic_box_part_name);
-    std::cout << "Vector of target calculated. Size =  " << this->tgt_vector.size() << std::endl;
-
-    for (const fs::path &p : this->img_paths) {
+    bool precomputed = db_vecs[0].size() == static_cast<size_t>(basic_box_vector_size);
+    if (precomputed) {
+        if (compute_histogram(this->tgt_file, this->tgt_vector, HistogramType::BASIC_BOX, basic_box_part_name) != 0
+            || build_feature_matrix(db_vecs, this->img_vecs) != 0) {
+            std::cout << "Unable to compute the target vector or load the feature vectors." << std::endl;
+            std::exit(-1);
+        }
+        DistanceQuery query(this->tgt_vector, this->metric);
+        if (query.distances(this->img_vecs, this->diffs) != 0) {
+            std::cout << "Target vector does not match the feature file: " << vec_files[0] << std::endl;
+            std::exit(-1);
+        }
+    } else {
+        // Feature file written by an older p1 that stored paths only. Compute the squares here, decoding every
+        // image (target included) at reduced scale so that the vectors stay comparable.
+        std::cout << "Feature file has no precomputed vectors; decoding images at reduced scale. "
+                  << "Re-run ./p1 -b- to avoid this." << std::endl;
+        ImagePlanes tgt_planes(this->tgt_file, basic_box_reduced_read);
+        if (compute_basic_box_vector(tgt_planes, this->tgt_vector, basic_box_part_name) != 0) {
+            std::cout << "Unable to compute the target vector: " << this->tgt_file << std::endl;
+            std::exit(-1);
+        }
+        this->diffs.reserve(this->img_paths.size());
         std::vector<float> img_vec;
-        compute_histogram(p, img_vec, HistogramType::BASIC_BOX, basic_box_part_name);
-        double diff = compute_distance(this->tgt_vector, img_vec, this->metric);  // -b-i
-		std::cout << "Diff = " << diff << std::endl << "File: " << p << std::endl;
-        std::pair<double, fs::path> tmp_pair(diff, p);
-        this->op.push_back(tmp_pair);
-    }
-	std::cout << "Size of output: " << this->op.size() << std::endl;
-    std::ranges::sort(this->op);
-	std::cout << "Size of output after sorting " << this->op.size() << std::endl;
-	std::cout << "printing top 3 from dist_utils.cpp..." << std::endl;
-	for (int i = 0; i < 3; i++) {
-		std::cout << this->op[i].first << ", " << this->op[i].second << std::endl;
-	}
+        for (const char* p : this->img_paths) {
+            ImagePlanes planes(fs::absolute(p), basic_box_reduced_read);
+            if (compute_basic_box_vector(planes, img_vec, basic_box_part_name) != 0) {
+                this->diffs.push_back(std::numeric_limits<double>::infinity());
+                continue;
+            }
+            this->diffs.push_back(compute_distance(this->tgt_vector, img_vec, this->metric));  // -b-i
+        }
+    }
+    std::cout << "Vector of target calculated. Size =  " << this->tgt_vector.size() << std::endl;
+    this->pager.reset(this->diffs);
+    this->next_page();
     return 0;
 }
 
+size_t Basic::next_page() {
+    return append_result_page(this->pager, this->k, this->img_paths, true, this->op);
+}
+
 
 int Basic::prep_config() {
     char a0 = this->spec[0];
@@ -387,4 +827,58 @@ int Basic::prep_config() {
 }
 
 
+Compressed::Compressed(fs::path &tgt_file, std::string &spec, std::vector<fs::path> &vf,
+                       SearchResults& op, size_t k, const AnnOptions& ann) : tgt_file(tgt_file), spec(spec), vec_files(vf), op(op), k(k), ann(ann), shown(0) {
+}
+
+int Compressed::calculate_compressed() {
+    if (parse_distance_metric(this->spec[0]) != SSD) {
+        std::cout << "PQ stores only support SSD. Use -c-i" << std::endl;
+        std::exit(-1);
+    }
+    if (this->store.open(vec_files[0]) != 0) {
+        std::exit(-1);
+    }
+    std::string part = parse_part_name(this->store.part());
+    HistogramType hist = parse_hist_type(this->store.hist());
+    std::cout << "PQ store with " << this->store.rows() << " images. Part: " << part << ", Histogram_type: " << HISTOGRAM_NAMES.at(hist) << std::endl;
+    if (compute_histogram(this->tgt_file, this->tgt_vector, hist, part) != 0 || this->tgt_vector.size() != this->store.dims()) {
+        std::cout << "Target histogram does not match the PQ store: " << vec_files[0] << std::endl;
+        std::exit(-1);
+    }
+
+    if (this->ann.verify) {
+        std::vector<ScoredRow> adc;
+        std::vector<ScoredRow> reranked;
+        std::vector<ScoredRow> exact;
+        cr::steady_clock::time_point t0 = cr::steady_clock::now();
+        this->store.search_adc(this->tgt_vector, this->k, adc);
+        cr::steady_clock::time_point t1 = cr::steady_clock::now();
+        this->store.search(this->tgt_vector, this->k, this->ann.rerank, reranked);
+        cr::steady_clock::time_point t2 = cr::steady_clock::now();
+        this->store.search_exact(this->tgt_vector, this->k, exact);
+        cr::steady_clock::time_point t3 = cr::steady_clock::now();
+        std::cout << "Verify: recall@" << this->k << " codes only = " << recall_at_k(adc, exact)
+                  << " (" << cr::duration<double, std::milli>(t1 - t0).count() << " ms), re-ranked x" << this->ann.rerank
+                  << " = " << recall_at_k(reranked, exact) << " (" << cr::duration<double, std::milli>(t2 - t1).count()
+                  << " ms), exact scan " << cr::duration<double, std::milli>(t3 - t2).count() << " ms" << std::endl;
+    }
+    this->next_page();
+    return 0;
+}
 
+size_t Compressed::next_page() {
+    if (this->shown >= this->store.rows()) {
+        return 0;
+    }
+    std::vector<ScoredRow> best;
+    if (this->store.search(this->tgt_vector, this->shown + std::min(this->k, this->store.rows()), this->ann.rerank, best) != 0) {
+        std::exit(-1);
+    }
+    for (size_t i = this->shown; i < best.size(); i++) {
+        this->op.emplace_back(best[i].dist, fs::path(this->store.name(best[i].row)));
+    }
+    size_t added = best.size() > this->shown ? best.size() - this->shown : 0;
+    this->shown += added;
+    return added;
+}
@@ -12,9 +12,17 @@
 #include <iostream>
 #include <algorithm>
 #include <iomanip>
+#include <memory>
 
 #include "mycv_utils.h"
 #include "csv_util.h"
+#include "dist_kernels.h"
+#include "emd.h"
+#include "topk.h"
+#include "ivf_index.h"
+#include "pq.h"
+#include "shard_pool.h"
+#include "query_cache.h"
 
 /**
  * Function pointer type for distance/similarity metric functions.
@@ -33,7 +41,7 @@ enum DistanceMetric {
     SSD,                      // i - Sum of squared differences
     INTERSECTION,             // I - Histogram intersection
     CHI_SQUARED,              // q - Chi-squared distance
-    EARTH_MOVER,              // Q - Earth mover's distance (1D)
+    EARTH_MOVER,              // Q - Earth mover's distance (exact 1D, sliced 2D / 3D)
     COSINE,                   // o - Cosine similarity
     CORELATION,               // O - Correlation coefficient
     BHATTACHARYA,             // y - Bhattacharyya distance
@@ -68,10 +76,54 @@ struct PartConfig {
     DistanceMetric metric;                              // Distance metric to use
     double weight;                                      // Weight for this part in final combination (normalized)
     fs::path feature_file;                              // CSV file containing features for this part
-    std::vector<std::vector<float>> img_vecs;           // Feature vectors for all database images
-    std::vector<fs::path> img_names;                    // Image paths corresponding to feature vectors
+    FeatureMatrix matrix;                               // Feature vectors for all database images (contiguous)
+    std::vector<char*> img_names;                       // Image names corresponding to feature vectors (as read from CSV)
     std::vector<float> target_vector;                   // Target image feature vector for this part
-    std::vector<std::pair<double, fs::path>> diff_values;  // Distance values for all images
+};
+
+/**
+ * Relative slack taken off every statistics based lower bound. The row statistics and the kernels accumulate in
+ * float lanes, so a bound that is tight in exact arithmetic can land a few ulps above the distance it bounds.
+ */
+const double bound_slack = 1e-5;
+
+/**
+ * Output of a search: (distance, image path) pairs, best first. Only the rows that are actually shown are
+ * resolved to paths.
+ */
+typedef std::vector<std::pair<double, fs::path>> SearchResults;
+
+/**
+ * Appends the next page of a ranking to the search results, resolving row IDs to image paths.
+ *
+ * @param pager pager over the per-row distances
+ * @param k page size
+ * @param names image name of every row
+ * @param absolute resolve names to absolute paths
+ * @param op output vector the page is appended to
+ * @return number of results appended (0 once the ranking is exhausted)
+ */
+size_t append_result_page(RankedPager& pager, size_t k, const std::vector<char*>& names, bool absolute, SearchResults& op);
+
+/**
+ * Appends already ranked rows to the search results, resolving row IDs to image paths.
+ *
+ * @param rows ranked rows, best first
+ * @param from index of the first row to append
+ * @param names image name of every row
+ * @param absolute resolve names to absolute paths
+ * @param op output vector the rows are appended to
+ * @return number of results appended
+ */
+size_t append_result_rows(const std::vector<ScoredRow>& rows, size_t from, const std::vector<char*>& names, bool absolute, SearchResults& op);
+
+/**
+ * Knobs for approximate search (IVF index in -d- mode, PQ store in -c- mode).
+ */
+struct AnnOptions {
+    size_t nprobe = ivf_default_nprobe;    // Inverted lists scanned per query (recall vs latency)
+    size_t rerank = pq_default_rerank;     // PQ shortlist size as a multiple of K (recall vs latency)
+    bool verify = false;                   // Also run brute force and report recall@K
 };
 
 /**
@@ -123,16 +175,29 @@ double compute_intersection(const std::vector<float>& x, const std::vector<float
 double compute_chi_squared(const std::vector<float>& x, const std::vector<float>& y);
 
 /**
- * Computes approximate earth mover's distance for multi-dimensional histograms.
+ * Layout of the histograms a HistogramType produces, used to pick the EMD ground distance.
+ * RG and HS are 2D (bins x bins), Sobel 2D is magnitude x orientation, RGB is 3D, Laws is one 1D histogram per
+ * filter and everything else is treated as a single 1D histogram.
+ *
+ * @param hist_type histogram type
+ * @param length length of the feature vector
+ * @return shape; falls back to 1D if length does not fit the type
+ */
+EmdShape emd_shape_for(HistogramType hist_type, size_t length);
+
+/**
+ * Computes approximate earth mover's distance for multi-dimensional histograms (sliced EMD, see emd.h).
+ * 1D shapes are computed exactly.
  *
  * @param x first histogram
  * @param y second histogram
+ * @param shape layout of both histograms
  * @return approximate EMD (lower = more similar)
  */
-double compute_emd_approx(const std::vector<float>& x, const std::vector<float>& y);
+double compute_emd_approx(const std::vector<float>& x, const std::vector<float>& y, const EmdShape& shape);
 
 /**
- * Computes earth mover's distance for 1D histograms.
+ * Computes earth mover's distance for 1D histograms, exactly and in O(n) for any number of bins.
  * Good for perceptual color similarity.
  *
  * @param x first histogram
@@ -218,19 +283,274 @@ const std::map<DistanceMetric, DistanceFunction> distance_functions = {
     {CUSTOM_WEIGHTED_COMBO, [](const std::vector<float>& x, const std::vector<float>& y) {return compute_custom_weighted_combo(x, y);} }
 };
 
+/**
+ * Row distance function used by DistanceQuery. Receives the query and one database row together with their
+ * precomputed statistics so that norms and means are never recomputed inside the scan.
+ */
+typedef double (*RowDistanceFunction)(const float* q, const float* x, size_t n, const RowStats& qs, const RowStats& xs);
+
+/**
+ * Metrics whose distance follows from the dot product and the two row statistics (SSD, cosine, correlation).
+ * Batched searches compute the dot products of many queries and rows at once with kernel_dot_tile.
+ *
+ * @param metric distance metric
+ * @return true if distance_from_dot supports the metric
+ */
+bool metric_from_dot(DistanceMetric metric);
+
+/**
+ * Distance from a dot product and the statistics of both vectors. SSD uses |q|^2 + |x|^2 - 2 q.x (clamped at 0),
+ * which can differ from the direct sum in the last few bits.
+ *
+ * @param metric SSD, COSINE or CORELATION
+ * @param dot q.x
+ * @param n values per vector
+ * @param qs query statistics
+ * @param xs row statistics
+ * @return distance value (lower = more similar)
+ */
+double distance_from_dot(DistanceMetric metric, double dot, size_t n, const RowStats& qs, const RowStats& xs);
+
+/**
+ * One query vector compared against many rows of a FeatureMatrix with a fixed metric.
+ * The metric is resolved to a row kernel once in the constructor, and the query statistics are computed once,
+ * so the per-row cost is a single SIMD reduction.
+ */
+class DistanceQuery {
+private:
+    std::vector<float> query;           // Query feature vector
+    DistanceMetric metric;              // Metric used for every comparison
+    RowStats query_stats;               // Precomputed sum / squared norm of the query
+    RowDistanceFunction row_fn;         // Kernel resolved from metric
+    std::vector<double> query_rest;     // Query mass left after each abandon_block chunk (intersection only)
+    ZeroRowSums query_zero;             // Query against an all-zero row, the baseline for sparse rows
+    SparseVector query_sparse;          // Non-zero query values, kept when rows are merged with the query
+    const EmdGround* emd;               // Shared EMD ground for multi-block / multi-dimensional shapes, else nullptr
+
+    /**
+     * Distance to a row of a sparse matrix, in time proportional to the row's non-zero count. SSD, Manhattan,
+     * intersection and chi-squared correct the zero-row baseline on the row's bins (or merge with the sparse
+     * query when the query is longer than sparse_dense_query_max_dims); cosine, correlation and Bhattacharyya
+     * only need the dot / sqrt products over the row's bins. Other metrics expand the row.
+     */
+    double sparse_distance(const FeatureMatrix& fm, size_t row) const;
+
+    /**
+     * Earth mover's distance between the query and one dense row, using the query's histogram shape.
+     */
+    double emd_distance(const float* x) const;
+
+public:
+    /**
+     * Constructor for DistanceQuery.
+     *
+     * @param query query feature vector
+     * @param metric distance metric to use for all rows
+     * @param shape histogram layout for the earth mover's distance (default: one 1D histogram)
+     */
+    DistanceQuery(const std::vector<float>& query, DistanceMetric metric, const EmdShape& shape = EmdShape());
+
+    /**
+     * @return the query feature vector
+     */
+    const std::vector<float>& vector() const { return this->query; }
+
+    /**
+     * @return the metric every row is compared with
+     */
+    DistanceMetric get_metric() const { return this->metric; }
+
+    /**
+     * @return precomputed sum / squared norm of the query
+     */
+    const RowStats& stats() const { return this->query_stats; }
+
+    /**
+     * Distance between the query and a single row of the matrix.
+     *
+     * @param fm feature matrix (dims must equal query size)
+     * @param row row index
+     * @return distance value (lower = more similar)
+     */
+    double distance(const FeatureMatrix& fm, size_t row) const;
+
+    /**
+     * Distances between the query and every row of the matrix.
+     *
+     * @param fm feature matrix (dims must equal query size)
+     * @param out output vector, resized to fm.rows
+     * @return 0 if successful, -1 if the query length does not match the matrix
+     */
+    int distances(const FeatureMatrix& fm, std::vector<double>& out) const;
+
+    /**
+     * O(1) lower bound on the distance to a row, computed from the precomputed row statistics only.
+     *   SSD:           (|q| - |x|)^2 / n            (reverse triangle inequality)
+     *   Manhattan:     |sum(q) - sum(x)|
+     *   Intersection:  1 - min(sum(q), sum(x))
+     *   Bhattacharyya: -0.5 * log(sum(q) * sum(x))  (Cauchy-Schwarz)
+     *   Earth mover:   centroid bound for 2D / 3D histograms (dense rows only, O(n) rather than O(1))
+     * Other metrics return 0.
+     *
+     * @param fm feature matrix
+     * @param row row index
+     * @return value that is never larger than distance(fm, row)
+     */
+    double lower_bound(const FeatureMatrix& fm, size_t row) const;
+
+    /**
+     * Distance to a row that may stop early once it is known to exceed the budget.
+     * SSD, Manhattan and chi-squared abandon as soon as their running sum passes the budget, intersection as soon
+     * as the remaining query mass can no longer bring it back under the budget. Other metrics are always
+     * evaluated in full.
+     *
+     * @param fm feature matrix
+     * @param row row index
+     * @param budget largest distance the caller is still interested in
+     * @return the exact distance if it is <= budget, otherwise some value > budget
+     */
+    double distance_bounded(const FeatureMatrix& fm, size_t row, double budget) const;
+};
+
+/**
+ * One weighted term of a multi-part search: a part's query and the matrix it is compared against.
+ */
+struct WeightedPart {
+    const DistanceQuery* query;                     // Query for this part
+    const FeatureMatrix* matrix;                    // Database rows for this part
+    double weight;                                  // Normalized weight of the part
+};
+
+/**
+ * Counters reported by pruned_search.
+ */
+struct PruneStats {
+    size_t skipped = 0;                             // Rows rejected by the lower bounds alone
+    size_t abandoned = 0;                           // Rows dropped part way through their parts
+};
+
+/**
+ * Sorts parts cheapest per unit of weight first and drops parts with zero weight. Cheap parts push the partial
+ * total towards the threshold fastest.
+ *
+ * @param parts parts to reorder in place
+ */
+void order_parts_by_cost(std::vector<WeightedPart>& parts);
+
+/**
+ * Pruned scan for the rows with the lowest weighted total distance over all parts.
+ * A row is skipped outright when the weighted sum of the part lower bounds already exceeds the current K-th best
+ * total. Otherwise parts are evaluated in the given order, each with whatever budget is left, and the row is
+ * dropped as soon as its partial total plus the bounds of the remaining parts exceeds the threshold.
+ *
+ * @param parts parts in evaluation order (see order_parts_by_cost); every matrix must have `rows` rows
+ * @param rows number of database rows
+ * @param want number of rows to return
+ * @param out output, best first
+ * @param stats output pruning counters
+ * @return 0 if successful
+ */
+int pruned_search(const std::vector<WeightedPart>& parts, size_t rows, size_t want, std::vector<ScoredRow>& out, PruneStats& stats);
+
+/**
+ * The pruned scan of pruned_search over rows [begin, end) only, adding to an existing TopK. Lets a batch of
+ * queries walk the database one tile at a time, each query keeping its own TopK between tiles.
+ *
+ * @param parts parts in evaluation order
+ * @param begin first row
+ * @param end one past the last row
+ * @param top running best rows of this query
+ * @param stats pruning counters, incremented
+ * @return 0 if successful
+ */
+int pruned_scan(const std::vector<WeightedPart>& parts, size_t begin, size_t end, TopK& top, PruneStats& stats);
+
+/**
+ * The pruned search split into row shards on a ShardPool. Each worker copies its shard of every part into memory
+ * it allocates itself, so on a multi-socket machine every shard is scanned out of its own node's memory. Shards
+ * keep a local TopK and the shard results are merged at the end. Databases too small to shard are scanned on the
+ * calling thread straight from the original matrices.
+ */
+class ShardedScan {
+private:
+    size_t rows = 0;                                        // Number of database rows
+    std::vector<WeightedPart> parts;                        // Parts over the whole database (single shard only)
+    std::unique_ptr<ShardPool> pool;                        // Shard workers (null for a single shard)
+    std::vector<size_t> bounds;                             // First row of every shard, then rows
+    std::vector<std::vector<FeatureMatrix>> local;          // Node-local copy of every part, per shard
+    std::vector<std::vector<WeightedPart>> shard_parts;     // parts with matrices swapped for the local copies
+
+public:
+    /**
+     * Splits the database into shards and has every worker copy its rows.
+     *
+     * @param parts parts in evaluation order (see order_parts_by_cost)
+     * @param rows number of database rows
+     * @return 0 if successful
+     */
+    int prepare(const std::vector<WeightedPart>& parts, size_t rows);
+
+    /**
+     * @return number of shards; above 1 the original matrices are no longer read and may be released
+     */
+    size_t shards() const;
+
+    /**
+     * Runs the pruned search over every shard in parallel.
+     *
+     * @param want number of rows to return
+     * @param out output, best first (global row numbers)
+     * @param stats output pruning counters summed over the shards
+     * @return 0 if successful
+     */
+    int search(size_t want, std::vector<ScoredRow>& out, PruneStats& stats);
+};
+
 /**
  * Handles CLASSIC mode matching with multiple weighted histogram parts.
  * Loads features from multiple CSV files, computes target features,
  * calculates weighted combination of distances, and returns sorted results.
+ *
+ * The scan is pruned against the current K-th best total. An image is skipped outright when the weighted sum of
+ * the O(1) part lower bounds already exceeds it. Otherwise parts are evaluated cheapest-per-weight first, each with
+ * whatever budget is left, and the image is dropped as soon as its partial total plus the bounds of the
+ * remaining parts exceeds the threshold. Large databases are split into shards scanned in parallel (ShardedScan),
+ * one per core, spread over the NUMA nodes.
  */
 class Distance {
 private:
     fs::path tgt_file;                              // Path to target image
     std::string spec;                               // Specification string (part+hist+metric+weight groups)
     std::vector<fs::path> vec_files;                // Paths to feature CSV files
-    int num_images;                                 // Number of images in database
-    std::vector<std::pair<double, fs::path>>& op;    // Output: sorted (distance, path) pairs
+    size_t num_images;                              // Number of images in database
+    SearchResults& op;                              // Output: sorted (distance, path) pairs, one page at a time
+    size_t k;                                       // Page size
     std::vector<PartConfig> pc;                     // Parsed configuration for each part
+    std::vector<DistanceQuery> queries;             // Target query for each part (same order as pc)
+    ShardedScan scan;                               // Parts in evaluation order, sharded over the cores
+    size_t shown;                                   // Number of results handed out so far
+    QueryCache cache;                               // Saved rankings and target histograms
+    std::string tgt_hash;                           // Hash of the target file contents (empty if not cached)
+    std::string ranking_key;                        // Cache key of this query's ranking (empty if not cached)
+    CachedRanking ranking;                          // Best images found so far, from the cache or the last scan
+    bool loaded;                                    // Feature files read and target queries built
+
+    /**
+     * Reads the feature files, builds the target histograms (or takes them from the cache) and prepares the
+     * sharded scan. Only needed when the cached ranking is missing or too short.
+     *
+     * @return 0 if successful, exits otherwise
+     */
+    int load_parts();
+
+    /**
+     * Pruned scan for the best images.
+     *
+     * @param want number of images to return
+     * @param out output, best first
+     * @return 0 if successful
+     */
+    int search(size_t want, std::vector<ScoredRow>& out);
 
     /**
      * Parses specification string and prepares PartConfig entries.
@@ -248,22 +568,36 @@ public:
      * @param spec specification string (groups of 4: part+hist+metric+weight)
      * @param vf vector of feature file paths (must match spec order)
      * @param op reference to output vector for storing results
+     * @param k number of results per page
+     * @param use_cache false to bypass the query cache
      */
-    Distance(fs::path& tgt_file, std::string& spec, std::vector<fs::path>& vf, std::vector<std::pair<double, fs::path>>& op);
+    Distance(fs::path& tgt_file, std::string& spec, std::vector<fs::path>& vf, SearchResults& op, size_t k, bool use_cache=true);
 
     /**
      * Executes classic multi-part weighted matching.
-     * Loads features, computes distances, combines with weights, and sorts results.
+     * Loads features, computes distances, combines with weights, and writes the first page of results to op.
+     * When the same target, spec and feature files were searched before, the saved ranking is served instead and
+     * nothing is loaded.
      *
      * @return 0 if successful
      */
     int calculate_classic();
 
+    /**
+     * Appends the next page of results to op. Runs the pruned scan again for the larger K, which is still far
+     * cheaper than keeping the full distance of every image around, unless the saved ranking is long enough.
+     * Every new ranking is saved to the cache.
+     *
+     * @return number of results appended (0 once every image has been shown)
+     */
+    size_t next_page();
+
 };
 
 /**
  * Handles DNN embedding matching with single distance metric.
- * Target and database embeddings stored in CSV format.
+ * Target and database embeddings stored in CSV format. The database can also be an IVF index built by p1 -i-,
+ * in which case only the nprobe closest inverted lists are scanned.
  */
 class MyDNN {
 private:
@@ -271,10 +605,17 @@ private:
     std::vector<float> tgt_vector;                  // Target image embedding vector
     std::string spec;                               // Single character distance metric
     std::vector<fs::path> vec_files;                // Path to database embeddings CSV
-    std::vector<std::vector<float>> img_vecs;       // Database embedding vectors
-    std::vector<fs::path> img_names;                // Image paths for database
-    std::vector<std::pair<double, fs::path>>& op;    // Output: sorted (distance, path) pairs
+    FeatureMatrix img_vecs;                         // Database embedding vectors (contiguous)
+    std::vector<char*> img_names;                   // Image names for database (as read from CSV)
+    SearchResults& op;                              // Output: sorted (distance, path) pairs, one page at a time
+    size_t k;                                       // Page size
     DistanceMetric metric;                          // Distance metric to use
+    std::vector<double> diffs;                      // Distance of every database embedding, indexed by row
+    RankedPager pager;                              // Hands out diffs one page at a time
+    AnnOptions ann;                                 // nprobe / verify settings for index search
+    IvfIndex index;                                 // Memory-mapped index (only when vec_files[0] is an index file)
+    bool use_index;                                 // True if searching through the index
+    size_t shown;                                   // Number of index results handed out so far
 
     /**
      * Parses single-character metric specification.
@@ -283,24 +624,41 @@ private:
      */
     int prep_config();
 
+    /**
+     * Opens the index, checks it against the target and metric, and optionally reports recall@K against an
+     * exact scan of the same index.
+     *
+     * @return 0 if successful
+     */
+    int prepare_index();
+
 public:
     /**
      * Constructor for MyDNN class.
      *
      * @param tgt_file path to CSV with target embedding (first entry used)
      * @param spec single character distance metric
-     * @param vf vector containing single path to embeddings CSV
+     * @param vf vector containing single path to embeddings CSV or index file
      * @param op reference to output vector for storing results
+     * @param k number of results per page
+     * @param ann approximate search settings (only used with an index file)
      */
-    MyDNN(fs::path& tgt_file, std::string& spec, std::vector<fs::path>& vf, std::vector<std::pair<double, fs::path>>& op);
+    MyDNN(fs::path& tgt_file, std::string& spec, std::vector<fs::path>& vf, SearchResults& op, size_t k, const AnnOptions& ann = AnnOptions());
 
     /**
      * Executes DNN embedding matching.
-     * Loads target and database embeddings, computes distances, and sorts results.
+     * Loads target and database embeddings, computes distances, and writes the first page of results to op.
      *
      * @return 0 if successful
      */
     int calculate_dnn();
+
+    /**
+     * Appends the next page of results to op.
+     *
+     * @return number of results appended (0 once every image has been shown)
+     */
+    size_t next_page();
 };
 
 /**
@@ -313,9 +671,13 @@ private:
     std::vector<float> tgt_vector;                  // Target 7x7 center square vector
     std::string spec;                               // Single character distance metric (typically 'd' for SSD)
     std::vector<fs::path> vec_files;                // Path to baseline features CSV
-    std::vector<std::pair<double, fs::path>>& op;    // Output: sorted (distance, path) pairs
+    SearchResults& op;                              // Output: sorted (distance, path) pairs, one page at a time
+    size_t k;                                       // Page size
     DistanceMetric metric;                          // Distance metric to use
-    std::vector<fs::path> img_paths;                // Database image paths
+    std::vector<char*> img_paths;                   // Database image paths (as read from CSV)
+    FeatureMatrix img_vecs;                         // Precomputed 7x7 square vectors, one row per image
+    std::vector<double> diffs;                      // Distance of every database image, indexed by row
+    RankedPager pager;                              // Hands out diffs one page at a time
 
     /**
      * Parses single-character metric specification.
@@ -332,16 +694,72 @@ public:
      * @param spec single character distance metric
      * @param vf vector containing path to baseline features CSV
      * @param op reference to output vector for storing results
+     * @param k number of results per page
      */
-    Basic(fs::path& tgt_file, std::string& spec, std::vector<fs::path>& vf, std::vector<std::pair<double, fs::path>>& op);
+    Basic(fs::path& tgt_file, std::string& spec, std::vector<fs::path>& vf, SearchResults& op, size_t k);
 
     /**
      * Executes basic 7x7 square matching.
-     * Computes SSD between center squares and sorts results.
+     * Scans the square vectors precomputed by p1. Feature files from older p1 builds hold paths only; for those the
+     * squares are computed here with a reduced-scale decode of every image.
+     * Writes the first page of results to op.
      *
      * @return 0 if successful
      */
     int calculate_basic();
+
+    /**
+     * Appends the next page of results to op.
+     *
+     * @return number of results appended (0 once every image has been shown)
+     */
+    size_t next_page();
+};
+
+/**
+ * Handles COMPRESSED mode matching against a product-quantized feature store built by p1 -q-.
+ * The target histogram is computed with the part and histogram recorded in the store, the codes are scanned with
+ * per-query lookup tables, and a shortlist is re-ranked exactly against the source CSV. Only SSD is supported.
+ */
+class Compressed {
+private:
+    fs::path tgt_file;                              // Path to target image
+    std::vector<float> tgt_vector;                  // Target feature vector
+    std::string spec;                               // Single character distance metric (must be 'i')
+    std::vector<fs::path> vec_files;                // Path to the PQ store
+    SearchResults& op;                              // Output: sorted (distance, path) pairs, one page at a time
+    size_t k;                                       // Page size
+    AnnOptions ann;                                 // rerank / verify settings
+    PqStore store;                                  // Codes and codebooks held in memory
+    size_t shown;                                   // Number of results handed out so far
+
+public:
+    /**
+     * Constructor for Compressed class.
+     *
+     * @param tgt_file path to target image
+     * @param spec single character distance metric
+     * @param vf vector containing path to the PQ store
+     * @param op reference to output vector for storing results
+     * @param k number of results per page
+     * @param ann approximate search settings
+     */
+    Compressed(fs::path& tgt_file, std::string& spec, std::vector<fs::path>& vf, SearchResults& op, size_t k, const AnnOptions& ann);
+
+    /**
+     * Loads the store, computes the target histogram and writes the first page of results to op.
+     * With verify set, also reports recall@K of the ADC ranking and of the re-ranked results against an exact scan.
+     *
+     * @return 0 if successful
+     */
+    int calculate_compressed();
+
+    /**
+     * Appends the next page of results to op.
+     *
+     * @return number of results appended (0 once every image has been shown)
+     */
+    size_t next_page();
 };
 
 #endif //DIST_UTILS_H
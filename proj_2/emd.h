@@ -0,0 +1,115 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Header file for emd.cpp. Earth mover's distance between histograms laid out as flat vectors.
+// 1D histograms use the exact CDF formula in O(n). 2D and 3D histograms (RG, HS, Sobel 2D, RGB) use sliced EMD:
+// the bins are projected onto a fixed set of directions, and each projection is a 1D transport problem solved in
+// O(n) over the bins sorted along it. The result is scaled so that a shifted point mass costs about its Euclidean
+// shift, so sliced EMD approximates the exact EMD with Euclidean ground distance. With emd_slices fixed directions
+// it can come out somewhat above or below the exact value depending on the direction of the displacement; it is not
+// an upper or lower bound on it. The projection order and gaps depend only on the histogram shape, so they are
+// computed once per shape and shared by every query (the ground-distance cache).
+//
+
+#ifndef EMD_H
+#define EMD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const size_t emd_slices = 32;    // Projection directions per multi-dimensional histogram
+
+/**
+ * Layout of a histogram vector. Bins are unit-spaced along every axis, last axis fastest (row major).
+ */
+struct EmdShape {
+    size_t blocks = 1;            // Independent histograms laid end to end (Laws: one per filter), summed
+    std::vector<size_t> dims;     // Bins along each axis of one block; zero or one axis means 1D
+
+    /**
+     * @return number of values in one block (0 if dims is empty)
+     */
+    size_t block_size() const;
+};
+
+bool operator<(const EmdShape& a, const EmdShape& b);
+
+/**
+ * Exact EMD between two 1D histograms: sum over bins of |CDF_x - CDF_y|.
+ *
+ * @param x first histogram
+ * @param y second histogram
+ * @param n number of bins
+ * @return EMD (lower = more similar)
+ */
+double emd_1d(const float* x, const float* y, size_t n);
+
+/**
+ * Precomputed geometry of one histogram shape.
+ */
+class EmdGround {
+private:
+    EmdShape shape;                  // Histogram layout
+    size_t n;                        // Bins per block
+    size_t axes;                     // Number of axes (1 for the exact path)
+    std::vector<float> directions;   // emd_slices x axes unit vectors
+    std::vector<float> top;          // emd_slices largest projection of any bin
+    std::vector<uint32_t> order;     // emd_slices x n bins sorted along each direction
+    std::vector<float> gaps;         // emd_slices x n distance from each sorted bin to the next one
+    double scale;                    // Makes a point mass moved by d cost about d (exact only on average over directions)
+
+    /**
+     * Unnormalised first moment (sum of mass x bin position) of one block.
+     */
+    void moment(const float* x, double* m) const;
+
+public:
+    /**
+     * Builds the projections for a shape. Use emd_ground() to share them.
+     *
+     * @param shape histogram layout
+     */
+    explicit EmdGround(const EmdShape& shape);
+
+    /**
+     * @return number of values of a full vector (blocks x bins per block)
+     */
+    size_t length() const;
+
+    /**
+     * @return true if the shape is multi-dimensional and distance() is sliced rather than exact
+     */
+    bool sliced() const;
+
+    /**
+     * EMD between two vectors of this shape, summed over blocks. Exact for 1D, sliced for 2D and 3D.
+     *
+     * @param x first histogram (length() values)
+     * @param y second histogram (length() values)
+     * @return EMD (lower = more similar)
+     */
+    double distance(const float* x, const float* y) const;
+
+    /**
+     * Centroid lower bound on distance(): in every projection the transport cost is at least the distance the
+     * first moment moves, so only the moments of x and y are needed (O(n x axes) instead of O(n x slices)).
+     * Returns 0 for 1D shapes, where the exact distance is just as cheap.
+     *
+     * @param x first histogram
+     * @param y second histogram
+     * @return value that is never larger than distance(x, y)
+     */
+    double lower_bound(const float* x, const float* y) const;
+};
+
+/**
+ * Shared ground for a shape. Built on first use and cached for the life of the process; safe to call from
+ * several threads.
+ *
+ * @param shape histogram layout
+ * @return ground for the shape
+ */
+const EmdGround& emd_ground(const EmdShape& shape);
+
+#endif //EMD_H
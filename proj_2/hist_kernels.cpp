@@ -0,0 +1,533 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Histogram binning engine: lookup-table binning, private sub-histograms and row-split threading, plus the GLCM
+// counter and the separable Laws filter bank.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "hist_kernels.h"
+
+namespace {
+
+const size_t index_block = 256;   // Pixels whose bin indices are computed before they are counted
+const int max_channel_sum = 3 * 255;
+
+/**
+ * Bin indices of n interleaved 3-channel pixels. For power-of-two bins the index is built from shifts in a
+ * branch-free loop the compiler vectorises (stride-3 loads are deinterleaved with vld3 / shuffles); otherwise
+ * three table lookups per pixel.
+ */
+void index_3c(const uint8_t* px, size_t n, const ChannelLuts& luts, uint32_t* idx) {
+    if (luts.shift >= 0) {
+        int s = luts.shift;
+        int k = luts.bits;
+        for (size_t i = 0; i < n; i++) {
+            idx[i] = (static_cast<uint32_t>(px[3 * i + 2] >> s) << (2 * k))
+                     | (static_cast<uint32_t>(px[3 * i + 1] >> s) << k)
+                     | static_cast<uint32_t>(px[3 * i] >> s);
+        }
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        idx[i] = luts.lut[0][px[3 * i]] + luts.lut[1][px[3 * i + 1]] + luts.lut[2][px[3 * i + 2]];
+    }
+}
+
+/**
+ * Counts indices into hist_sub_histograms private histograms laid out one after another. Neighbouring pixels
+ * usually fall in the same bin; spreading them over four counters keeps the increments from waiting on each other.
+ */
+void count_indices(const uint32_t* idx, size_t n, uint32_t* counts, size_t total_bins) {
+    uint32_t* c0 = counts;
+    uint32_t* c1 = counts + total_bins;
+    uint32_t* c2 = counts + 2 * total_bins;
+    uint32_t* c3 = counts + 3 * total_bins;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        c0[idx[i]]++;
+        c1[idx[i + 1]]++;
+        c2[idx[i + 2]]++;
+        c3[idx[i + 3]]++;
+    }
+    for (; i < n; i++) {
+        c0[idx[i]]++;
+    }
+}
+
+/**
+ * Sub-histograms of rows [row_begin, row_end) of a 3-channel image.
+ */
+void histogram_rows(const cv::Mat& src, int row_begin, int row_end, const ChannelLuts& luts, std::vector<uint32_t>& counts) {
+    counts.assign(hist_sub_histograms * luts.total_bins, 0);
+    uint32_t idx[index_block];
+    size_t cols = src.cols;
+    for (int i = row_begin; i < row_end; i++) {
+        const uint8_t* row = src.ptr<uint8_t>(i);
+        for (size_t j = 0; j < cols; j += index_block) {
+            size_t n = std::min(index_block, cols - j);
+            index_3c(row + 3 * j, n, luts, idx);
+            count_indices(idx, n, counts.data(), luts.total_bins);
+        }
+    }
+}
+
+/**
+ * Builds the (B + G + R, value) -> chromaticity index table for one bin count.
+ */
+void build_rg_lut(int bins, std::vector<uint8_t>& lut) {
+    lut.assign((max_channel_sum + 1) * 256, 0);
+    for (int sum = 0; sum <= max_channel_sum; sum++) {
+        float divisor = sum;
+        divisor = divisor > 0.0 ? divisor : 1.0;
+        for (int c = 0; c <= std::min(sum, 255); c++) {
+            float r = c / divisor;
+            lut[sum * 256 + c] = static_cast<uint8_t>((int) (r * (bins - 1) + 0.5));
+        }
+    }
+}
+
+/**
+ * Chromaticity table for a bin count, built on first use and shared by every image.
+ */
+const std::vector<uint8_t>& rg_lut(int bins) {
+    static std::mutex lock;
+    static std::map<int, std::vector<uint8_t>> luts;
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = luts.find(bins);
+    if (it == luts.end()) {
+        it = luts.emplace(bins, std::vector<uint8_t>()).first;
+        build_rg_lut(bins, it->second);
+    }
+    return it->second;
+}
+
+/**
+ * Runs fn(row_begin, row_end, shard) over row ranges, on several threads for large images.
+ */
+template <typename Fn>
+size_t split_rows(int rows, size_t num_shards, Fn fn) {
+    if (num_shards <= 1) {
+        fn(0, rows, 0);
+        return 1;
+    }
+    std::vector<std::thread> workers;
+    int shard_rows = (rows + num_shards - 1) / num_shards;
+    for (size_t s = 0; s < num_shards; s++) {
+        int begin = std::min(rows, static_cast<int>(s) * shard_rows);
+        int end = std::min(rows, begin + shard_rows);
+        workers.emplace_back(fn, begin, end, s);
+    }
+    for (std::thread& t : workers) {
+        t.join();
+    }
+    return num_shards;
+}
+
+/**
+ * Counts the co-occurrences of rows [begin, end) (first pixel of the pair in the range, the neighbour may be
+ * below it) into counts and pairs. Offsets must have dy >= 0.
+ */
+void glcm_rows(const cv::Mat& src, int begin, int end, int levels, const std::vector<std::pair<int, int>>& offs,
+               uint32_t* counts, uint64_t* pairs) {
+    size_t n = offs.size();
+    size_t cells = static_cast<size_t>(levels) * levels;
+    std::vector<const uint8_t*> nbr(n);     // Neighbour row of each offset, shifted by dx
+    std::vector<int> lo(n);                 // Columns [lo, hi) whose neighbour is inside the image
+    std::vector<int> hi(n);
+    for (size_t o = 0; o < n; o++) {
+        lo[o] = std::max(0, -offs[o].first);
+        hi[o] = std::max(lo[o], src.cols - std::max(0, offs[o].first));
+    }
+    for (int i = begin; i < end; i++) {
+        const uint8_t* row = src.ptr<uint8_t>(i);
+        int common_lo = 0;
+        int common_hi = src.cols;
+        for (size_t o = 0; o < n; o++) {
+            if (i + offs[o].second < src.rows) {
+                nbr[o] = src.ptr<uint8_t>(i + offs[o].second) + offs[o].first;
+                common_lo = std::max(common_lo, lo[o]);
+                common_hi = std::min(common_hi, hi[o]);
+                pairs[o] += hi[o] - lo[o];
+            } else {
+                nbr[o] = nullptr;   // Neighbour row below the image
+            }
+        }
+        bool all_rows = std::find(nbr.begin(), nbr.end(), nullptr) == nbr.end();
+        if (!all_rows) {
+            common_lo = common_hi = 0;
+        }
+        // Edge columns (and rows where some neighbours fall outside): check each offset.
+        auto checked = [&](int j) {
+            size_t a = static_cast<size_t>(row[j]) * levels;
+            for (size_t o = 0; o < n; o++) {
+                if (nbr[o] != nullptr && j >= lo[o] && j < hi[o]) {
+                    counts[o * cells + a + nbr[o][j]]++;
+                }
+            }
+        };
+        for (int j = 0; j < std::min(common_lo, src.cols); j++) {
+            checked(j);
+        }
+        // Interior: one load of the pixel, one neighbour load and one increment per offset.
+        for (int j = common_lo; j < common_hi; j++) {
+            size_t a = static_cast<size_t>(row[j]) * levels;
+            for (size_t o = 0; o < n; o++) {
+                counts[o * cells + a + nbr[o][j]]++;
+            }
+        }
+        for (int j = std::max(common_lo, common_hi); j < src.cols; j++) {
+            checked(j);
+        }
+    }
+}
+
+/**
+ * s * log2(s) for co-occurrence counts, from a table for small counts.
+ */
+double s_log2_s(uint64_t s) {
+    static const std::vector<double> table = [] {
+        std::vector<double> t(glcm_log_table_size, 0.0);
+        for (size_t v = 1; v < t.size(); v++) {
+            t[v] = v * std::log2(static_cast<double>(v));
+        }
+        return t;
+    }();
+    if (s < glcm_log_table_size) {
+        return table[s];
+    }
+    return s * std::log2(static_cast<double>(s));
+}
+
+/**
+ * Index of coordinate p in a line of n pixels, reflected as cv::BORDER_REFLECT_101 (gfedcb|abcdefgh|gfedcba).
+ */
+int reflect_101(int p, int n) {
+    if (n == 1) {
+        return 0;
+    }
+    while (p < 0 || p >= n) {
+        p = p < 0 ? -p : 2 * n - 2 - p;
+    }
+    return p;
+}
+
+/**
+ * Largest |response| a Laws filter can give on 8-bit input.
+ */
+int laws_max_response(LawsKernel a, LawsKernel b) {
+    int sa = 0;
+    int sb = 0;
+    for (int i = 0; i < 5; i++) {
+        sa += std::abs(laws_kernels[a][i]);
+        sb += std::abs(laws_kernels[b][i]);
+    }
+    return sa * sb * 255;
+}
+
+/**
+ * Per-value response counts and running min / max of every filter, for one band of rows.
+ */
+struct LawsCounts {
+    std::vector<std::vector<uint32_t>> counts;    // counts[f][|response|]
+    std::vector<int> lo;                          // Smallest |response| of every filter
+    std::vector<int> hi;                          // Largest |response| of every filter
+};
+
+/**
+ * Runs the filter bank over rows [begin, end). The horizontal responses of the five rows around the current one
+ * are kept in a ring of int16 rows (|response| <= 16 * 255 for every 1D kernel).
+ */
+void laws_rows(const cv::Mat& src, int begin, int end, const std::vector<std::pair<LawsKernel, LawsKernel>>& filters, LawsCounts& out) {
+    int cols = src.cols;
+    size_t n = filters.size();
+    out.counts.resize(n);
+    out.lo.assign(n, std::numeric_limits<int>::max());
+    out.hi.assign(n, 0);
+    bool used[LAWS_NUM_KERNELS] = {false};
+    for (size_t f = 0; f < n; f++) {
+        out.counts[f].assign(laws_max_response(filters[f].first, filters[f].second) + 1, 0);
+        used[filters[f].second] = true;
+    }
+
+    std::vector<uint8_t> padded(cols + 4);
+    std::vector<int16_t> ring(static_cast<size_t>(5) * LAWS_NUM_KERNELS * cols);
+    auto slot = [&](int r, int k) {return ring.data() + ((((r - begin + 2) % 5) * LAWS_NUM_KERNELS) + k) * static_cast<size_t>(cols);};
+    auto horizontal = [&](int r) {
+        const uint8_t* row = src.ptr<uint8_t>(reflect_101(r, src.rows));
+        for (int x = 0; x < cols + 4; x++) {
+            padded[x] = row[reflect_101(x - 2, cols)];
+        }
+        for (int k = 0; k < LAWS_NUM_KERNELS; k++) {
+            if (!used[k]) {
+                continue;
+            }
+            const int* kk = laws_kernels[k];
+            int16_t* dst = slot(r, k);
+            for (int x = 0; x < cols; x++) {
+                const uint8_t* p = padded.data() + x;
+                dst[x] = static_cast<int16_t>(kk[0] * p[0] + kk[1] * p[1] + kk[2] * p[2] + kk[3] * p[3] + kk[4] * p[4]);
+            }
+        }
+    };
+
+    for (int r = begin - 2; r < begin + 2; r++) {
+        horizontal(r);
+    }
+    for (int y = begin; y < end; y++) {
+        horizontal(y + 2);
+        for (size_t f = 0; f < n; f++) {
+            const int* kv = laws_kernels[filters[f].first];
+            int hk = filters[f].second;
+            const int16_t* h0 = slot(y - 2, hk);
+            const int16_t* h1 = slot(y - 1, hk);
+            const int16_t* h2 = slot(y, hk);
+            const int16_t* h3 = slot(y + 1, hk);
+            const int16_t* h4 = slot(y + 2, hk);
+            uint32_t* counts = out.counts[f].data();
+            int lo = out.lo[f];
+            int hi = out.hi[f];
+            for (int x = 0; x < cols; x++) {
+                int v = std::abs(kv[0] * h0[x] + kv[1] * h1[x] + kv[2] * h2[x] + kv[3] * h3[x] + kv[4] * h4[x]);
+                counts[v]++;
+                lo = std::min(lo, v);
+                hi = std::max(hi, v);
+            }
+            out.lo[f] = lo;
+            out.hi[f] = hi;
+        }
+    }
+}
+
+}  // namespace
+
+
+void make_rgb_luts(int bins, ChannelLuts& luts) {
+    for (int v = 0; v < 256; v++) {
+        uint32_t bin = std::min((v * bins) / 256, bins - 1);
+        luts.lut[0][v] = bin;                  // B
+        luts.lut[1][v] = bin * bins;           // G
+        luts.lut[2][v] = bin * bins * bins;    // R
+    }
+    luts.total_bins = static_cast<size_t>(bins) * bins * bins;
+    luts.shift = -1;
+    luts.bits = 0;
+    for (int k = 0; k <= 8; k++) {
+        if ((1 << k) == bins) {
+            luts.shift = 8 - k;
+            luts.bits = k;
+        }
+    }
+}
+
+void make_hs_luts(int bins, ChannelLuts& luts) {
+    for (int v = 0; v < 256; v++) {
+        luts.lut[0][v] = std::min((v * bins) / 180, bins - 1) * bins;   // H, 0-179
+        luts.lut[1][v] = std::min((v * bins) / 256, bins - 1);          // S
+        luts.lut[2][v] = 0;                                             // V unused
+    }
+    luts.total_bins = static_cast<size_t>(bins) * bins;
+    luts.shift = -1;
+    luts.bits = 0;
+}
+
+void make_grey_lut(int bins, uint16_t lut[256]) {
+    for (int v = 0; v < 256; v++) {
+        lut[v] = static_cast<uint16_t>(std::min((v * bins) / 256, bins - 1));
+    }
+}
+
+size_t hist_num_threads(size_t pixels, size_t rows) {
+    size_t hw = std::max(1u, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min({hw, pixels / hist_min_pixels_per_thread, rows}));
+}
+
+int histogram_3c(const cv::Mat& src, const ChannelLuts& luts, std::vector<float>& vec) {
+    if (src.empty() || src.type() != CV_8UC3) {
+        return -1;
+    }
+    size_t pixels = static_cast<size_t>(src.rows) * src.cols;
+    size_t num_shards = hist_num_threads(pixels, src.rows);
+    std::vector<std::vector<uint32_t>> shard_counts(num_shards);
+    split_rows(src.rows, num_shards, [&](int begin, int end, size_t s) {
+        histogram_rows(src, begin, end, luts, shard_counts[s]);
+    });
+
+    std::vector<uint64_t> total(luts.total_bins, 0);
+    for (const std::vector<uint32_t>& counts : shard_counts) {
+        for (size_t sub = 0; sub < hist_sub_histograms; sub++) {
+            const uint32_t* c = counts.data() + sub * luts.total_bins;
+            for (size_t k = 0; k < luts.total_bins; k++) {
+                total[k] += c[k];
+            }
+        }
+    }
+    vec.resize(luts.total_bins);
+    float n = static_cast<float>(pixels);
+    for (size_t k = 0; k < luts.total_bins; k++) {
+        vec[k] = total[k] / n;
+    }
+    return 0;
+}
+
+void bin_plane_1c(const cv::Mat& src, const uint16_t lut[256], cv::Mat& dst) {
+    dst.create(src.size(), CV_16UC1);
+    size_t num_shards = hist_num_threads(static_cast<size_t>(src.rows) * src.cols, src.rows);
+    split_rows(src.rows, num_shards, [&](int begin, int end, size_t) {
+        for (int i = begin; i < end; i++) {
+            const uint8_t* ptr = src.ptr<uint8_t>(i);
+            uint16_t* dst_ptr = dst.ptr<uint16_t>(i);
+            for (int j = 0; j < src.cols; j++) {
+                dst_ptr[j] = lut[ptr[j]];
+            }
+        }
+    });
+}
+
+void bin_plane_rg(const cv::Mat& src, int bins, cv::Mat& dst) {
+    dst.create(src.size(), CV_16UC1);
+    const uint8_t* lut = rg_lut(bins).data();
+    size_t num_shards = hist_num_threads(static_cast<size_t>(src.rows) * src.cols, src.rows);
+    split_rows(src.rows, num_shards, [&](int begin, int end, size_t) {
+        for (int i = begin; i < end; i++) {
+            const uint8_t* ptr = src.ptr<uint8_t>(i);
+            uint16_t* dst_ptr = dst.ptr<uint16_t>(i);
+            for (int j = 0; j < src.cols; j++) {
+                int b = ptr[3 * j];
+                int g = ptr[3 * j + 1];
+                int r = ptr[3 * j + 2];
+                const uint8_t* row = lut + (b + g + r) * 256;
+                dst_ptr[j] = static_cast<uint16_t>(row[r] * bins + row[g]);
+            }
+        }
+    });
+}
+
+int glcm_counts(const cv::Mat& src, int levels, const std::pair<int, int>* offsets, size_t num_offsets, GlcmCounts& out) {
+    if (src.empty() || src.type() != CV_8UC1 || levels <= 0) {
+        return -1;
+    }
+    // (dx, dy) and (-dx, -dy) only transpose the counts, so point every offset downwards (or right on its row).
+    std::vector<std::pair<int, int>> offs(offsets, offsets + num_offsets);
+    for (std::pair<int, int>& o : offs) {
+        if (o.second < 0 || (o.second == 0 && o.first < 0)) {
+            o = {-o.first, -o.second};
+        }
+    }
+    size_t cells = static_cast<size_t>(levels) * levels;
+    size_t num_shards = hist_num_threads(static_cast<size_t>(src.rows) * src.cols, src.rows);
+    std::vector<std::vector<uint32_t>> shard_counts(num_shards, std::vector<uint32_t>(num_offsets * cells, 0));
+    std::vector<std::vector<uint64_t>> shard_pairs(num_shards, std::vector<uint64_t>(num_offsets, 0));
+    split_rows(src.rows, num_shards, [&](int begin, int end, size_t s) {
+        glcm_rows(src, begin, end, levels, offs, shard_counts[s].data(), shard_pairs[s].data());
+    });
+
+    out.levels = levels;
+    out.num_offsets = num_offsets;
+    out.counts = std::move(shard_counts[0]);
+    out.pairs = std::move(shard_pairs[0]);
+    for (size_t s = 1; s < num_shards; s++) {
+        for (size_t k = 0; k < out.counts.size(); k++) {
+            out.counts[k] += shard_counts[s][k];
+        }
+        for (size_t o = 0; o < num_offsets; o++) {
+            out.pairs[o] += shard_pairs[s][o];
+        }
+    }
+    return 0;
+}
+
+void glcm_features(const GlcmCounts& g, std::vector<float>& vec) {
+    int levels = g.levels;
+    size_t cells = static_cast<size_t>(levels) * levels;
+    for (size_t o = 0; o < g.num_offsets; o++) {
+        const uint32_t* c = g.counts.data() + o * cells;
+        uint64_t total = 2 * g.pairs[o];  // Symmetric matrix: every pair counted as (a, b) and (b, a)
+        if (total == 0) {
+            vec.insert(vec.end(), 5, 0.0f);
+            continue;
+        }
+        double energy = 0.0;
+        double contrast = 0.0;
+        double homogeneity = 0.0;
+        double s_log_s = 0.0;
+        uint64_t max_s = 0;
+        for (int a = 0; a < levels; a++) {
+            for (int b = 0; b < levels; b++) {
+                uint64_t sym = static_cast<uint64_t>(c[a * levels + b]) + c[b * levels + a];
+                if (sym == 0) {
+                    continue;
+                }
+                double s = static_cast<double>(sym);
+                int diff = a - b;
+                energy += s * s;
+                contrast += diff * diff * s;
+                homogeneity += s / (1 + std::abs(diff));
+                s_log_s += s_log2_s(sym);
+                max_s = std::max(max_s, sym);
+            }
+        }
+        double n = static_cast<double>(total);
+        // With p = s / n: -sum p log2 p = log2 n - sum s log2 s / n.
+        vec.push_back(static_cast<float>(energy / (n * n)));
+        vec.push_back(static_cast<float>(contrast / n));
+        vec.push_back(static_cast<float>(homogeneity / n));
+        vec.push_back(static_cast<float>(std::log2(n) - s_log_s / n));
+        vec.push_back(static_cast<float>(max_s / n));
+    }
+}
+
+int laws_histograms(const cv::Mat& src, const std::pair<LawsKernel, LawsKernel>* filters, size_t num_filters, int bins, std::vector<float>& vec) {
+    if (src.empty() || src.type() != CV_8UC1 || bins <= 0) {
+        return -1;
+    }
+    std::vector<std::pair<LawsKernel, LawsKernel>> bank(filters, filters + num_filters);
+    size_t pixels = static_cast<size_t>(src.rows) * src.cols;
+    size_t num_shards = hist_num_threads(pixels, src.rows);
+    std::vector<LawsCounts> shards(num_shards);
+    split_rows(src.rows, num_shards, [&](int begin, int end, size_t s) {
+        laws_rows(src, begin, end, bank, shards[s]);
+    });
+
+    vec.assign(num_filters * bins, 0.0f);
+    for (size_t f = 0; f < num_filters; f++) {
+        float* hist = vec.data() + f * bins;
+        int lo = std::numeric_limits<int>::max();
+        int hi = 0;
+        for (const LawsCounts& shard : shards) {
+            if (!shard.counts.empty()) {
+                lo = std::min(lo, shard.lo[f]);
+                hi = std::max(hi, shard.hi[f]);
+            }
+        }
+        if (hi <= lo) {
+            hist[0] = 1.0f;  // Constant response
+            continue;
+        }
+        double range = static_cast<double>(hi - lo);
+        std::vector<uint64_t> total(bins, 0);
+        for (int v = lo; v <= hi; v++) {
+            uint64_t c = 0;
+            for (const LawsCounts& shard : shards) {
+                if (!shard.counts.empty()) {
+                    c += shard.counts[f][v];
+                }
+            }
+            if (c == 0) {
+                continue;
+            }
+            int bin = std::min(bins - 1, static_cast<int>((v - lo) / range * bins));
+            total[bin] += c;
+        }
+        for (int b = 0; b < bins; b++) {
+            hist[b] = static_cast<float>(total[b]) / pixels;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,174 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Header file for hist_kernels.cpp. Histogram binning engine shared by the colour and intensity extractors.
+// Bin indices come from lookup tables (or shifts for power-of-two RGB bins) instead of per-pixel divisions, and
+// are counted into several private sub-histograms that are merged and normalised once at the end. Large images
+// are split by rows across threads. Also holds the single-pass GLCM (co-occurrence) counter and the separable
+// Laws filter bank.
+//
+
+#ifndef HIST_KERNELS_H
+#define HIST_KERNELS_H
+
+#include <opencv2/core.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+const size_t hist_sub_histograms = 4;             // Private counters per bin (count_indices is unrolled to match)
+const size_t hist_min_pixels_per_thread = 1 << 18; // Below this many pixels per thread a histogram stays on one thread
+const size_t glcm_log_table_size = 4096;          // Co-occurrence counts below this use a precomputed s * log2(s)
+
+/**
+ * The five 1D Laws kernels. Every 2D Laws filter is the outer product of two of them.
+ */
+enum LawsKernel {
+    LAWS_L5,    // Level (averaging)
+    LAWS_E5,    // Edge detection
+    LAWS_S5,    // Spot detection
+    LAWS_W5,    // Wave detection
+    LAWS_R5,    // Ripple detection
+    LAWS_NUM_KERNELS
+};
+
+const int laws_kernels[LAWS_NUM_KERNELS][5] = {
+    {1, 4, 6, 4, 1},
+    {-1, -2, 0, 2, 1},
+    {-1, 0, 2, 0, -1},
+    {-1, 2, 0, -2, 1},
+    {1, -4, 6, -4, 1}
+};
+
+/**
+ * Per-channel lookup tables for 3-channel pixels. The bin index of a pixel is lut[0][c0] + lut[1][c1] + lut[2][c2],
+ * each table already multiplied by its channel's stride in the flattened histogram.
+ */
+struct ChannelLuts {
+    uint32_t lut[3][256];
+    size_t total_bins;      // Length of the flattened histogram
+    int shift;              // Right shift giving each channel's bin when the bins are a power of two, -1 otherwise
+    int bits;               // log2 of the bins per channel when shift >= 0
+};
+
+/**
+ * Tables for the flattened bins^3 RGB histogram of a BGR image: index = r * bins^2 + g * bins + b,
+ * bin = value * bins / 256 (same mapping as compute_rgb_histogram).
+ *
+ * @param bins bins per channel
+ * @param luts output tables
+ */
+void make_rgb_luts(int bins, ChannelLuts& luts);
+
+/**
+ * Tables for the bins x bins Hue-Saturation histogram of an HSV image: index = h * bins + s,
+ * h = H * bins / 180, s = S * bins / 256. V is ignored.
+ *
+ * @param bins bins per dimension
+ * @param luts output tables
+ */
+void make_hs_luts(int bins, ChannelLuts& luts);
+
+/**
+ * Table mapping an 8-bit value to value * bins / 256.
+ *
+ * @param bins number of bins
+ * @param lut output table (256 entries)
+ */
+void make_grey_lut(int bins, uint16_t lut[256]);
+
+/**
+ * Normalised histogram of a 3-channel 8-bit image (or ROI).
+ *
+ * @param src CV_8UC3 image
+ * @param luts tables from make_rgb_luts / make_hs_luts
+ * @param vec output vector (luts.total_bins values, summing to 1)
+ * @return 0 if successful, -1 if the image is empty or of the wrong type
+ */
+int histogram_3c(const cv::Mat& src, const ChannelLuts& luts, std::vector<float>& vec);
+
+/**
+ * Bin index of every pixel of an 8-bit single channel image.
+ *
+ * @param src CV_8UC1 image
+ * @param lut table from make_grey_lut
+ * @param dst output CV_16UC1 plane
+ */
+void bin_plane_1c(const cv::Mat& src, const uint16_t lut[256], cv::Mat& dst);
+
+/**
+ * RG chromaticity bin index of every pixel of a BGR image: rindex * bins + gindex, with
+ * rindex = (int) (R / (B + G + R) * (bins - 1) + 0.5). The division is replaced by a (B + G + R, value) lookup
+ * table built with the same float expression, so the indices are identical to the per-pixel division.
+ *
+ * @param src CV_8UC3 image
+ * @param bins bins per dimension (at most 256)
+ * @param dst output CV_16UC1 plane
+ */
+void bin_plane_rg(const cv::Mat& src, int bins, cv::Mat& dst);
+
+/**
+ * Co-occurrence counts of a quantized image for several offsets.
+ */
+struct GlcmCounts {
+    int levels = 0;                               // Grey levels (counts are levels x levels per offset)
+    size_t num_offsets = 0;                       // Number of offsets
+    std::vector<uint32_t> counts;                 // counts[(o * levels + a) * levels + b]: pairs (a, b) at offset o
+    std::vector<uint64_t> pairs;                  // Number of pixel pairs counted for each offset
+};
+
+/**
+ * Counts grey-level co-occurrences for every offset in one pass over the image. Each pixel is loaded once and
+ * paired with its neighbour at every offset, counting into integer matrices (levels^2 x offsets, a few KB for 16
+ * levels). Each ordered pair is counted once; glcm_features makes the matrices symmetric. Large images are split
+ * by rows across threads with private counts.
+ *
+ * @param src CV_8UC1 image (or ROI) with values in [0, levels)
+ * @param levels number of grey levels
+ * @param offsets (dx, dy) offsets; (dx, dy) and (-dx, -dy) give the same symmetric matrix
+ * @param num_offsets number of offsets
+ * @param out output counts
+ * @return 0 if successful, -1 if the image is empty or of the wrong type
+ */
+int glcm_counts(const cv::Mat& src, int levels, const std::pair<int, int>* offsets, size_t num_offsets, GlcmCounts& out);
+
+/**
+ * Appends energy, contrast, homogeneity, entropy and max probability of every offset's symmetric co-occurrence
+ * matrix, normalised by the number of pairs counted. Offsets with no pairs give zeros.
+ *
+ * @param g counts from glcm_counts
+ * @param vec output vector, 5 values per offset are appended
+ */
+void glcm_features(const GlcmCounts& g, std::vector<float>& vec);
+
+/**
+ * Histograms of the absolute responses of a bank of 5x5 Laws filters, each the outer product of a vertical and a
+ * horizontal 1D kernel (correlation, borders reflected as in cv::BORDER_REFLECT_101 at the edges of src).
+ * The five horizontal 1D passes are run once per row into int16 buffers and every filter is finished with a
+ * vertical 1D pass over them, 5x5 + 5 x filters multiply-adds per pixel instead of 25 x filters. Responses are
+ * exact integers and are counted per value as they are produced, with a running min / max, so the min-max
+ * binning needs no second pass over the image. Large images are split by rows across threads.
+ * A filter's histogram bins |response| over [min, max] into bins equal ranges; a constant response puts
+ * everything in bin 0.
+ *
+ * @param src CV_8UC1 image (or ROI)
+ * @param filters (vertical, horizontal) kernel pair of every filter
+ * @param num_filters number of filters
+ * @param bins bins per filter
+ * @param vec output vector (num_filters x bins values, each filter's histogram summing to 1)
+ * @return 0 if successful, -1 if the image is empty or of the wrong type
+ */
+int laws_histograms(const cv::Mat& src, const std::pair<LawsKernel, LawsKernel>* filters, size_t num_filters, int bins, std::vector<float>& vec);
+
+/**
+ * Number of threads to split the rows of an image of the given size across.
+ *
+ * @param pixels number of pixels
+ * @param rows number of rows
+ * @return 1 for small images, otherwise at most one thread per hist_min_pixels_per_thread pixels
+ */
+size_t hist_num_threads(size_t pixels, size_t rows);
+
+#endif //HIST_KERNELS_H
@@ -0,0 +1,253 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// IVF-Flat index: k-means coarse quantizer, binary index file writer and memory-mapped reader.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ivf_index.h"
+#include "csv_util.h"
+#include "kmeans.h"
+
+
+int parse_ivf_metric(char c, IvfMetric& metric) {
+    switch (c) {
+        case 'i': metric = IVF_L2; return 0;
+        case 'o': metric = IVF_COSINE; return 0;
+        default: return -1;
+    }
+}
+
+int read_ivf_embeddings(const fs::path& csv_path, IvfMetric metric, std::vector<float>& data, size_t& dims, std::vector<std::string>& names) {
+    std::vector<long> offsets;
+    if (index_image_data_csv(csv_path.string().c_str(), offsets) != 0 || offsets.empty()) {
+        std::cout << "Unable to read embeddings: " << csv_path << std::endl;
+        return -1;
+    }
+    FILE* fp = fopen(csv_path.string().c_str(), "r");
+    if (!fp) {
+        std::cout << "Unable to open embeddings: " << csv_path << std::endl;
+        return -1;
+    }
+    char img_file[256];
+    std::vector<float> v;
+    data.clear();
+    names.clear();
+    names.reserve(offsets.size());
+    dims = 0;
+    for (size_t i = 0; i < offsets.size(); i++) {
+        if (read_image_data_csv_row(fp, offsets[i], img_file, v) != 0 || v.empty() || (i > 0 && v.size() != dims)) {
+            std::cout << "Row " << i << " of the embeddings could not be read or has the wrong length." << std::endl;
+            fclose(fp);
+            return -1;
+        }
+        if (i == 0) {
+            dims = v.size();
+            data.reserve(offsets.size() * dims);
+        }
+        data.insert(data.end(), v.begin(), v.end());
+        if (metric == IVF_COSINE) {
+            normalize_l2(data.data() + data.size() - dims, dims);
+        }
+        names.push_back(img_file);
+    }
+    fclose(fp);
+    return 0;
+}
+
+int build_ivf_index(const float* data, size_t rows, size_t dims, const std::vector<std::string>& names, IvfMetric metric, size_t nlist, const fs::path& op_path) {
+    if (rows == 0 || dims == 0 || names.size() != rows || nlist == 0) {
+        std::cout << "Nothing to index." << std::endl;
+        return -1;
+    }
+    nlist = std::min(nlist, rows);
+
+    std::cout << "Training " << nlist << " lists on " << std::min(rows, nlist * ivf_train_per_list) << " sampled embeddings..." << std::endl;
+    std::vector<float> centroids;
+    if (kmeans_train(data, rows, dims, nlist, nlist * ivf_train_per_list, metric == IVF_COSINE, centroids) != 0) {
+        std::cout << "Need at least " << nlist << " embeddings to train " << nlist << " lists." << std::endl;
+        return -1;
+    }
+    std::vector<uint32_t> assign;
+    kmeans_assign(data, rows, dims, centroids, nlist, assign);
+
+    // Counting sort of the rows by list.
+    std::vector<uint64_t> list_offsets(nlist + 1, 0);
+    for (uint32_t c : assign) {
+        list_offsets[c + 1]++;
+    }
+    for (size_t c = 0; c < nlist; c++) {
+        list_offsets[c + 1] += list_offsets[c];
+    }
+    std::vector<uint64_t> ids(rows);
+    std::vector<uint64_t> fill(list_offsets.begin(), list_offsets.end() - 1);
+    for (size_t i = 0; i < rows; i++) {
+        ids[fill[assign[i]]++] = i;
+    }
+
+    std::vector<uint64_t> name_offsets(rows);
+    uint64_t names_bytes = 0;
+    for (size_t i = 0; i < rows; i++) {
+        name_offsets[i] = names_bytes;
+        names_bytes += names[i].size() + 1;
+    }
+
+    IvfHeader header{};
+    std::memcpy(header.magic, ivf_magic, sizeof(ivf_magic));
+    header.version = ivf_version;
+    header.metric = metric;
+    header.dims = static_cast<uint32_t>(dims);
+    header.nlist = static_cast<uint32_t>(nlist);
+    header.rows = rows;
+    header.names_bytes = names_bytes;
+
+    std::ofstream op(op_path, std::ios::binary);
+    if (!op) {
+        std::cout << "Unable to open index file for writing: " << op_path << std::endl;
+        return -1;
+    }
+    op.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    op.write(reinterpret_cast<const char*>(list_offsets.data()), list_offsets.size() * sizeof(uint64_t));
+    op.write(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(uint64_t));
+    op.write(reinterpret_cast<const char*>(name_offsets.data()), name_offsets.size() * sizeof(uint64_t));
+    op.write(reinterpret_cast<const char*>(centroids.data()), centroids.size() * sizeof(float));
+    for (uint64_t id : ids) {
+        op.write(reinterpret_cast<const char*>(data + id * dims), dims * sizeof(float));
+    }
+    for (size_t i = 0; i < rows; i++) {
+        op.write(names[i].c_str(), names[i].size() + 1);
+    }
+    if (!op) {
+        std::cout << "Error writing index file: " << op_path << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+
+IvfIndex::IvfIndex() : base(nullptr), mapped_bytes(0), header(nullptr), list_offsets(nullptr), ids(nullptr),
+                       name_offsets(nullptr), centroids(nullptr), data(nullptr), names(nullptr) {}
+
+IvfIndex::~IvfIndex() {
+    if (this->base != nullptr) {
+        munmap(this->base, this->mapped_bytes);
+    }
+}
+
+int IvfIndex::open(const fs::path& path) {
+    int fd = ::open(path.string().c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "Unable to open index file: " << path << std::endl;
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(IvfHeader)) {
+        std::cout << "Index file is too small: " << path << std::endl;
+        ::close(fd);
+        return -1;
+    }
+    void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) {
+        std::cout << "Unable to map index file: " << path << std::endl;
+        return -1;
+    }
+    this->base = m;
+    this->mapped_bytes = st.st_size;
+
+    const IvfHeader* h = static_cast<const IvfHeader*>(m);
+    if (std::memcmp(h->magic, ivf_magic, sizeof(ivf_magic)) != 0 || h->version != ivf_version) {
+        std::cout << "Not an index file (or built by a different version): " << path << std::endl;
+        return -1;
+    }
+    size_t expected = sizeof(IvfHeader)
+                      + (h->nlist + 1 + 2 * h->rows) * sizeof(uint64_t)
+                      + (static_cast<size_t>(h->nlist) + h->rows) * h->dims * sizeof(float)
+                      + h->names_bytes;
+    if (expected != this->mapped_bytes) {
+        std::cout << "Index file is truncated or corrupt: " << path << std::endl;
+        return -1;
+    }
+    const char* p = static_cast<const char*>(m) + sizeof(IvfHeader);
+    this->header = h;
+    this->list_offsets = reinterpret_cast<const uint64_t*>(p);
+    p += (h->nlist + 1) * sizeof(uint64_t);
+    this->ids = reinterpret_cast<const uint64_t*>(p);
+    p += h->rows * sizeof(uint64_t);
+    this->name_offsets = reinterpret_cast<const uint64_t*>(p);
+    p += h->rows * sizeof(uint64_t);
+    this->centroids = reinterpret_cast<const float*>(p);
+    p += static_cast<size_t>(h->nlist) * h->dims * sizeof(float);
+    this->data = reinterpret_cast<const float*>(p);
+    p += h->rows * h->dims * sizeof(float);
+    this->names = p;
+    return 0;
+}
+
+size_t IvfIndex::rows() const {
+    return this->header->rows;
+}
+
+size_t IvfIndex::dims() const {
+    return this->header->dims;
+}
+
+IvfMetric IvfIndex::metric() const {
+    return static_cast<IvfMetric>(this->header->metric);
+}
+
+size_t IvfIndex::nlist() const {
+    return this->header->nlist;
+}
+
+const char* IvfIndex::name(size_t row) const {
+    return this->names + this->name_offsets[row];
+}
+
+double IvfIndex::distance(const float* q, const float* x) const {
+    size_t n = this->dims();
+    if (this->metric() == IVF_COSINE) {
+        return 1.0 - kernel_dot(q, x, n);
+    }
+    return kernel_sum_sq_diff(q, x, n) / n;
+}
+
+int IvfIndex::search(const std::vector<float>& query, size_t k, size_t nprobe, std::vector<ScoredRow>& out) const {
+    size_t n = this->dims();
+    if (query.size() != n) {
+        std::cout << "Query has " << query.size() << " values but the index has " << n << std::endl;
+        return -1;
+    }
+    std::vector<float> q = query;
+    if (this->metric() == IVF_COSINE) {
+        normalize_l2(q.data(), n);
+    }
+
+    TopK probes(std::min(nprobe, this->nlist()));
+    for (size_t c = 0; c < this->nlist(); c++) {
+        probes.push(kernel_sum_sq_diff(q.data(), this->centroids + c * n, n), c);
+    }
+    TopK top(k);
+    for (const ScoredRow& probe : probes.sorted()) {
+        for (uint64_t r = this->list_offsets[probe.row]; r < this->list_offsets[probe.row + 1]; r++) {
+            top.push(this->distance(q.data(), this->data + r * n), this->ids[r]);
+        }
+    }
+    out = top.sorted();
+    return 0;
+}
+
+int IvfIndex::search_exact(const std::vector<float>& query, size_t k, std::vector<ScoredRow>& out) const {
+    return this->search(query, k, this->nlist(), out);
+}
@@ -0,0 +1,180 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Header file for ivf_index.cpp. IVF-Flat approximate nearest neighbour index for DNN embeddings.
+// The embeddings are clustered with k-means into nlist inverted lists. At query time only the nprobe lists whose
+// centroids are closest to the query are scanned. The index is built once by p1 (-i- mode), written to a
+// single binary file and memory-mapped by p2, so opening a 10M image index costs no parsing.
+//
+
+#ifndef IVF_INDEX_H
+#define IVF_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "dist_kernels.h"
+#include "topk.h"
+
+namespace fs = std::filesystem;
+
+const char ivf_magic[4] = {'I', 'V', 'F', 'F'};    // First four bytes of every index file
+const uint32_t ivf_version = 1;                     // Bumped whenever the file layout changes
+const std::string ivf_file_format = ".ivf";          // Extension of index files
+const size_t ivf_default_nprobe = 8;                // Lists scanned per query unless --nprobe is given
+const size_t ivf_train_per_list = 256;              // Training sample size per list (k-means on a sample)
+
+/**
+ * Metrics the index can serve. Cosine vectors are L2-normalised when the index is built, so both reduce to a
+ * single kernel per row.
+ */
+enum IvfMetric : uint32_t {
+    IVF_L2 = 0,       // i - SSD / dims, same value as compute_ssd
+    IVF_COSINE = 1    // o - 1 - cosine similarity, same value as compute_cosine_similarity
+};
+
+/**
+ * Fixed-size header at the start of an index file. All arrays follow in this order:
+ *   list_offsets  (nlist + 1) x uint64   first row of each inverted list in the data block
+ *   ids           rows x uint64          original CSV row of every data row
+ *   name_offsets  rows x uint64          offset of the image name of each original row in the names block
+ *   centroids     nlist x dims float
+ *   data          rows x dims float      embeddings grouped by list
+ *   names         names_bytes chars      NUL terminated image names
+ * 64-bit arrays come first so that every array is naturally aligned in the mapping.
+ */
+struct IvfHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t metric;
+    uint32_t dims;
+    uint32_t nlist;
+    uint32_t reserved;
+    uint64_t rows;
+    uint64_t names_bytes;
+};
+
+/**
+ * Parses the metric character of a p1 -i- / p2 -d- spec.
+ *
+ * @param c metric character ('i' for SSD, 'o' for cosine)
+ * @param metric output metric
+ * @return 0 if successful, -1 if the metric is not supported by the index
+ */
+int parse_ivf_metric(char c, IvfMetric& metric);
+
+/**
+ * Streams an embeddings CSV into one contiguous rows x dims buffer, sized once from a first pass over the row
+ * offsets, so building never holds more than one copy of the corpus. Rows are scaled to unit length for IVF_COSINE.
+ *
+ * @param csv_path embeddings CSV (image name + vector per line)
+ * @param metric metric the index will serve
+ * @param data output, rows x dims values
+ * @param dims output, length of every embedding
+ * @param names output, image name of every embedding
+ * @return 0 if successful, -1 otherwise
+ */
+int read_ivf_embeddings(const fs::path& csv_path, IvfMetric metric, std::vector<float>& data, size_t& dims, std::vector<std::string>& names);
+
+/**
+ * Trains the coarse quantizer and writes an index file.
+ *
+ * @param data rows x dims embeddings, already unit length for IVF_COSINE (see read_ivf_embeddings)
+ * @param rows number of embeddings
+ * @param dims length of every embedding
+ * @param names image name of every embedding
+ * @param metric metric the index will serve
+ * @param nlist number of inverted lists
+ * @param op_path output index file
+ * @return 0 if successful, -1 otherwise
+ */
+int build_ivf_index(const float* data, size_t rows, size_t dims, const std::vector<std::string>& names, IvfMetric metric, size_t nlist, const fs::path& op_path);
+
+/**
+ * Read-only view of an index file mapped into memory.
+ */
+class IvfIndex {
+private:
+    void* base;                      // Start of the mapping
+    size_t mapped_bytes;             // Length of the mapping
+    const IvfHeader* header;         // Header at the start of the mapping
+    const uint64_t* list_offsets;    // nlist + 1 entries
+    const uint64_t* ids;             // Original row of each data row
+    const uint64_t* name_offsets;    // Name offset of each original row
+    const float* centroids;          // nlist x dims
+    const float* data;               // rows x dims, grouped by list
+    const char* names;               // Names block
+
+    /**
+     * Distance between the (prepared) query and one stored vector.
+     */
+    double distance(const float* q, const float* x) const;
+
+public:
+    IvfIndex();
+    ~IvfIndex();
+    IvfIndex(const IvfIndex&) = delete;
+    IvfIndex& operator=(const IvfIndex&) = delete;
+
+    /**
+     * Maps an index file and validates its layout.
+     *
+     * @param path index file
+     * @return 0 if successful, -1 otherwise
+     */
+    int open(const fs::path& path);
+
+    /**
+     * @return number of indexed embeddings
+     */
+    size_t rows() const;
+
+    /**
+     * @return length of each embedding
+     */
+    size_t dims() const;
+
+    /**
+     * @return metric the index was built for
+     */
+    IvfMetric metric() const;
+
+    /**
+     * @return number of inverted lists
+     */
+    size_t nlist() const;
+
+    /**
+     * Image name of an original CSV row.
+     *
+     * @param row original row
+     * @return NUL terminated name inside the mapping
+     */
+    const char* name(size_t row) const;
+
+    /**
+     * Approximate search: scans the nprobe lists closest to the query.
+     *
+     * @param query query embedding (dims values)
+     * @param k number of results
+     * @param nprobe number of lists to scan
+     * @param out output rows (original CSV rows), best first
+     * @return 0 if successful, -1 if the query length does not match
+     */
+    int search(const std::vector<float>& query, size_t k, size_t nprobe, std::vector<ScoredRow>& out) const;
+
+    /**
+     * Exact search over every stored vector. Used to verify the approximate results.
+     *
+     * @param query query embedding (dims values)
+     * @param k number of results
+     * @param out output rows (original CSV rows), best first
+     * @return 0 if successful, -1 if the query length does not match
+     */
+    int search_exact(const std::vector<float>& query, size_t k, std::vector<ScoredRow>& out) const;
+};
+
+#endif //IVF_INDEX_H
@@ -0,0 +1,109 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Lloyd's k-means with threaded assignment.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <thread>
+
+#include "kmeans.h"
+#include "dist_kernels.h"
+
+
+void normalize_l2(float* x, size_t n) {
+    double norm = std::sqrt(kernel_dot(x, x, n));
+    if (norm == 0.0) {
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        x[i] = static_cast<float>(x[i] / norm);
+    }
+}
+
+void kmeans_assign(const float* data, size_t rows, size_t dims, const std::vector<float>& centroids, size_t k, std::vector<uint32_t>& assign) {
+    assign.resize(rows);
+    auto worker = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const float* x = data + i * dims;
+            double best = kernel_sum_sq_diff(x, centroids.data(), dims);
+            uint32_t best_c = 0;
+            for (size_t c = 1; c < k; c++) {
+                double d = kernel_sum_sq_diff(x, centroids.data() + c * dims, dims);
+                if (d < best) {
+                    best = d;
+                    best_c = static_cast<uint32_t>(c);
+                }
+            }
+            assign[i] = best_c;
+        }
+    };
+    size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    num_threads = std::min(num_threads, std::max<size_t>(1, rows / 1024));
+    std::vector<std::thread> workers;
+    size_t chunk = (rows + num_threads - 1) / num_threads;
+    for (size_t t = 0; t < num_threads; t++) {
+        size_t begin = t * chunk;
+        size_t end = std::min(rows, begin + chunk);
+        if (begin < end) {
+            workers.emplace_back(worker, begin, end);
+        }
+    }
+    for (std::thread& t : workers) {
+        t.join();
+    }
+}
+
+int kmeans_train(const float* data, size_t rows, size_t dims, size_t k, size_t max_train, bool spherical, std::vector<float>& centroids) {
+    if (k == 0 || rows < k) {
+        return -1;
+    }
+    std::mt19937 rng(kmeans_seed);
+    std::vector<size_t> order(rows);
+    for (size_t i = 0; i < rows; i++) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), rng);
+    size_t num_train = std::max(k, std::min(rows, max_train));
+
+    std::vector<float> train(num_train * dims);
+    for (size_t i = 0; i < num_train; i++) {
+        std::memcpy(train.data() + i * dims, data + order[i] * dims, dims * sizeof(float));
+    }
+    centroids.assign(train.begin(), train.begin() + k * dims);
+
+    std::vector<uint32_t> assign;
+    std::vector<double> sums(k * dims);
+    std::vector<size_t> counts(k);
+    std::uniform_int_distribution<size_t> pick(0, num_train - 1);
+    for (int it = 0; it < kmeans_iters; it++) {
+        kmeans_assign(train.data(), num_train, dims, centroids, k, assign);
+        std::fill(sums.begin(), sums.end(), 0.0);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t i = 0; i < num_train; i++) {
+            const float* x = train.data() + i * dims;
+            double* s = sums.data() + assign[i] * dims;
+            for (size_t d = 0; d < dims; d++) {
+                s[d] += x[d];
+            }
+            counts[assign[i]]++;
+        }
+        for (size_t c = 0; c < k; c++) {
+            float* cen = centroids.data() + c * dims;
+            if (counts[c] == 0) {
+                std::memcpy(cen, train.data() + pick(rng) * dims, dims * sizeof(float));
+                continue;
+            }
+            for (size_t d = 0; d < dims; d++) {
+                cen[d] = static_cast<float>(sums[c * dims + d] / counts[c]);
+            }
+            if (spherical) {
+                normalize_l2(cen, dims);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Header file for kmeans.cpp. Lloyd's k-means on contiguous float rows, shared by the IVF coarse quantizer and
+// the product quantizer codebooks.
+//
+
+#ifndef KMEANS_H
+#define KMEANS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const int kmeans_iters = 20;          // Lloyd iterations
+const unsigned kmeans_seed = 42;      // Seed for sampling and re-seeding empty clusters (builds are reproducible)
+
+/**
+ * Scales a vector to unit L2 norm (left untouched if it is all zeros).
+ *
+ * @param x vector
+ * @param n number of elements
+ */
+void normalize_l2(float* x, size_t n);
+
+/**
+ * Assigns every row to its nearest centroid (L2). Rows are split across hardware threads.
+ *
+ * @param data rows x dims values
+ * @param rows number of rows
+ * @param dims length of each row
+ * @param centroids k x dims values
+ * @param k number of centroids
+ * @param assign output, index of the nearest centroid of every row
+ */
+void kmeans_assign(const float* data, size_t rows, size_t dims, const std::vector<float>& centroids, size_t k, std::vector<uint32_t>& assign);
+
+/**
+ * Trains k centroids on at most max_train randomly sampled rows. Empty clusters are re-seeded with a random
+ * sample point. With spherical set the centroids are re-normalised after every update (for cosine).
+ *
+ * @param data rows x dims values
+ * @param rows number of rows (must be >= k)
+ * @param dims length of each row
+ * @param k number of centroids
+ * @param max_train largest number of rows used for training
+ * @param spherical re-normalise centroids to unit length
+ * @param centroids output, k x dims values
+ * @return 0 if successful, -1 if k is 0 or there are fewer than k rows
+ */
+int kmeans_train(const float* data, size_t rows, size_t dims, size_t k, size_t max_train, bool spherical, std::vector<float>& centroids);
+
+#endif //KMEANS_H
@@ -11,6 +11,7 @@
 #include <filesystem>
 
 #include "mycv_utils.h"
+#include "hist_kernels.h"
 
 namespace fs = std::filesystem;
 
@@ -174,22 +175,168 @@ HistogramType parse_hist_type(char c) {
 }
 
 
-int compute_histogram(const fs::path& im_path, std::vector<float>& vec, HistogramType hist_type, std::string& part) {
+ImagePlanes::ImagePlanes(const fs::path& img_path, int read_flags) : img_path(img_path), read_flags(read_flags),
+                                                                      decoded(false), sobel_done(false) {}
+
+const cv::Mat& ImagePlanes::bgr() {
+  if (!this->decoded) {
+    this->decoded = true;
+    this->bgr_plane = cv::imread(this->img_path.string(), this->read_flags);
+    if (this->bgr_plane.empty()) {
+      std::cout << "Could not open or find the image" << this->img_path  << std::endl;
+    }
+  }
+  return this->bgr_plane;
+}
+
+const cv::Mat& ImagePlanes::grey() {
+  if (this->grey_plane.empty() && !this->bgr().empty()) {
+    cv::cvtColor(this->bgr_plane, this->grey_plane, cv::COLOR_BGR2GRAY);
+  }
+  return this->grey_plane;
+}
+
+const cv::Mat& ImagePlanes::hsv() {
+  if (this->hsv_plane.empty() && !this->bgr().empty()) {
+    cv::cvtColor(this->bgr_plane, this->hsv_plane, cv::COLOR_BGR2HSV);
+  }
+  return this->hsv_plane;
+}
+
+void ImagePlanes::compute_sobel() {
+  if (this->sobel_done) {
+    return;
+  }
+  this->sobel_done = true;
+  cv::Mat src = this->grey();  // 8UC1
+  if (src.empty()) {
+    return;
+  }
+  this->sx_plane.create(src.size(), CV_16SC1);
+  this->sy_plane.create(src.size(), CV_16SC1);
+  this->mag_plane.create(src.size(), CV_8UC1);
+  sobelX3x3(src, this->sx_plane);
+  sobelY3x3(src, this->sy_plane);
+  magnitude(this->sx_plane, this->sy_plane, this->mag_plane);
+}
+
+const cv::Mat& ImagePlanes::sobel_x() {
+  this->compute_sobel();
+  return this->sx_plane;
+}
+
+const cv::Mat& ImagePlanes::sobel_y() {
+  this->compute_sobel();
+  return this->sy_plane;
+}
+
+const cv::Mat& ImagePlanes::sobel_mag() {
+  this->compute_sobel();
+  return this->mag_plane;
+}
+
+const cv::Mat& ImagePlanes::sobel_orn() {
+  if (this->orn_plane.empty() && !this->sobel_mag().empty()) {
+    this->orn_plane.create(this->sx_plane.size(), CV_32FC1);
+    for (int i=0; i < this->sx_plane.rows; i++) {
+      const short* x_ptr = this->sx_plane.ptr<short>(i);
+      const short* y_ptr = this->sy_plane.ptr<short>(i);
+      float* dst_ptr = this->orn_plane.ptr<float>(i);
+      for (int j=0; j < this->sx_plane.cols; j++) {
+        float angle_deg = std::atan2((float) y_ptr[j], (float) x_ptr[j]) * 180.0 / CV_PI;
+        if (angle_deg < 0) {
+          angle_deg += 180;
+        }
+        dst_ptr[j] = angle_deg;
+      }
+    }
+  }
+  return this->orn_plane;
+}
+
+const cv::Mat& ImagePlanes::quantized(int levels) {
+  auto it = this->quantized_planes.find(levels);
+  if (it != this->quantized_planes.end()) {
+    return it->second;
+  }
+  cv::Mat& dst = this->quantized_planes[levels];
+  cv::Mat src = this->grey();
+  if (!src.empty()) {
+    dst.create(src.size(), CV_8UC1);
+    quantize_img(src, dst, levels);
+  }
+  return dst;
+}
+
+
+const CellHistograms& ImagePlanes::cells(HistogramType hist_type, int bins) {
+  std::pair<HistogramType, int> key(hist_type, bins);
+  auto it = this->cell_hists.find(key);
+  if (it != this->cell_hists.end()) {
+    return it->second;
+  }
+  CellHistograms& grid = this->cell_hists[key];
+  cv::Mat bin_plane;
+  int total_bins = bins;
+  uint16_t grey_lut[256];
+  switch (hist_type) {
+    case HistogramType::INTENSITY:
+      make_grey_lut(bins, grey_lut);
+      if (!this->grey().empty()) bin_plane_1c(this->grey_plane, grey_lut, bin_plane);
+      break;
+    case HistogramType::SOBEL_MAG_1D:
+      make_grey_lut(bins, grey_lut);
+      if (!this->sobel_mag().empty()) bin_plane_1c(this->mag_plane, grey_lut, bin_plane);
+      break;
+    case HistogramType::RG_CHROMATICITY:
+      total_bins = bins * bins;
+      if (!this->bgr().empty()) bin_plane_rg(this->bgr_plane, bins, bin_plane);
+      break;
+    default:
+      break;
+  }
+  if (!bin_plane.empty()) {
+    grid.build(bin_plane, total_bins);
+  }
+  return grid;
+}
+
+
+int take_feature_version(std::vector<char*>& names, std::vector<std::vector<float>>& vecs) {
+    if (names.empty() || feature_version_key != names[0] || vecs.empty() || vecs[0].size() != 1) {
+        return 0;
+    }
+    int version = static_cast<int>(vecs[0][0]);
+    delete[] names[0];
+    names.erase(names.begin());
+    vecs.erase(vecs.begin());
+    return version;
+}
+
+int compute_histogram(ImagePlanes& planes, std::vector<float>& vec, HistogramType hist_type, std::string& part) {
   auto it = histogram_functions.find(hist_type);
   int ret = 0;
   if (it == histogram_functions.end()) {
-    ret = compute_rg_histogram(im_path, vec, part);  // defaults to rg histogram
+    ret = compute_rg_histogram(planes, vec, part);  // defaults to rg histogram
   } else {
-    ret = it->second(im_path, vec, part);
+    ret = it->second(planes, vec, part);
   }
   return ret;
 }
 
+int compute_histogram(const fs::path& im_path, std::vector<float>& vec, HistogramType hist_type, std::string& part) {
+  ImagePlanes planes(im_path);
+  return compute_histogram(planes, vec, hist_type, part);
+}
+
 
-int compute_basic_box_vector(const fs::path &img_path, std::vector<float> &vec, std::string &part, int bins) {
-  cv::Mat src = cv::imread(img_path.string());
+int compute_basic_box_vector(ImagePlanes& planes, std::vector<float> &vec, std::string &part, int bins) {
+  const cv::Mat& src = planes.bgr();
   if (src.empty()) {
-    std::cout << "Could not open or find the image" << img_path  << std::endl;
+    return -1;
+  }
+  if (src.rows < bins || src.cols < bins) {
+    std::cout << "Image is smaller than the center square: " << planes.path() << std::endl;
     return -1;
   }
   cv::Mat img = src(parse_rect_size(part, src.rows, src.cols));  // part = "W"
@@ -214,160 +361,49 @@ int compute_basic_box_vector(const fs::path &img_path, std::vector<float> &vec,
 }
 
 
-int compute_rg_histogram(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins) {
-  cv::Mat hist;
-  hist = cv::Mat::zeros(bins, bins, CV_32FC1);
-  cv::Mat src = cv::imread(img_path.string());
-  if (src.empty()) {
-    std::cout << "Could not open or find the image" << img_path  << std::endl;
+int compute_rg_histogram(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins) {
+  const CellHistograms& cells = planes.cells(HistogramType::RG_CHROMATICITY, bins);
+  if (cells.empty()) {
     return -1;
   }
-  cv::Mat img = src(parse_rect_size(part, src.rows, src.cols));
-  for (int i=0; i < img.rows; i++) {
-    cv::Vec3b* ptr = img.ptr<cv::Vec3b>(i);
-    for (int j=0; j<img.cols; j++) {
-      float B = ptr[j][0];
-      float G = ptr[j][1];
-      float R = ptr[j][2];
-
-      float divisor = B + G + R;
-      divisor = divisor > 0.0 ? divisor : 1.0;
-      float r = R / divisor;
-      float g = G/ divisor;
-
-      int rindex = (int) (r * (bins - 1) + 0.5);
-      int gindex = (int) (g * (bins - 1) + 0.5);
-
-      hist.at<float>(rindex, gindex)++;
-
-    }
-  }
-  vec.clear();
-  // std::cout << "Size of vec = " << vec.size() << std::endl;
-  hist /= (img.rows * img.cols);
-  for (int i=0; i < hist.rows; i++) {
-    float* h_ptr = hist.ptr<float>(i);
-    for (int j=0; j < hist.cols; j++) {
-      vec.push_back(h_ptr[j]);
-      // std::cout << "Size of vec IN THE LOOP = " << vec.size() << std::endl;
-    }
-  }
-  return 0;
+  // bins x bins values, index = rindex * bins + gindex
+  return cells.part_histogram(parse_rect_size(part, cells.rows(), cells.cols()), vec);
 }
 
 
-int compute_rgb_histogram(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins) {
-  cv::Mat src = cv::imread(img_path.string());
+int compute_rgb_histogram(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins) {
+  const cv::Mat& src = planes.bgr();
   if (src.empty()) {
-    std::cout << "Could not open or find the image" << img_path  << std::endl;
     return -1;
   }
   cv::Mat img = src(parse_rect_size(part, src.rows, src.cols));
-  vec.clear();
-  vec.resize(bins * bins * bins, 0.0f);
-  for (int i=0; i < img.rows; i++) {
-    cv::Vec3b* ptr = img.ptr<cv::Vec3b>(i);
-    for (int j=0; j<img.cols; j++) {
-      uchar B = ptr[j][0];
-      uchar G = ptr[j][1];
-      uchar R = ptr[j][2];
-
-      int r_bin = (R * bins) / 256;
-      int g_bin = (G * bins) / 256;
-      int b_bin = (B * bins) / 256;
-
-      if (r_bin >= bins) r_bin = bins - 1;
-      if (g_bin >= bins) g_bin = bins - 1;
-      if (b_bin >= bins) b_bin = bins - 1;
-
-      // Flatten 3D to 1D: index = r*(bins²) + g*bins + b
-      int index = r_bin * (bins * bins) + g_bin * bins + b_bin;
-      vec[index]++;
-    }
-  }
-  float total = static_cast<float>(img.rows * img.cols);
-  for (float& val : vec) {
-    val /= total;
-  }
-  return 0;
+  // Flatten 3D to 1D: index = r*(bins²) + g*bins + b
+  ChannelLuts luts;
+  make_rgb_luts(bins, luts);
+  return histogram_3c(img, luts, vec);
 }
 
 
-int compute_hs_histogram(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins) {
+int compute_hs_histogram(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins) {
 
-  cv::Mat s = cv::imread(img_path.string());
-  if (s.empty()) {
-    std::cout << "Could not open or find the image" << img_path << std::endl;
+  const cv::Mat& src = planes.hsv();
+  if (src.empty()) {
     return -1;
   }
-  cv::Mat src;
-  cv::cvtColor(s, src, cv::COLOR_BGR2HSV);
-  vec.clear();
-  vec.resize(bins * bins, 0.0f);
-//  int skipped = 0;
   cv::Mat img = src(parse_rect_size(part, src.rows, src.cols));
-  for (int i=0; i < img.rows; i++) {
-    cv::Vec3b* ptr = img.ptr<cv::Vec3b>(i);
-    for (int j=0; j<img.cols; j++) {
-      float H = ptr[j][0];
-      float S = ptr[j][1];
-//      float V = ptr[j][2];
-//
-//      if (V < 20) {
-//        skipped++;
-//        continue;
-//      }
-
-      // Map to bins
-      int h_bin = (H * bins) / 180;  // Hue is 0-179
-      int s_bin = (S * bins) / 256;
-
-      // Clamp
-      if (h_bin >= bins) h_bin = bins - 1;
-      if (s_bin >= bins) s_bin = bins - 1;
-
-      int index = h_bin * bins + s_bin;
-      vec[index]++;
-    }
-  }
-//  float div = img.rows * img.cols - skipped;
-  float total = static_cast<float>(img.rows * img.cols);
-  for (float& val : vec) {
-    val /= total;
-  }
-  return 0;
+  // index = h_bin * bins + s_bin, Hue is 0-179
+  ChannelLuts luts;
+  make_hs_luts(bins, luts);
+  return histogram_3c(img, luts, vec);
 }
 
 
-int compute_intensity_histogram(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins) {
-
-  cv::Mat src = cv::imread(img_path.string(), cv::IMREAD_GRAYSCALE);
-  if (src.empty()) {
-    std::cout << "Could not open or find the image" << img_path  << std::endl;
+int compute_intensity_histogram(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins) {
+  const CellHistograms& cells = planes.cells(HistogramType::INTENSITY, bins);
+  if (cells.empty()) {
     return -1;
   }
-  vec.clear();
-  vec.resize(bins, 0.0f);
-//  int skipped = 0;
-  cv::Mat img = src(parse_rect_size(part, src.rows, src.cols));
-  for (int i=0; i < img.rows; i++) {
-    const uchar *ptr = img.ptr<uchar>(i);
-
-    for (int j = 0; j < img.cols; j++) {
-      uchar intensity = ptr[j];
-
-      // Map to bin
-      int bin_index = (intensity * bins) / 256;
-      if (bin_index >= bins) bin_index = bins - 1;
-
-      vec[bin_index]++;
-    }
-  }
-  float total = static_cast<float>(img.rows * img.cols);
-  for (float& val : vec) {
-    val /= total;
-  }
-  return 0;
+  return cells.part_histogram(parse_rect_size(part, cells.rows(), cells.cols()), vec);
 }
 
 
@@ -563,92 +599,38 @@ int magnitude(cv::Mat &sx, cv::Mat &sy, cv::Mat &dst) {
 }
 
 
-int compute_sobel_mag_1d_histogram(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins) {
-  vec.clear();
-  vec.resize(bins, 0.0f);
-  cv::Mat src = cv::imread(img_path.string(), cv::IMREAD_GRAYSCALE);  // 8UC1
-  if (src.empty()) {
-    std::cout << "Could not open or find the image" << img_path  << std::endl;
+int compute_sobel_mag_1d_histogram(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins) {
+  const CellHistograms& cells = planes.cells(HistogramType::SOBEL_MAG_1D, bins);
+  if (cells.empty()) {
     return -1;
   }
-  cv::Mat region = src(parse_rect_size(part, src.rows, src.cols));  // 8UC1
-
-  cv::Mat sx(cv::Size(region.cols, region.rows), CV_16SC1);
-  cv::Mat sy(cv::Size(region.cols, region.rows), CV_16SC1);
-  cv::Mat img(cv::Size(region.cols, region.rows), CV_8UC1);
-  sobelX3x3(region, sx);
-  sobelY3x3(region, sy);
-  magnitude(sx, sy, img);
-
-  for (int i=0; i < img.rows; i++) {
-    uchar* ptr = img.ptr<uchar>(i);
-    for (int j=0; j<img.cols; j++) {
-      float B = ptr[j];
-//      float G = ptr[j][1];
-//      float R = ptr[j][2];
-
-//      float divisor = B + G + R;
-//      divisor = divisor > 0.0 ? divisor : 1.0;
-//      float r = R / divisor;
-//      float g = G/ divisor;
-//
-//      int rindex = (int) (r * (bins - 1) + 0.5);
-//      int gindex = (int) (g * (bins - 1) + 0.5);
-//
-//      hist.at<float>(rindex, gindex)++;
-	  	int bin_index = (int) (B * bins / 256);
-        vec[bin_index]++;
-    }
-  }
-  float total = static_cast<float>(img.rows * img.cols);
-  for (float& val : vec) {
-    val /= total;
-  }
-  return 0;
+  return cells.part_histogram(parse_rect_size(part, cells.rows(), cells.cols()), vec);
 }
 
 
-int compute_sobel_mag_vs_orn_2d_histogram(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins) {
+int compute_sobel_mag_vs_orn_2d_histogram(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins) {
   cv::Mat hist;
   hist = cv::Mat::zeros(bins, angle_bins, CV_32FC1);
   vec.clear();
-  cv::Mat src = cv::imread(img_path.string(), cv::IMREAD_GRAYSCALE);  // 8UC1
-  if (src.empty()) {
-    std::cout << "Could not open or find the image" << img_path  << std::endl;
+  const cv::Mat& mag = planes.sobel_mag();  // 8UC1
+  if (mag.empty()) {
     return -1;
   }
-  cv::Mat region = src(parse_rect_size(part, src.rows, src.cols));  // 8UC1
-
-  cv::Mat sx(cv::Size(region.cols, region.rows), CV_16SC1);
-  cv::Mat sy(cv::Size(region.cols, region.rows), CV_16SC1);
-  cv::Mat img(cv::Size(region.cols, region.rows), CV_8UC1);
-  sobelX3x3(region, sx);
-  sobelY3x3(region, sy);
-  magnitude(sx, sy, img);
+  cv::Rect roi = parse_rect_size(part, mag.rows, mag.cols);
+  cv::Mat img = mag(roi);
+  cv::Mat orn = planes.sobel_orn()(roi);  // 32FC1 degrees
 
   for (int i=0; i < img.rows; i++) {
-    short* x_ptr = sx.ptr<short>(i);
-    short* y_ptr = sy.ptr<short>(i);
+    const float* orn_ptr = orn.ptr<float>(i);
     uchar* ptr = img.ptr<uchar>(i);
     for (int j=0; j<img.cols; j++) {
       float B = ptr[j];
-      float x_val = x_ptr[j];
-      float y_val = y_ptr[j];
-//      float G = ptr[j][1];
-//      float R = ptr[j][2];
-
-//      float divisor = B + G + R;
-//      divisor = divisor > 0.0 ? divisor : 1.0;
-//      float r = R / divisor;
-//      float g = G/ divisor;
-
-      float angle_rad = std::atan2(y_val, x_val);
-      float angle_deg = (angle_rad * 180.0 / CV_PI);
-      if (angle_deg < 0) {
-        angle_deg += 180;
-      }
+      float angle_deg = orn_ptr[j];
 
       int angle_bin = (int) (angle_deg * angle_bins / 180.0);
+      if (angle_bin >= angle_bins) {
+        angle_bin = angle_bins - 1;  // exactly 180 degrees
+      }
 	  int mag_bin = (int) (B * bins / 256);
 //      int rindex = (int) (r * (bins - 1) + 0.5);
 //      int gindex = (int) (g * (bins - 1) + 0.5);
@@ -685,144 +667,29 @@ int quantize_img(cv::Mat& src, cv::Mat& dst, int levels) {
 }
 
 
-int compute_cooccurrence_matrix(cv::Mat&src, cv::Mat& dst, int dx, int dy) {
-  for (int i=0; i < (src.rows - dy); i++) {
-    uchar* sr1 = src.ptr<uchar>(i);
-    uchar* sr2 = src.ptr<uchar>(i + dy);
-//    uchar* dst_ptr = dst.ptr<uchar>(i);
-    for (int j=0; j < (src.cols - dx); j++) {
-      uchar val1 = sr1[j];
-      uchar val2 = sr2[j + dx];
-
-      dst.at<float>(val1, val2)++;
-      dst.at<float>(val2, val1)++;
-    }
-  }
-
-  dst = dst / (quantize_levels * quantize_levels);
-  return 0;
-}
-
-
-int calculate_glcm_vectors(cv::Mat& co_mat, float& energy, float& contrast, float& homogeneity, float& entropy, float& max_prob) {
-  for (int i=0; i < co_mat.rows; i++) {
-    float* ptr = co_mat.ptr<float>(i);
-    for (int j=0; j < co_mat.cols; j++) {
-      float p = ptr[j];
-      if (p > 0) {
-        energy += p * p;
-
-        int diff = i - j;
-        contrast += diff * diff * p;
-
-        homogeneity += p / (1.0 + std::abs(diff));
-
-        entropy += -p * std::log2(p);
-
-        if (p > max_prob) {
-          max_prob = p;
-        }
-      }
-    }
-  }
-  return 0;
-}
-
-
-int compute_glcm_features(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins) {
+int compute_glcm_features(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins) {
   vec.clear();
 
-  cv::Mat src = cv::imread(img_path.string(), cv::IMREAD_GRAYSCALE);  // 8UC1
+  const cv::Mat& src = planes.quantized(bins);  // 8UC1, values in [0, bins)
   if (src.empty()) {
-    std::cout << "Could not open or find the image" << img_path  << std::endl;
     return -1;
   }
   cv::Mat region = src(parse_rect_size(part, src.rows, src.cols));
 
-  quantize_img(region, region, bins);
-
-  for (std::pair<int, int> offset: offsets) {
-    cv::Mat co_mat = cv::Mat::zeros(cv::Size(bins, bins), CV_32FC1);
-    float energy = 0.0f;
-    float contrast = 0.0f;
-    float homogeneity = 0.0f;
-    float entropy = 0.0f;
-    float max_prob = 0.0f;
-    compute_cooccurrence_matrix(region, co_mat, offset.first, offset.second);
-    calculate_glcm_vectors(co_mat, energy, contrast, homogeneity, entropy, max_prob);
-    vec.push_back(energy);
-    vec.push_back(contrast);
-    vec.push_back(homogeneity);
-    vec.push_back(entropy);
-    vec.push_back(max_prob);
-  }
-  return 0;
-}
-
-
-int create_laws_filter(const std::array<float, 5>& a, const std::array<float, 5>& b, cv::Mat& filter) {
-	for (int i=0; i < 5; i++) {
-          uchar* ptr = filter.ptr<uchar>(i);
-          for (int j=0; j < 5; j++) {
-            ptr[j] = a[i] * b[j];
-          }
-	}
-    return 0;
-}
-
-
-int calculate_law_response_histogram(cv::Mat& src, std::vector<float>& hist, int bins) {
-  hist.clear();
-  hist.resize(bins, 0.0f);
-
-  double min_val;
-  double max_val;
-  minMaxLoc(src, &min_val, &max_val);
-  if (max_val - min_val < 0.001) {
-    hist[0] = 1.0f;
-    return 0;
-  }
-  for (int i=0; i < bins; i++) {
-    float* ptr = src.ptr<float>(i);
-    for (int j=0; j < bins; j++) {
-      float val = ptr[j];
-
-      float norm = (val - min_val) / (max_val - min_val);
-      int bin_index = (int) (norm * bins);
-
-      if (bin_index >= bins) {
-      	bin_index = bins - 1;
-      }
-      hist[bin_index]++;
-    }
-  }
-  float total = static_cast<float>(src.rows * src.cols);
-  for (float& val : hist) {
-    val /= total;
+  GlcmCounts counts;
+  if (glcm_counts(region, bins, offsets, std::size(offsets), counts) != 0) {
+    return -1;
   }
+  glcm_features(counts, vec);
   return 0;
 }
 
 
-int compute_law_histogram(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins) {
-  cv::Mat src = cv::imread(img_path.string(), cv::IMREAD_GRAYSCALE);  // 8UC1
+int compute_law_histogram(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins) {
+  const cv::Mat& src = planes.grey();  // 8UC1
   if (src.empty()) {
-    std::cout << "Could not open or find the image" << img_path  << std::endl;
     return -1;
   }
   cv::Mat region = src(parse_rect_size(part, src.rows, src.cols));
-
-  for (std::pair<std::array<float, 5>, std::array<float, 5>> lf: laws_filters) {
-    cv::Mat two_d_filter(cv::Size(5, 5), CV_32FC1);
-    create_laws_filter(lf.first, lf.second, two_d_filter);
-
-    cv::Mat response;
-    cv::filter2D(region, response, -1, two_d_filter);
-    response = cv::abs(response);
-
-    std::vector<float> tmp;
-    calculate_law_response_histogram(response, tmp, bins);
-    vec.insert(vec.end(), tmp.begin(), tmp.end());
-  }
-  return 0;
+  return laws_histograms(region, laws_filters, std::size(laws_filters), bins, vec);
 }
\ No newline at end of file
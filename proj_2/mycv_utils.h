@@ -9,6 +9,7 @@
 #define MYCV_UTILS_H
 
 #include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
 
 #include <filesystem>
 #include <string>
@@ -17,13 +18,10 @@
 #include <iterator>
 #include <functional>
 
-namespace fs = std::filesystem;
+#include "cell_hist.h"
+#include "hist_kernels.h"
 
-/**
- * Function pointer type for histogram computation functions.
- * Takes image path, output vector, and part name as parameters.
- */
-typedef std::function<int(const fs::path&, std::vector<float>&, std::string&)> HistogramFunction;
+namespace fs = std::filesystem;
 
 // Sobel filter kernels for separable convolution
 const int SOBEL_g[3] = {1, 2, 1};      // Gaussian smoothing kernel
@@ -34,6 +32,11 @@ const int SOBEL_r[3] = {1, 0, -1};     // Reverse derivative kernel
 const int angle_bins = 9;              // Number of orientation bins (0-180 degrees)
 const int quantize_levels = 16;       // Grayscale quantization levels for GLCM
 
+// Version of the histogram extractors. Bump whenever a change alters the values any extractor writes, so cached
+// target histograms and rankings computed by an older build are never reused.
+const int feature_version = 3;  // 2: GLCM normalised by pair count, 3: signed Laws responses
+const std::string feature_version_key = "#feature_version";  // Name of the first row of every p1 -m- feature CSV
+
 /**
  * Spatial offsets for GLCM computation.
  * Format: {dx, dy} where dx is horizontal offset, dy is vertical offset.
@@ -51,28 +54,21 @@ const std::pair<int, int> offsets[4] = {
 // const std::array<float, 5> W5 = {-1, 2, 0, -2, 1};  // Wave
 // const std::array<float, 5> R5 = {1, -4, 6, -4, 1};  // Ripple
 
-// Laws filter 1D kernels for texture analysis
-const std::array<float, 5> L5 = {1, 4, 6, 4, 1};      // Level (averaging)
-const std::array<float, 5> E5 = {-1, -2, 0, 2, 1};    // Edge detection
-const std::array<float, 5> S5 = {-1, 0, 2, 0, -1};    // Spot detection
-const std::array<float, 5> W5 = {-1, 2, 0, -2, 1};    // Wave detection
-const std::array<float, 5> R5 = {1, -4, 6, -4, 1};    // Ripple detection
-
 /**
  * The 9 Laws filter combinations used for texture analysis.
- * Each entry is a pair of 1D kernels that are combined to create a 2D filter.
+ * Each entry is a pair of 1D kernels (see laws_kernels in hist_kernels.h) whose outer product is the 2D filter.
  * Format: {vertical_kernel, horizontal_kernel}
  */
-const std::pair<std::array<float, 5>, std::array<float, 5>> laws_filters[9] = {
-  {L5, E5},  // Vertical edges
-  {E5, L5},  // Horizontal edges
-  {E5, E5},  // All edges
-  {S5, S5},  // Spots
-  {L5, S5},  // Vertical spots
-  {S5, L5},  // Horizontal spots
-  {W5, W5},  // Waves
-  {R5, R5},  // Ripples
-  {E5, S5}   // Edge-spot combinations
+const std::pair<LawsKernel, LawsKernel> laws_filters[9] = {
+  {LAWS_L5, LAWS_E5},  // Vertical edges
+  {LAWS_E5, LAWS_L5},  // Horizontal edges
+  {LAWS_E5, LAWS_E5},  // All edges
+  {LAWS_S5, LAWS_S5},  // Spots
+  {LAWS_L5, LAWS_S5},  // Vertical spots
+  {LAWS_S5, LAWS_L5},  // Horizontal spots
+  {LAWS_W5, LAWS_W5},  // Waves
+  {LAWS_R5, LAWS_R5},  // Ripples
+  {LAWS_E5, LAWS_S5}   // Edge-spot combinations
 };
 
 /**
@@ -120,6 +116,80 @@ const std::unordered_map<HistogramType, std::string> HISTOGRAM_NAMES = {
   {LAW, "law"}
 };
 
+/**
+ * Decoded image and the planes derived from it, each computed on first use and then reused.
+ * One instance is made per image so that every histogram over every part of that image shares a single decode,
+ * a single grey / HSV conversion and a single Sobel pass. Planes always cover the whole image; histogram functions
+ * take their part as an ROI of the plane.
+ */
+class ImagePlanes {
+private:
+  fs::path img_path;                        // Image file
+  int read_flags;                           // cv::imread flags used for the decode
+  bool decoded;                             // Decode has been attempted
+  bool sobel_done;                          // Sobel planes have been attempted
+  cv::Mat bgr_plane;                        // 8UC3 decoded image
+  cv::Mat grey_plane;                       // 8UC1
+  cv::Mat hsv_plane;                        // 8UC3, H in [0, 180)
+  cv::Mat sx_plane;                         // 16SC1 Sobel X
+  cv::Mat sy_plane;                         // 16SC1 Sobel Y
+  cv::Mat mag_plane;                        // 8UC1 gradient magnitude
+  cv::Mat orn_plane;                        // 32FC1 gradient orientation in degrees, [0, 180]
+  std::map<int, cv::Mat> quantized_planes;  // 8UC1 grey quantized to n levels, keyed by n
+  std::map<std::pair<HistogramType, int>, CellHistograms> cell_hists;  // Cell grids keyed by (type, bins)
+
+  /**
+   * Fills sx, sy and magnitude from the grey plane.
+   */
+  void compute_sobel();
+
+public:
+  /**
+   * Constructor for ImagePlanes. Nothing is decoded until a plane is requested.
+   *
+   * @param img_path path to the image file
+   * @param read_flags cv::imread flags (full color decode by default)
+   */
+  explicit ImagePlanes(const fs::path& img_path, int read_flags=cv::IMREAD_COLOR);
+
+  const fs::path& path() const { return this->img_path; }
+
+  /**
+   * Each accessor returns an empty Mat if the image could not be decoded.
+   */
+  const cv::Mat& bgr();
+  const cv::Mat& grey();
+  const cv::Mat& hsv();
+  const cv::Mat& sobel_x();
+  const cv::Mat& sobel_y();
+  const cv::Mat& sobel_mag();
+  const cv::Mat& sobel_orn();
+
+  /**
+   * Grey plane quantized to the given number of levels (GLCM input).
+   *
+   * @param levels number of grey levels
+   * @return quantized plane
+   */
+  const cv::Mat& quantized(int levels);
+
+  /**
+   * Cell grid histograms of the whole image (see cell_hist.h), from which any part's histogram is assembled
+   * without re-walking its pixels. Supported for INTENSITY, SOBEL_MAG_1D and RG_CHROMATICITY; empty otherwise.
+   *
+   * @param hist_type histogram type
+   * @param bins number of bins (per dimension for RG chromaticity)
+   * @return cell grid, empty if the image could not be decoded or the type is not supported
+   */
+  const CellHistograms& cells(HistogramType hist_type, int bins);
+};
+
+/**
+ * Function pointer type for histogram computation functions.
+ * Takes the image planes, output vector, and part name as parameters.
+ */
+typedef std::function<int(ImagePlanes&, std::vector<float>&, std::string&)> HistogramFunction;
+
 /**
  * Holds configuration information for feature extraction including
  * image parts, histogram types, regions of interest, and bin counts.
@@ -168,6 +238,8 @@ cv::Rect parse_rect_size(std::string ch, int r, int c);
 
 // Default bin counts for each histogram type
 const int basic_box_size = 7;          // 7x7 square for baseline matching
+const int basic_box_vector_size = basic_box_size * basic_box_size * 3;  // B, G, R of every pixel in the square
+const int basic_box_reduced_read = cv::IMREAD_REDUCED_COLOR_2;         // Half-scale decode used when vectors are computed on the fly
 const int rg_bins = 16;                // 32x32 bins for RG chromaticity
 const int rgb_bins = 8;               // 32x32x32 bins for RGB (flattened)
 const int hs_bins = 32;                // 32x32 bins for Hue-Saturation
@@ -196,6 +268,26 @@ const std::map<HistogramType, int> histogram_bins = {
  * Main dispatcher function that calls the appropriate histogram computation function
  * based on the histogram type specified.
  *
+ * @param planes decoded planes of the image (shared by every histogram of that image)
+ * @param vec output vector where histogram/features will be stored
+ * @param hist_type type of histogram to compute
+ * @param part name of the image part/region to process
+ * @return 0 if successful, non-zero otherwise
+ */
+int compute_histogram(ImagePlanes& planes, std::vector<float>& vec, HistogramType hist_type, std::string& part);
+
+/**
+ * Removes the version row p1 -m- writes at the top of its feature CSVs, if the file has one.
+ *
+ * @param names image names read from the CSV
+ * @param vecs vectors read from the CSV
+ * @return feature_version the file was written with, 0 if it has no version row (older p1, or not a -m- file)
+ */
+int take_feature_version(std::vector<char*>& names, std::vector<std::vector<float>>& vecs);
+
+/**
+ * Computes a single histogram of an image file. Use the ImagePlanes overload when several histograms are needed.
+ *
  * @param im_path path to the image file
  * @param vec output vector where histogram/features will be stored
  * @param hist_type type of histogram to compute
@@ -206,121 +298,125 @@ int compute_histogram(const fs::path& im_path, std::vector<float>& vec, Histogra
 
 /**
  * Computes baseline 7x7 center square feature vector.
+ * With planes read using basic_box_reduced_read the JPEG is decoded at half scale (libjpeg skips most of the IDCT
+ * work), so the square covers a 14x14 area of the full image. Vectors read with different flags are not comparable.
  *
- * @param img_path path to the image file
- * @param vec output vector (49 values for 7x7 square)
+ * @param planes decoded planes of the image
+ * @param vec output vector (147 values: B, G, R for each pixel of the 7x7 square)
  * @param part name of the image part (typically "whole")
  * @param bins size of the center square (default 7)
  * @return 0 if successful
  */
-int compute_basic_box_vector(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins=basic_box_size);
+int compute_basic_box_vector(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins=basic_box_size);
 
 /**
  * Computes RG chromaticity histogram for the specified image region.
  *
- * @param img_path path to the image file
+ * @param planes decoded planes of the image
  * @param vec output vector (bins x bins values)
  * @param part name of the image part to process
  * @param bins number of bins per dimension (default 32)
  * @return 0 if successful
  */
-int compute_rg_histogram(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins=rg_bins);
+int compute_rg_histogram(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins=rg_bins);
 
 /**
  * Computes 3D RGB color histogram for the specified image region.
  *
- * @param img_path path to the image file
+ * @param planes decoded planes of the image
  * @param vec output vector (bins^3 values, flattened)
  * @param part name of the image part to process
  * @param bins number of bins per channel (default 32)
  * @return 0 if successful
  */
-int compute_rgb_histogram(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins=rgb_bins);
+int compute_rgb_histogram(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins=rgb_bins);
 
 /**
  * Computes Hue-Saturation histogram for the specified image region.
  *
- * @param img_path path to the image file
+ * @param planes decoded planes of the image
  * @param vec output vector (bins x bins values)
  * @param part name of the image part to process
  * @param bins number of bins per dimension (default 32)
  * @return 0 if successful
  */
-int compute_hs_histogram(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins=hs_bins);
+int compute_hs_histogram(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins=hs_bins);
 
 /**
  * Computes grayscale intensity histogram for the specified image region.
  *
- * @param img_path path to the image file
+ * @param planes decoded planes of the image
  * @param vec output vector (bins values)
  * @param part name of the image part to process
  * @param bins number of intensity bins (default 32)
  * @return 0 if successful
  */
-int compute_intensity_histogram(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins=intensity_bins);
+int compute_intensity_histogram(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins=intensity_bins);
 
 /**
  * Computes 1D histogram of Sobel gradient magnitudes.
  *
- * @param img_path path to the image file
+ * @param planes decoded planes of the image
  * @param vec output vector (bins values)
  * @param part name of the image part to process
  * @param bins number of magnitude bins (default 32)
  * @return 0 if successful
  */
-int compute_sobel_mag_1d_histogram(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins=sobel_mag_1d_bins);
+int compute_sobel_mag_1d_histogram(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins=sobel_mag_1d_bins);
 
 /**
  * Computes 2D histogram of Sobel gradient magnitude vs orientation.
  * Combines magnitude strength with edge direction for texture analysis.
  *
- * @param img_path path to the image file
+ * @param planes decoded planes of the image
  * @param vec output vector (mag_bins x angle_bins values, flattened)
  * @param part name of the image part to process
  * @param bins number of bins per dimension (default 32)
  * @return 0 if successful
  */
-int compute_sobel_mag_vs_orn_2d_histogram(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins=sobel_mag_2d_bins);
+int compute_sobel_mag_vs_orn_2d_histogram(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins=sobel_mag_2d_bins);
 
 /**
  * Computes GLCM (Gray-Level Co-occurrence Matrix) texture features.
  * Extracts 5 features (energy, contrast, homogeneity, entropy, max probability)
- * for each of 4 spatial offsets.
+ * for each of 4 spatial offsets. All offsets are counted in one pass (glcm_counts) and every matrix is normalised
+ * by its number of pixel pairs.
  *
- * @param img_path path to the image file
+ * @param planes decoded planes of the image
  * @param vec output vector (20 values: 5 features x 4 offsets)
  * @param part name of the image part to process
  * @param bins number of grayscale quantization levels (default 16)
  * @return 0 if successful
  */
-int compute_glcm_features(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins=glcm_bins);
+int compute_glcm_features(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins=glcm_bins);
 
 /**
  * Computes histograms of Laws filter responses for texture analysis.
- * Applies 9 different Laws filter combinations and creates response histograms.
+ * Applies 9 different Laws filter combinations and creates histograms of the absolute responses
+ * (separable filter bank, see laws_histograms).
  *
- * @param img_path path to the image file
+ * @param planes decoded planes of the image
  * @param vec output vector (9 filters x bins values)
  * @param part name of the image part to process
  * @param bins number of bins per filter response histogram (default 16)
  * @return 0 if successful
  */
-int compute_law_histogram(const fs::path& img_path, std::vector<float>& vec, std::string& part, int bins=law_bins);
+int compute_law_histogram(ImagePlanes& planes, std::vector<float>& vec, std::string& part, int bins=law_bins);
 
 /**
  * Registry mapping histogram types to their computation functions.
  * Uses lambda functions to provide uniform interface for all histogram types.
  */
 const std::map<HistogramType, HistogramFunction> histogram_functions = {
-  {HistogramType::BASIC_BOX, [](const fs::path& p, std::vector<float>& s, std::string& v) {return compute_basic_box_vector(p, s, v);} },
-  {HistogramType::RG_CHROMATICITY, [](const fs::path& p, std::vector<float>& s, std::string& v) {return compute_rg_histogram(p, s, v);} },
-  {HistogramType::RGB, [](const fs::path& p, std::vector<float>& s, std::string& v) {return compute_rgb_histogram(p, s, v);} },
-  {HistogramType::HS, [](const fs::path& p, std::vector<float>& s, std::string& v) {return compute_hs_histogram(p, s, v);} },
-  {HistogramType::INTENSITY, [](const fs::path& p, std::vector<float>& s, std::string& v) {return compute_intensity_histogram(p, s, v);} },
-  {HistogramType::SOBEL_MAG_1D, [](const fs::path& p, std::vector<float>& s, std::string& v) {return compute_sobel_mag_1d_histogram(p, s, v);} },
-  {HistogramType::SOBEL_MAGvORN_2D, [](const fs::path& p, std::vector<float>& s, std::string& v) {return compute_sobel_mag_vs_orn_2d_histogram(p, s, v);} },
-  {HistogramType::GLCM, [](const fs::path& p, std::vector<float>& s, std::string& v) {return compute_glcm_features(p, s, v);} },
-  {HistogramType::LAW, [](const fs::path& p, std::vector<float>& s, std::string& v) {return compute_law_histogram(p, s, v);} }
+  {HistogramType::BASIC_BOX, [](ImagePlanes& p, std::vector<float>& s, std::string& v) {return compute_basic_box_vector(p, s, v);} },
+  {HistogramType::RG_CHROMATICITY, [](ImagePlanes& p, std::vector<float>& s, std::string& v) {return compute_rg_histogram(p, s, v);} },
+  {HistogramType::RGB, [](ImagePlanes& p, std::vector<float>& s, std::string& v) {return compute_rgb_histogram(p, s, v);} },
+  {HistogramType::HS, [](ImagePlanes& p, std::vector<float>& s, std::string& v) {return compute_hs_histogram(p, s, v);} },
+  {HistogramType::INTENSITY, [](ImagePlanes& p, std::vector<float>& s, std::string& v) {return compute_intensity_histogram(p, s, v);} },
+  {HistogramType::SOBEL_MAG_1D, [](ImagePlanes& p, std::vector<float>& s, std::string& v) {return compute_sobel_mag_1d_histogram(p, s, v);} },
+  {HistogramType::SOBEL_MAGvORN_2D, [](ImagePlanes& p, std::vector<float>& s, std::string& v) {return compute_sobel_mag_vs_orn_2d_histogram(p, s, v);} },
+  {HistogramType::GLCM, [](ImagePlanes& p, std::vector<float>& s, std::string& v) {return compute_glcm_features(p, s, v);} },
+  {HistogramType::LAW, [](ImagePlanes& p, std::vector<float>& s, std::string& v) {return compute_law_histogram(p, s, v);} }
 };
 
 /**
@@ -362,49 +458,4 @@ int magnitude(cv::Mat &sx, cv::Mat &sy, cv::Mat &dst);
  */
 int quantize_img(cv::Mat& src, cv::Mat& dst, int levels);
 
-/**
- * Computes gray-level co-occurrence matrix for given spatial offset.
- *
- * @param src input quantized grayscale image
- * @param dst output co-occurrence matrix (levels x levels)
- * @param dx horizontal offset
- * @param dy vertical offset
- * @return 0 if successful
- */
-int compute_cooccurrence_matrix(cv::Mat& src, cv::Mat& dst, int dx, int dy);
-
-/**
- * Calculates five GLCM texture features from a co-occurrence matrix.
- *
- * @param co_mat input co-occurrence matrix
- * @param energy output: sum of squared elements
- * @param contrast output: intensity contrast between neighbors
- * @param homogeneity output: similarity of neighbors
- * @param entropy output: randomness of texture
- * @param max_prob output: most dominant co-occurrence pair
- * @return 0 if successful
- */
-int calculate_glcm_vectors(cv::Mat& co_mat, float& energy, float& contrast, float& homogeneity, float& entropy, float& max_prob);
-
-/**
- * Creates a 5x5 2D Laws filter from two 1D kernels.
- * Combines vertical and horizontal kernels via outer product.
- *
- * @param a vertical 1D kernel (5 elements)
- * @param b horizontal 1D kernel (5 elements)
- * @param filter output 5x5 filter matrix
- * @return 0 if successful
- */
-int create_laws_filter(const float a[5], const float b[5], cv::Mat& filter);
-
-/**
- * Computes histogram of Laws filter response values.
- *
- * @param src filtered image (response map)
- * @param hist output histogram vector
- * @param bins number of histogram bins
- * @return 0 if successful
- */
-int calculate_law_response_histogram(cv::Mat& src, std::vector<float>& hist, int bins);
-
 #endif //MYCV_UTILS_H
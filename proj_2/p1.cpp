@@ -28,7 +28,11 @@ int main(int argc, char *argv[]) {
 
     P1 p1;
     p1.parse_mode(arg1);
-    p1.parse_dir(arg2);
+    if (arg1.starts_with("-i-") || arg1.starts_with("-q-")) {
+        p1.parse_csv_file(arg2);
+    } else {
+        p1.parse_dir(arg2);
+    }
     p1.run();
     return 0;
 }
@@ -40,7 +44,7 @@ int P1::parse_mode(std::string& arg) {
         std::exit(-1);
     }
     if (valid_modes.count(arg[1]) == 0) {
-        std::cout << "Allowed modes include: [m, b]" << std::endl;
+        std::cout << "Allowed modes include: [m, b, i, q]" << std::endl;
         std::exit(-1);
     }
     const char hyphen = '-';
@@ -72,6 +76,17 @@ int P1::parse_dir(std::string& arg) {
 }
 
 
+int P1::parse_csv_file(std::string& arg) {
+    std::set<std::string> csv = {".csv"};
+    if (!check_file(arg, csv)) {
+        std::cout << "Index (-i-) and PQ (-q-) modes expect a CSV file of feature vectors: " << arg << std::endl;
+        std::exit(-1);
+    }
+    this->csv_file = fs::absolute(arg);
+    return 0;
+}
+
+
 int P1::find_img_paths() {
     int count = 0;
     for (const fs::directory_entry& entry : fs::directory_iterator(this->dir)) {
@@ -102,6 +117,12 @@ int P1::run() {
     else if (this->mode == "m") {
         this->run_mhs();  // multiple histogram match mode
     }
+    else if (this->mode == "i") {
+        this->run_ivf();  // ANN index over DNN embeddings
+    }
+    else if (this->mode == "q") {
+        this->run_pq();  // product-quantized feature store
+    }
     // else if (this->mode == "h") {
     //     std::cout << "Running Single Histogram match mode." << std::endl;
     //     this->run_bhs();  // basic histogram match mode
@@ -116,17 +137,21 @@ int P1::run() {
 
 
 int P1::run_bsm() {
-	std::cout << "Inside run_bsm" << std::endl;
     std::string ts = std::to_string(get_time_instant());
     std::string op_filename = bsm_op_file_name + ts + op_file_format;
-	std::cout << op_filename << std::endl;
     fs::path parent_dir = this->dir.parent_path();
     fs::path op_file_path = parent_dir / op_filename;
     this->op_files.push_back(fs::absolute(op_file_path));
 
-    std::vector<float> dummy = {0.0};
+    std::string basic_box_part_name = "W";
+    std::vector<float> vec;
+    vec.reserve(basic_box_vector_size);
     for (const fs::path& file : this->img_paths) {
-        append_image_data_csv(op_file_path.string().c_str(), file.string().c_str(), dummy);
+        vec.clear();
+        if (compute_histogram(file, vec, HistogramType::BASIC_BOX, basic_box_part_name) != 0) {
+            continue;  // unreadable image, already reported
+        }
+        append_image_data_csv(op_file_path.string().c_str(), file.string().c_str(), vec);
     }
     return 0;
 }
@@ -140,32 +165,88 @@ int P1::run_mhs() {
     FeatureConfig config;
     parse_config(this->spec, config);
 
+    std::vector<std::string> op_paths;
+    std::string ts = std::to_string(get_time_instant());
     for (std::size_t i = 0; i < config.parts.size(); i++) {
         std::string part = config.parts[i];
         HistogramType ht = config.hists[i];
-        std::cout << "Processing part: " << part << std::endl;
-        std::cout << "Histogram type: " << HISTOGRAM_NAMES.at(ht) << std::endl;
+        std::cout << "Part: " << part << ", Histogram type: " << HISTOGRAM_NAMES.at(ht) << std::endl;
 
-        std::string ts = std::to_string(get_time_instant());
         std::string op_file_name = part + "_" + HISTOGRAM_NAMES.at(ht) + "_" + mhs_op_file_name + ts + op_file_format;
         fs::path op_path = this->dir.parent_path() / op_file_name;
         std::cout << "Writing vectors to: " << op_path << std::endl;
     	this->op_files.push_back(op_path);
-        for (fs::path img_path : this->img_paths) {
-            std::vector<float> img_vec;
-            std::cout << "Processing Image: " << img_path << std::endl;
-            int res = compute_histogram(img_path, img_vec, ht, part);
+        op_paths.push_back(fs::absolute(op_path).string());
+    }
+
+    // Every file starts with the version of the extractors, so p2 can refuse files written by an older p1.
+    std::vector<float> img_vec = {static_cast<float>(feature_version)};
+    for (const std::string& op_path : op_paths) {
+        append_image_data_csv(op_path.c_str(), feature_version_key.c_str(), img_vec, 1);
+    }
+
+    // Image-major: every part of an image is computed from the same decoded planes.
+    for (const fs::path& img_path : this->img_paths) {
+        ImagePlanes planes(img_path);
+        std::string abs_img_path = fs::absolute(img_path).string();
+        for (std::size_t i = 0; i < config.parts.size(); i++) {
+            img_vec.clear();
+            int res = compute_histogram(planes, img_vec, config.hists[i], config.parts[i]);
             if (res != 0) {
-                std::cout << "Error computing histogram." << std::endl;
+                std::cout << "Error computing histogram for " << img_path << std::endl;
                 continue;
             }
-            append_image_data_csv(fs::absolute(op_path).string().c_str(), fs::absolute(img_path).string().c_str(), img_vec);
+            append_image_data_csv(op_paths[i].c_str(), abs_img_path.c_str(), img_vec);
         }
     }
     return 0;
 }
 
 
+int P1::run_ivf() {
+    IvfMetric metric;
+    size_t nlist = 0;
+    if (this->spec.size() < 2 || parse_ivf_metric(this->spec[0], metric) != 0 || !parse_count(this->spec.substr(1), nlist)) {
+        std::cout << "Index spec should be a metric (i or o) followed by the number of lists. Example: -i-o1024" << std::endl;
+        std::exit(-1);
+    }
+
+    std::vector<float> data;
+    std::vector<std::string> names;
+    size_t dims = 0;
+    if (read_ivf_embeddings(this->csv_file, metric, data, dims, names) != 0) {
+        std::exit(-1);
+    }
+    std::string op_file_name = this->csv_file.stem().string() + "_ivf_" + this->spec + ivf_file_format;
+    fs::path op_path = this->csv_file.parent_path() / op_file_name;
+    std::cout << "Building index over " << names.size() << " embeddings of size " << dims << std::endl;
+    if (build_ivf_index(data.data(), names.size(), dims, names, metric, nlist, op_path) != 0) {
+        std::cout << "Error building index." << std::endl;
+        std::exit(-1);
+    }
+    this->op_files.push_back(op_path);
+    return 0;
+}
+
+
+int P1::run_pq() {
+    size_t m = 0;
+    if (this->spec.size() < 3 || !std::isalpha(this->spec[0]) || !std::isalpha(this->spec[1])
+        || !parse_count(this->spec.substr(2), m)) {
+        std::cout << "PQ spec should be a part, a histogram and the number of sub-spaces. Example: -q-wR64" << std::endl;
+        std::exit(-1);
+    }
+    std::string op_file_name = this->csv_file.stem().string() + "_pq" + this->spec.substr(2) + pq_file_format;
+    fs::path op_path = this->csv_file.parent_path() / op_file_name;
+    if (build_pq_store(this->csv_file, this->spec[0], this->spec[1], m, op_path) != 0) {
+        std::cout << "Error building PQ store." << std::endl;
+        std::exit(-1);
+    }
+    this->op_files.push_back(op_path);
+    return 0;
+}
+
+
 // int main(int argc, char* argv[]) {
 //
 // 	fs::path op_path;
@@ -21,10 +21,9 @@
  *
  * Output:
  *   Creates: baseline_ft_vec_<timestamp>.csv
- *   Format: image_path,0.0
- *   Vector size: 1
- *   For Baseline mode, generation and comparison is done by P2.
- *   P1 only takes in directory and writes it to a csv file. This file is passed to P2.
+ *   Format: image_path,B,G,R,B,G,R,...
+ *   Vector size: 147 floats (B, G, R of each pixel in the 7x7 center square)
+ *   P2 -b- scans these vectors directly, so no image is decoded at query time.
  *
  * MODE 2: MULTIPLE HISTOGRAMS (-m-)
  * Extracts custom histogram features from specified image regions.
@@ -59,6 +58,36 @@
  *
  *   Use case: Sunset matching (blue sky top, warm colors bottom)
  *
+ * MODE 3: ANN INDEX (-i-)
+ * Builds an IVF-Flat approximate nearest neighbour index from a DNN embeddings CSV (dnnvec_*.csv format).
+ * The embeddings are clustered into <nlist> inverted lists with k-means. P2 then scans only the lists closest to
+ * the query instead of the whole file.
+ *
+ * Format: ./p1 -i-<metric><nlist> <embeddings_csv>
+ *
+ * Metric codes: i=SSD (L2), o=cosine
+ *
+ * Example:
+ *   ./p1 -i-o1024 dnnvec_all.csv
+ *
+ *   Output file: dnnvec_all_ivf_o1024.ivf (next to the CSV)
+ *   Use with: ./p2 target_embedding.csv -d-o dnnvec_all_ivf_o1024.ivf --nprobe 16
+ *   A good starting point is nlist ~ sqrt(number of images).
+ *
+ * MODE 4: PRODUCT QUANTIZATION (-q-)
+ * Compresses a feature CSV written by -m- into a PQ store: each vector is cut into <M> sub-vectors and every
+ * sub-vector is stored as a one byte code. P2 searches the codes (-c- mode) and re-ranks a shortlist against the
+ * original CSV, so only M bytes per image have to stay in RAM.
+ *
+ * Format: ./p1 -q-<part><histogram><M> <feature_csv>
+ *
+ * Example:
+ *   ./p1 -q-wR64 whole_rgb_multi_histogram_ft_vec_12345.csv
+ *
+ *   Output file: whole_rgb_multi_histogram_ft_vec_12345_pq64.pq (next to the CSV)
+ *   Use with: ./p2 query.jpg -c-i whole_rgb_multi_histogram_ft_vec_12345_pq64.pq
+ *   M must divide the vector length. Part and histogram codes must match the ones the CSV was built with.
+ *
  * FEATURE VECTOR SIZES
  *
  * Default bin counts produce these vector sizes:
@@ -128,12 +157,14 @@
 #include "utils.h"
 #include "csv_util.h"
 #include "mycv_utils.h"
+#include "ivf_index.h"
+#include "pq.h"
 
 
 namespace fs = std::filesystem;
 
 // COnstants used throughout the part 1 of the program are defined here.
-const std::set<char> valid_modes = {'b', 'h', 'm'};
+const std::set<char> valid_modes = {'b', 'h', 'm', 'i', 'q'};
 inline const std::set<std::string> &allowed_img_formats = {".jpg", ".jpeg", ".jpe", ".png", ".webp", ".tiff", ".tif"};
 const std::string op_file_format = ".csv";
 const std::string bsm_op_file_name = "baseline_ft_vec_";
@@ -148,6 +179,7 @@ class P1 {
     std::string mode;
     std::string spec;
     fs::path dir;
+    fs::path csv_file;
     std::vector<fs::path> img_paths;
     std::vector<fs::path> op_files;
 
@@ -172,6 +204,8 @@ class P1 {
      */
     int parse_dir(std::string& arg);
 
+    int parse_csv_file(std::string& arg);
+
     /**
      * Iterates over the files in the directory parsed in {@code parse_mode} function and identifies all the images.
      * Performs the some sanity checks on each file and stores their absolute paths in the class.
@@ -212,6 +246,10 @@ class P1 {
      * @return 0 on success. exits othersie
      */
     int run_mhs();
+
+    int run_ivf();
+
+    int run_pq();
 };
 
 
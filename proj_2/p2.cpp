@@ -12,12 +12,24 @@
 // #include "similarity.h"
 #include "p2.h"
 #include "dist_utils.h"
+#include "server.h"
+#include "batch.h"
 
 namespace fs = std::filesystem;
 
 
 int main(int argc, char *argv[]) {
 	std::cout << "Starting up Program Part 2..." << std::endl;
+	if (argc >= 2 && argv[1] == serve_flag) {
+		std::vector<std::string> args(argv + 2, argv + argc);
+		P2 p2;
+		return p2.serve(args);
+	}
+	if (argc >= 2 && argv[1] == batch_flag) {
+		std::vector<std::string> args(argv + 2, argv + argc);
+		P2 p2;
+		return p2.batch(args);
+	}
 	if (argc < 4) {
 		std::cout << "Incorrect usage!" << std::endl;
 		std::cout << "Correct usage (classic features): ./p2 [path_to_target_img] [distance_metric_type(-m-____)] [file_path_to_feature_vectors] <file_path_to_feature_vectors...>" << std::endl;
@@ -35,6 +47,7 @@ int main(int argc, char *argv[]) {
 
 	int start_index = 3;
 	std::vector<std::string> fi(argv + start_index, argv + argc);
+	p2.parse_options(fi);
 	p2.validate_spec(fi);
 	p2.run();
 	std::cout << "Terminating Program Part 2..." << std::endl;
@@ -85,7 +98,7 @@ int P2::parse_mode(const std::string& arg) {
 	// Mode it = modes.find(md);
 	std::map<char, Mode>::const_iterator it = str_to_mode.find(md);
 	if (it == str_to_mode.end()) {
-		std::cout << "Valid modes are b, m and d" << std::endl;
+		std::cout << "Valid modes are b, m, d and c" << std::endl;
 		std::exit(-1);
 	}
 	this->mode = it->second;
@@ -105,6 +118,123 @@ int P2::parse_mode(const std::string& arg) {
 }
 
 
+/**
+ * Erases a flag and its positive integer value from the arguments.
+ *
+ * @param args command line arguments
+ * @param flag flag to look for
+ * @param val output value (untouched if the flag is absent)
+ * @return 0 if valid, exits otherwise
+ */
+static int take_count_option(std::vector<std::string>& args, const std::string& flag, size_t& val) {
+	std::vector<std::string>::iterator it = std::find(args.begin(), args.end(), flag);
+	if (it == args.end()) {
+		return 0;
+	}
+	if (it + 1 == args.end()) {
+		std::cout << flag << " needs a number." << std::endl;
+		std::exit(-1);
+	}
+	const std::string& s = *(it + 1);
+	if (!parse_count(s, val)) {
+		std::cout << flag << " should be a positive integer: " << s << std::endl;
+		std::exit(-1);
+	}
+	args.erase(it, it + 2);
+	return 0;
+}
+
+
+int P2::parse_options(std::vector<std::string>& args) {
+	take_count_option(args, page_size_flag, this->k);
+	take_count_option(args, nprobe_flag, this->ann.nprobe);
+	take_count_option(args, rerank_flag, this->ann.rerank);
+	std::vector<std::string>::iterator it = std::find(args.begin(), args.end(), verify_flag);
+	if (it != args.end()) {
+		this->ann.verify = true;
+		args.erase(it);
+	}
+	it = std::find(args.begin(), args.end(), no_cache_flag);
+	if (it != args.end()) {
+		this->use_cache = false;
+		args.erase(it);
+	}
+	return 0;
+}
+
+
+int P2::serve(std::vector<std::string>& args) {
+	size_t threads = 0;
+	take_count_option(args, threads_flag, threads);
+	fs::path socket_path;
+	std::vector<std::string>::iterator it = std::find(args.begin(), args.end(), socket_flag);
+	if (it != args.end()) {
+		if (it + 1 == args.end()) {
+			std::cout << socket_flag << " needs a path." << std::endl;
+			std::exit(-1);
+		}
+		socket_path = *(it + 1);
+		args.erase(it, it + 2);
+	}
+	std::set<std::string> csv = {".csv"};
+	for (const std::string& file : args) {
+		if (!check_file(file, csv)) {
+			std::cout << "File " << file << " is not in a valid csv format." << std::endl;
+			std::exit(-1);
+		}
+	}
+	QueryServer server(threads);
+	if (server.preload(args) != 0) {
+		std::exit(-1);
+	}
+	if (socket_path.empty()) {
+		return server.serve_stdin();
+	}
+	if (server.serve_socket(socket_path) != 0) {
+		std::exit(-1);
+	}
+	return 0;
+}
+
+
+int P2::batch(std::vector<std::string>& args) {
+	if (args.size() < 3) {
+		std::cout << "Correct usage (batch): ./p2 --batch [query_csv_or_image_list] [-b-_ / -m-____ / -d-_] [file_path_to_feature_vectors] <...> [--k N] [--out results.csv]" << std::endl;
+		std::exit(-1);
+	}
+	fs::path query_file = fs::absolute(args[0]);
+	if (!fs::is_regular_file(query_file)) {
+		std::cout << "Query file does not exist: " << query_file << std::endl;
+		std::exit(-1);
+	}
+	this->parse_mode(args[1]);
+	if (this->mode == COMPRESSED) {
+		std::cout << "Batch search supports -b-, -m- and -d- with CSV feature files." << std::endl;
+		std::exit(-1);
+	}
+	std::vector<std::string> files(args.begin() + 2, args.end());
+	fs::path op_file;
+	std::vector<std::string>::iterator it = std::find(files.begin(), files.end(), out_flag);
+	if (it != files.end()) {
+		if (it + 1 == files.end()) {
+			std::cout << out_flag << " needs a path." << std::endl;
+			std::exit(-1);
+		}
+		op_file = fs::absolute(*(it + 1));
+		files.erase(it, it + 2);
+	}
+	this->parse_options(files);
+	this->validate_spec(files);
+	if (this->vec_files[0].extension() != op_file_format) {
+		std::cout << "Batch search needs CSV feature files, not an index: " << this->vec_files[0] << std::endl;
+		std::exit(-1);
+	}
+	std::cout << "Distance kernels compiled for: " << kernel_isa_name() << std::endl;
+	Batch batch(query_file, args[1][1], this->spec, this->vec_files, this->k, op_file);
+	return batch.run();
+}
+
+
 int P2::validate_spec(std::vector<std::string>& files) {
 	std::map<Mode, SpecValidatorFunc>::const_iterator it = spec_validators.find(this->mode);
 	if (it == spec_validators.end()) {
@@ -174,10 +304,10 @@ int P2::validate_dnn_spec(std::vector<std::string>& files) {
 		std::cout << "Please provide a single file containing the DNN embeddings." << std::endl;
 		std::exit(-1);
 	}
-	std::set<std::string> csv = {".csv"};
+	std::set<std::string> csv = {".csv", ivf_file_format};
 	bool is_csv = check_file(files[0], csv);
 	if (!is_csv) {
-		std::cout << "File " << files[0] << " is not a valid DNN embeddings in csv format." << std::endl;
+		std::cout << "File " << files[0] << " is not a valid DNN embeddings in csv format (or an index file from ./p1 -i-)." << std::endl;
 		std::exit(-1);
 	}
 	size_t num_of_configs = this->spec.size();
@@ -192,8 +322,28 @@ int P2::validate_dnn_spec(std::vector<std::string>& files) {
 	return 0;
 }
 
+int P2::validate_compressed_spec(std::vector<std::string>& files) {
+	size_t num_files = files.size();
+	if (num_files != 1) {
+		std::cout << "Please provide a single PQ store file (built with ./p1 -q-)." << std::endl;
+		std::exit(-1);
+	}
+	std::set<std::string> pq = {pq_file_format};
+	if (!check_file(files[0], pq)) {
+		std::cout << "File " << files[0] << " is not a PQ store." << std::endl;
+		std::exit(-1);
+	}
+	if (this->spec.size() != 1 || !std::isalpha(this->spec.at(0))) {
+		std::cout << "Specification does not match expected pattern. try -c-i for SSD." << std::endl;
+		std::exit(-1);
+	}
+	this->vec_files.push_back(fs::absolute(files[0]));
+	return 0;
+}
+
 int P2::run() {
 	std::cout << "Parameters passed look correct so far. Starting comparison..." << std::endl;
+	std::cout << "Distance kernels compiled for: " << kernel_isa_name() << std::endl;
 	std::map<Mode, RunnerFunc>::const_iterator it = runners.find(this->mode);
 	if (it == runners.end()) {
 		std::cout << "No runner found." << std::endl;
@@ -203,24 +353,15 @@ int P2::run() {
 }
 
 
-int P2::run_basic() {
-	std::cout << "BASIC RUNNING" << std::endl;
-	std::cout << "Target: " << this->tgt_path << std::endl;
-	std::cout << "Spec: " << this->spec << std::endl;
-	std::cout << "Files: ";
-	for (const auto& f : this->vec_files) {
-		std::cout << f.filename() << " ";
-	}
-	std::cout << std::endl;
-
-	Basic basic(this->tgt_path, this->spec, this->vec_files, this->neighbours);
-	basic.calculate_basic();
-	int counter = 0;
-	std::cout << "Printing out the images in decreasing order of similarity. \nProgram will print first five images by default. \nPress 'q' after that to terminate the program." << std::endl;
+int P2::page_results(const NextPageFunc& next_page) {
+	std::cout << "Printing out the images in decreasing order of similarity. \nProgram will print first " << this->k << " images by default. \nPress 'q' after that to terminate the program." << std::endl;
 	std::cout << std::endl;
-	std::cout << "Size of neighbour (in P2 file) = " << this->neighbours.size() << std::endl;
-	for (const std::pair<double, fs::path>& p : this->neighbours) {
-		if (counter >= top_n) {
+	size_t counter = 0;
+	while (true) {
+		if (counter == this->neighbours.size() && next_page() == 0) {
+			break;
+		}
+		if (counter >= this->k) {
 			std::cout <<"Want to see the next image? Press 'n'. \nIf you want to exit, press 'q'." << std::endl;
 			char inp;
 			std::cin >> inp;
@@ -228,13 +369,30 @@ int P2::run_basic() {
 				break;
 			}
 		}
+		const std::pair<double, fs::path>& p = this->neighbours[counter];
 		counter++;
-		std::cout << counter << ". " << p.second << " ---\t--- " << p.first << std::endl;
+		std::cout << counter << ". " << p.second << " ---\t--- " << std::setprecision(10) << p.first << std::endl;
 	}
 	return 0;
 }
 
 
+int P2::run_basic() {
+	std::cout << "BASIC RUNNING" << std::endl;
+	std::cout << "Target: " << this->tgt_path << std::endl;
+	std::cout << "Spec: " << this->spec << std::endl;
+	std::cout << "Files: ";
+	for (const auto& f : this->vec_files) {
+		std::cout << f.filename() << " ";
+	}
+	std::cout << std::endl;
+
+	Basic basic(this->tgt_path, this->spec, this->vec_files, this->neighbours, this->k);
+	basic.calculate_basic();
+	return page_results([&basic] () {return basic.next_page();});
+}
+
+
 int P2::run_classic() {
 	std::cout << "CLASSIC RUNNING" << std::endl;
 	std::cout << "Target: " << this->tgt_path << std::endl;
@@ -244,24 +402,9 @@ int P2::run_classic() {
 		std::cout << f.filename() << " ";
 	}
 	std::cout << std::endl;
-	Distance dist(this->tgt_path, this->spec, this->vec_files, this->neighbours);
+	Distance dist(this->tgt_path, this->spec, this->vec_files, this->neighbours, this->k, this->use_cache);
 	dist.calculate_classic();
-
-	int counter = 0;
-	std::cout << "Printing out the images in decreasing order of similarity. \nProgram will print first five images by default. \nPress 'q' after that to terminate the program." << std::endl;
-	for (const std::pair<double, fs::path>& p : this->neighbours) {
-		if (counter >= top_n) {
-			std::cout <<"Want to see the next image? Press 'n'. \nIf you want to exit, press 'q'." << std::endl;
-			char inp;
-			std::cin >> inp;
-			if (inp == 'q') {
-				break;
-			}
-		}
-		counter++;
-		std::cout << counter << ". "  << p.second << " ---\t--- " << std::setprecision(10) << p.first << std::endl;
-	}
-	return 0;
+	return page_results([&dist] () {return dist.next_page();});
 }
 
 int P2::run_dne() {
@@ -273,25 +416,23 @@ int P2::run_dne() {
 		std::cout << f.filename() << " ";
 	}
 	std::cout << std::endl;
-	MyDNN mydnn(this->tgt_path, this->spec, this->vec_files, this->neighbours);
+	MyDNN mydnn(this->tgt_path, this->spec, this->vec_files, this->neighbours, this->k, this->ann);
 	mydnn.calculate_dnn();
+	return page_results([&mydnn] () {return mydnn.next_page();});
+}
 
-	int counter = 0;
-	std::cout << "Printing out the images in decreasing order of similarity. \nProgram will print first five images by default. \nPress 'q' after that to terminate the program." << std::endl;
-	std::cout << std::endl;
-	for (const std::pair<double, fs::path>& p : this->neighbours) {
-		if (counter >= top_n) {
-			std::cout <<"Want to see the next image? Press 'n'. \nIf you want to exit, press 'q'." << std::endl;
-			char inp;
-			std::cin >> inp;
-			if (inp == 'q') {
-				break;
-			}
-		}
-		counter++;
-		std::cout << counter << ". " << p.second << " ---\t--- " << std::setprecision(10) << p.first << std::endl;
+int P2::run_compressed() {
+	std::cout << "COMPRESSED RUNNING" << std::endl;
+	std::cout << "Target: " << this->tgt_path << std::endl;
+	std::cout << "Spec: " << this->spec << std::endl;
+	std::cout << "Files: ";
+	for (const auto& f : this->vec_files) {
+		std::cout << f.filename() << " ";
 	}
-	return 0;
+	std::cout << std::endl;
+	Compressed comp(this->tgt_path, this->spec, this->vec_files, this->neighbours, this->k, this->ann);
+	comp.calculate_compressed();
+	return page_results([&comp] () {return comp.next_page();});
 }
 
 
@@ -21,7 +21,7 @@
  *   - query.jpg: target image to match
  *   - -b-: BASIC mode flag
  *   - i: SSD distance metric
- *   - baseline_ft_vec_12345.csv: CSV with 7x7 square vectors from P1
+ *   - baseline_ft_vec_12345.csv: CSV with 7x7 square vectors from P1 (147 floats per image)
  *
  * Output: Top N images ranked by similarity to query.jpg
  *
@@ -93,11 +93,27 @@
  * Target CSV format:
  *   target_image.jpg,0.123,0.456,0.789,...,0.321
  *
+ * The embeddings CSV can be replaced by an IVF index built with ./p1 -i-<metric><nlist> (see p1.h):
+ *   ./p2 target_embedding.csv -d-o dnnvec_all_ivf_o1024.ivf --nprobe 16 --verify
+ *   --nprobe N   number of inverted lists scanned (more = higher recall, slower)
+ *   --verify     also run an exact scan and print recall@K and both latencies
+ *
  * Common metrics for DNN:
  *   o (cosine): Most common for deep learning embeddings
  *   O (correlation): Good for semantic similarity
  *   i (SSD): Direct distance in embedding space
  *
+ * MODE 4: COMPRESSED (-c-)
+ * Searches a product-quantized feature store built by ./p1 -q- (see p1.h). The part and histogram are read from
+ * the store. Only SSD is supported.
+ *
+ * Format: ./p2 <target_image> -c-i <pq_store>
+ *
+ * Example:
+ *   ./p2 query.jpg -c-i whole_rgb_multi_histogram_ft_vec_12345_pq64.pq --rerank 20 --verify
+ *   --rerank N   shortlist of N x K images re-scored against the original CSV (default 10)
+ *   --verify     also scan the original CSV and print recall@K of the codes and of the re-ranked results
+ *
  * GENERAL NOTES
  *
  * All modes return results sorted by distance (lower = more similar).
@@ -111,6 +127,46 @@
  * Weights in CLASSIC mode are automatically normalized (don't need to sum to any value).
  *
  * Interactive output: Shows top 5 automatically, then prompts for more.
+ *
+ * Page size can be changed with --k anywhere after the mode flag:
+ *   ./p2 dog.jpg -m-wri1 whole_rg_*.csv --k 20
+ * Only one page is ranked at a time; the next page is selected when the user asks for more, so the full
+ * database is never sorted.
+ *
+ * CLASSIC mode keeps a query cache in .p2_cache under the working directory. Running the same target with the same
+ * spec and unchanged feature files serves the saved ranking without loading anything, and target histograms are
+ * reused when only the weights or metrics change. Re-running p1 on a feature file invalidates its entries.
+ * --no-cache bypasses the cache; deleting .p2_cache clears it.
+ *
+ * BATCH MODE (--batch)
+ * Runs many queries against the same feature files in one tiled pass over the database and writes every result
+ * list to one CSV (query, rank, image, distance). Supports -b-, -m- and -d- with CSV feature files.
+ *
+ * Format: ./p2 --batch <queries> -<mode>-<spec> <csv> ... [--k N] [--out <results.csv>]
+ *
+ * Where:
+ *   <queries>  a CSV of precomputed vectors (name + vector per line, e.g. a dnnvec_*.csv file; single-part specs)
+ *              or a text file with one target image path per line (-b- and -m-)
+ *   --k        results per query (default 5)
+ *   --out      results file (default batch_results_<timestamp>.csv in the working directory)
+ *
+ * Example:
+ *   ./p2 --batch eval_images.txt -m-wri2wSO1 whole_rg_*.csv whole_sobel_*.csv --k 20 --out eval.csv
+ *   ./p2 --batch dnnvec_queries.csv -d-o dnnvec_all.csv --k 10
+ *
+ * SERVER MODE (--serve)
+ * Keeps feature CSVs in memory and answers JSON queries, one per line, until stopped (protocol in server.h).
+ *
+ * Format: ./p2 --serve [--socket <path>] [--threads N] [<csv> ...]
+ *
+ * Example:
+ *   ./p2 --serve --socket /tmp/cbir.sock whole_rg_*.csv whole_sobel_*.csv
+ *   echo '{"id": 1, "spec": "-m-wri1", "files": ["whole_rg.csv"], "target": "dog.jpg", "k": 10}' | ./p2 --serve
+ *
+ * Where:
+ *   --socket   Unix domain socket to listen on; without it requests are read from stdin and answered on stdout
+ *   --threads  worker threads answering queries (default: one per hardware thread)
+ *   <csv>      feature files loaded at startup; any other file is loaded the first time a query names it
  */
 
 #ifndef P2_H
@@ -138,6 +194,7 @@ namespace fs = std::filesystem;
 typedef std::function<int()> RunnerFunc;                                              // Executes matching algorithm
 typedef std::function<int(std::vector<std::string>& files)> SpecValidatorFunc;        // Validates specification string
 typedef std::function<int(const std::string&)> TargetPathValidatorFunc;               // Validates target file path
+typedef std::function<size_t()> NextPageFunc;                                         // Appends next page of results
 
 /**
  * Operating modes for the matching program.
@@ -145,7 +202,8 @@ typedef std::function<int(const std::string&)> TargetPathValidatorFunc;
 enum Mode {
     BASIC,    // b - baseline 7x7 square matching
     CLASSIC,  // m - multiple histogram matching with custom features
-    DNN       // d - deep neural network embedding matching
+    DNN,      // d - deep neural network embedding matching
+    COMPRESSED  // c - product-quantized feature store with exact re-ranking
 };
 
 /**
@@ -156,9 +214,20 @@ const std::map<char, Mode> str_to_mode = {
     {'b', BASIC},
     {'m', CLASSIC},
     {'d', DNN},
+    {'c', COMPRESSED},
 };
 
 const int top_n = 5;  // Default number of top matches to display before prompting user
+const std::string page_size_flag = "--k";  // Command line flag overriding top_n
+const std::string nprobe_flag = "--nprobe";  // Command line flag setting the lists scanned in an IVF index
+const std::string verify_flag = "--verify";  // Command line flag reporting recall@K of an IVF index / PQ search
+const std::string rerank_flag = "--rerank";  // Command line flag setting the PQ shortlist multiple
+const std::string serve_flag = "--serve";  // First argument starting the query server instead of a single search
+const std::string socket_flag = "--socket";  // Server flag: listen on this Unix domain socket instead of stdin
+const std::string threads_flag = "--threads";  // Server flag: number of worker threads
+const std::string batch_flag = "--batch";  // First argument starting a batch search over a list of queries
+const std::string out_flag = "--out";  // Batch flag: results file
+const std::string no_cache_flag = "--no-cache";  // Command line flag bypassing the query cache (-m- only)
 
 // Allowed image file extensions for target images
 inline const std::set<std::string>& allowed_img_formats = {".jpg", ".jpeg", ".jpe", ".png", ".webp", ".tiff", ".tif", ""};
@@ -175,13 +244,49 @@ class P2 {
         Mode mode;                                            // Operating mode (BASIC, CLASSIC, or DNN)
         std::string spec;                                     // Specification string from command line
         std::vector<fs::path> vec_files;                      // Paths to feature vector CSV files
-        std::vector<std::pair<double, fs::path>> neighbours;  // Results: (distance, image_path) pairs
+        SearchResults neighbours;                             // Results shown so far: (distance, image_path) pairs
+        size_t k;                                             // Page size (number of results ranked at a time)
+        AnnOptions ann;                                       // Index search settings for DNN and COMPRESSED modes
+        bool use_cache;                                       // Read and write the query cache in CLASSIC mode
+
+        /**
+         * Prints results page by page. The first page is printed directly, after that the user is prompted
+         * before every image and a new page is requested once the current one has been shown.
+         *
+         * @param next_page appends the next page of results to neighbours
+         * @return 0 if successful
+         */
+        int page_results(const NextPageFunc& next_page);
 
     public:
         /**
          * Default constructor. Initializes mode to CLASSIC.
          */
-        P2() {mode = CLASSIC;}
+        P2() {mode = CLASSIC; k = top_n; use_cache = true;}
+
+        /**
+         * Removes the optional flags (--k N, --nprobe N, --rerank N, --verify, --no-cache) from the command line arguments.
+         *
+         * @param args command line arguments after the mode flag; flags and their values are erased
+         * @return 0 if valid, exits otherwise
+         */
+        int parse_options(std::vector<std::string>& args);
+
+        /**
+         * Runs the query server (--serve) until stdin is closed or the process is stopped.
+         *
+         * @param args command line arguments after --serve (--socket, --threads and feature CSVs to preload)
+         * @return 0 if successful, exits otherwise
+         */
+        int serve(std::vector<std::string>& args);
+
+        /**
+         * Runs a batch search (--batch) and writes all results to one file.
+         *
+         * @param args command line arguments after --batch (query file, mode flag, feature files, options)
+         * @return 0 if successful, exits otherwise
+         */
+        int batch(std::vector<std::string>& args);
 
         /**
          * Validates target path for CLASSIC mode.
@@ -246,6 +351,15 @@ class P2 {
          */
         int validate_dnn_spec(std::vector<std::string>& files);
 
+        /**
+         * Validates specification for COMPRESSED mode.
+         * Expects single character (distance metric) and a single PQ store file.
+         *
+         * @param files vector of feature file paths
+         * @return 0 if valid, exits otherwise
+         */
+        int validate_compressed_spec(std::vector<std::string>& files);
+
         /**
          * Dispatches to appropriate spec validator based on current mode.
          *
@@ -277,6 +391,14 @@ class P2 {
          */
         int run_dne();
 
+        /**
+         * Executes matching against a product-quantized feature store.
+         * Creates Compressed object which handles ADC search and re-ranking.
+         *
+         * @return 0 if successful
+         */
+        int run_compressed();
+
         /**
          * Dispatches to appropriate runner based on current mode.
          * Displays results with interactive prompting.
@@ -292,7 +414,8 @@ class P2 {
         const std::map<Mode, RunnerFunc> runners = {
             {BASIC, [this] () {return run_basic();}},
             {CLASSIC, [this] () {return run_classic();} },
-            {DNN, [this] () {return run_dne();} }
+            {DNN, [this] () {return run_dne();} },
+            {COMPRESSED, [this] () {return run_compressed();} }
         };
 
         /**
@@ -301,7 +424,8 @@ class P2 {
         const std::map<Mode, SpecValidatorFunc> spec_validators = {
             {BASIC, [this] (auto& p) {return validate_basic_spec(p);}},
             {CLASSIC, [this] (auto& p) {return validate_classic_spec(p);}},
-            {DNN, [this] (auto& p) {return validate_dnn_spec(p);}}
+            {DNN, [this] (auto& p) {return validate_dnn_spec(p);}},
+            {COMPRESSED, [this] (auto& p) {return validate_compressed_spec(p);}}
         };
 
         /**
@@ -310,7 +434,8 @@ class P2 {
         const std::map<Mode, TargetPathValidatorFunc> target_path_validators = {
             {BASIC, [this] (const std::string& arg) {return validate_tgt_path_classic(arg);}},
             {CLASSIC, [this] (const std::string& arg) {return validate_tgt_path_classic(arg);}},
-            {DNN, [this] (const std::string& arg) {return validate_tgt_path_dnn(arg);}}
+            {DNN, [this] (const std::string& arg) {return validate_tgt_path_dnn(arg);}},
+            {COMPRESSED, [this] (const std::string& arg) {return validate_tgt_path_classic(arg);}}
         };
 };
 
@@ -0,0 +1,339 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Product quantization: codebook training, encoding, store file IO and ADC search with exact re-ranking.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+#include "pq.h"
+#include "csv_util.h"
+#include "dist_kernels.h"
+#include "kmeans.h"
+#include "mycv_utils.h"
+
+namespace {
+
+const size_t encode_batch = 4096;   // Most rows read from the CSV and encoded together
+
+/**
+ * Copies columns [m * dsub, (m + 1) * dsub) of a rows x dims block into a contiguous rows x dsub block.
+ */
+void extract_subspace(const std::vector<float>& block, size_t rows, size_t dims, size_t m, size_t dsub, std::vector<float>& sub) {
+    sub.resize(rows * dsub);
+    for (size_t i = 0; i < rows; i++) {
+        std::memcpy(sub.data() + i * dsub, block.data() + i * dims + m * dsub, dsub * sizeof(float));
+    }
+}
+
+/**
+ * Reads the given CSV rows into a rows x dims block.
+ */
+int read_rows(FILE* fp, const std::vector<long>& offsets, const std::vector<size_t>& which, size_t dims, std::vector<float>& block, std::vector<std::string>* names) {
+    char img_file[256];
+    std::vector<float> v;
+    block.resize(which.size() * dims);
+    for (size_t i = 0; i < which.size(); i++) {
+        if (read_image_data_csv_row(fp, offsets[which[i]], img_file, v) != 0 || v.size() != dims) {
+            std::cout << "Row " << which[i] << " of the feature file could not be read or has the wrong length." << std::endl;
+            return -1;
+        }
+        std::memcpy(block.data() + i * dims, v.data(), dims * sizeof(float));
+        if (names != nullptr) {
+            names->push_back(img_file);
+        }
+    }
+    return 0;
+}
+
+}  // namespace
+
+
+int build_pq_store(const fs::path& csv_path, char part, char hist, size_t m, const fs::path& op_path) {
+    std::vector<long> offsets;
+    if (index_image_data_csv(csv_path.string().c_str(), offsets) != 0 || offsets.empty()) {
+        std::cout << "Unable to read feature file: " << csv_path << std::endl;
+        return -1;
+    }
+    FILE* fp = fopen(csv_path.string().c_str(), "r");
+    if (!fp) {
+        std::cout << "Unable to open feature file: " << csv_path << std::endl;
+        return -1;
+    }
+    char img_file[256];
+    std::vector<float> first;
+    if (read_image_data_csv_row(fp, offsets[0], img_file, first) != 0 || feature_version_key != img_file
+        || first.size() != 1 || static_cast<int>(first[0]) != feature_version) {
+        std::cout << "Feature file was not written by this version of p1 (expected feature version " << feature_version
+                  << "). Regenerate it with ./p1 -m-: " << csv_path << std::endl;
+        fclose(fp);
+        return -1;
+    }
+    offsets.erase(offsets.begin());  // the version row
+    size_t rows = offsets.size();
+    if (rows == 0 || read_image_data_csv_row(fp, offsets[0], img_file, first) != 0 || first.empty()) {
+        std::cout << "Unable to read the first row of the feature file: " << csv_path << std::endl;
+        fclose(fp);
+        return -1;
+    }
+    size_t dims = first.size();
+    if (m == 0 || dims % m != 0) {
+        std::cout << "Number of sub-spaces (" << m << ") must divide the vector length (" << dims << ")." << std::endl;
+        fclose(fp);
+        return -1;
+    }
+    size_t dsub = dims / m;
+    size_t block_rows = std::max<size_t>(1, pq_block_bytes / (dims * sizeof(float)));
+    size_t train_rows = std::min({rows, pq_train_rows, std::max(pq_max_ksub, block_rows)});
+    size_t ksub = std::min(pq_max_ksub, train_rows);
+    size_t batch_rows = std::min(encode_batch, block_rows);
+
+    // Training sample.
+    std::vector<size_t> order(rows);
+    for (size_t i = 0; i < rows; i++) {
+        order[i] = i;
+    }
+    std::mt19937 rng(kmeans_seed);
+    std::shuffle(order.begin(), order.end(), rng);
+    order.resize(train_rows);
+    std::sort(order.begin(), order.end());
+    std::vector<float> train;
+    if (read_rows(fp, offsets, order, dims, train, nullptr) != 0) {
+        fclose(fp);
+        return -1;
+    }
+    std::cout << "Training " << m << " codebooks of " << ksub << " centroids on " << order.size() << " rows..." << std::endl;
+    std::vector<float> codebooks(m * ksub * dsub);
+    std::vector<float> sub;
+    std::vector<float> cb;
+    for (size_t s = 0; s < m; s++) {
+        extract_subspace(train, order.size(), dims, s, dsub, sub);
+        if (kmeans_train(sub.data(), order.size(), dsub, ksub, order.size(), false, cb) != 0) {
+            std::cout << "Unable to train codebook " << s << "." << std::endl;
+            fclose(fp);
+            return -1;
+        }
+        std::copy(cb.begin(), cb.end(), codebooks.begin() + s * ksub * dsub);
+    }
+
+    // Encode every row, a batch at a time.
+    std::vector<uint8_t> codes(rows * m);
+    std::vector<std::string> img_names;
+    img_names.reserve(rows);
+    std::vector<float> block;
+    std::vector<size_t> which;
+    std::vector<uint32_t> assign;
+    for (size_t begin = 0; begin < rows; begin += batch_rows) {
+        size_t end = std::min(rows, begin + batch_rows);
+        which.clear();
+        for (size_t i = begin; i < end; i++) {
+            which.push_back(i);
+        }
+        if (read_rows(fp, offsets, which, dims, block, &img_names) != 0) {
+            fclose(fp);
+            return -1;
+        }
+        for (size_t s = 0; s < m; s++) {
+            extract_subspace(block, which.size(), dims, s, dsub, sub);
+            cb.assign(codebooks.begin() + s * ksub * dsub, codebooks.begin() + (s + 1) * ksub * dsub);
+            kmeans_assign(sub.data(), which.size(), dsub, cb, ksub, assign);
+            for (size_t i = 0; i < which.size(); i++) {
+                codes[(begin + i) * m + s] = static_cast<uint8_t>(assign[i]);
+            }
+        }
+    }
+    fclose(fp);
+
+    std::vector<uint64_t> row_offsets(offsets.begin(), offsets.end());
+    std::vector<uint64_t> name_offsets(rows);
+    uint64_t names_bytes = 0;
+    for (size_t i = 0; i < rows; i++) {
+        name_offsets[i] = names_bytes;
+        names_bytes += img_names[i].size() + 1;
+    }
+    std::string source = fs::absolute(csv_path).string();
+
+    PqHeader header{};
+    std::memcpy(header.magic, pq_magic, sizeof(pq_magic));
+    header.version = pq_version;
+    header.dims = static_cast<uint32_t>(dims);
+    header.m = static_cast<uint32_t>(m);
+    header.ksub = static_cast<uint32_t>(ksub);
+    header.part = part;
+    header.hist = hist;
+    header.feature_version = static_cast<uint16_t>(feature_version);
+    header.rows = rows;
+    header.names_bytes = names_bytes;
+    header.source_bytes = source.size() + 1;
+
+    std::ofstream op(op_path, std::ios::binary);
+    if (!op) {
+        std::cout << "Unable to open PQ store for writing: " << op_path << std::endl;
+        return -1;
+    }
+    op.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    op.write(reinterpret_cast<const char*>(row_offsets.data()), rows * sizeof(uint64_t));
+    op.write(reinterpret_cast<const char*>(name_offsets.data()), rows * sizeof(uint64_t));
+    op.write(reinterpret_cast<const char*>(codebooks.data()), codebooks.size() * sizeof(float));
+    op.write(reinterpret_cast<const char*>(codes.data()), codes.size());
+    for (const std::string& n : img_names) {
+        op.write(n.c_str(), n.size() + 1);
+    }
+    op.write(source.c_str(), source.size() + 1);
+    if (!op) {
+        std::cout << "Error writing PQ store: " << op_path << std::endl;
+        return -1;
+    }
+    std::cout << "Compressed " << rows << " x " << dims << " floats to " << m << " bytes per image." << std::endl;
+    return 0;
+}
+
+
+int PqStore::open(const fs::path& path) {
+    std::ifstream ip(path, std::ios::binary);
+    if (!ip || !ip.read(reinterpret_cast<char*>(&this->header), sizeof(PqHeader))) {
+        std::cout << "Unable to read PQ store: " << path << std::endl;
+        return -1;
+    }
+    const PqHeader& h = this->header;
+    if (std::memcmp(h.magic, pq_magic, sizeof(pq_magic)) != 0 || h.version != pq_version) {
+        std::cout << "Not a PQ store (or built by a different version): " << path << std::endl;
+        return -1;
+    }
+    if (h.feature_version != feature_version) {
+        std::cout << "PQ store was built from features of a different version of p1. Regenerate the feature file with"
+                  << " ./p1 -m- and rebuild the store with ./p1 -q-: " << path << std::endl;
+        return -1;
+    }
+    if (h.m == 0 || h.dims % h.m != 0 || h.ksub == 0 || h.ksub > pq_max_ksub) {
+        std::cout << "PQ store is truncated or corrupt: " << path << std::endl;
+        return -1;
+    }
+    std::error_code ec;
+    uintmax_t file_bytes = fs::file_size(path, ec);
+    size_t dsub = h.dims / h.m;
+    // Every term is bounded by the file size before anything is multiplied or allocated.
+    if (ec || h.rows > file_bytes / (2 * sizeof(uint64_t)) || (h.rows != 0 && h.m > file_bytes / h.rows)
+        || h.names_bytes > file_bytes || h.source_bytes > file_bytes
+        || sizeof(PqHeader) + h.rows * 2 * sizeof(uint64_t) + static_cast<uintmax_t>(h.m) * h.ksub * dsub * sizeof(float)
+           + h.rows * h.m + h.names_bytes + h.source_bytes != file_bytes) {
+        std::cout << "PQ store is truncated or corrupt: " << path << std::endl;
+        return -1;
+    }
+    this->row_offsets.resize(h.rows);
+    this->name_offsets.resize(h.rows);
+    this->codebooks.resize(static_cast<size_t>(h.m) * h.ksub * dsub);
+    this->codes.resize(h.rows * h.m);
+    this->names.resize(h.names_bytes);
+    std::vector<char> src(h.source_bytes);
+    ip.read(reinterpret_cast<char*>(this->row_offsets.data()), h.rows * sizeof(uint64_t));
+    ip.read(reinterpret_cast<char*>(this->name_offsets.data()), h.rows * sizeof(uint64_t));
+    ip.read(reinterpret_cast<char*>(this->codebooks.data()), this->codebooks.size() * sizeof(float));
+    ip.read(reinterpret_cast<char*>(this->codes.data()), this->codes.size());
+    ip.read(this->names.data(), this->names.size());
+    ip.read(src.data(), src.size());
+    if (!ip || src.empty() || src.back() != '\0') {
+        std::cout << "PQ store is truncated or corrupt: " << path << std::endl;
+        return -1;
+    }
+    this->source = fs::path(src.data());
+    return 0;
+}
+
+void PqStore::build_lut(const std::vector<float>& query, std::vector<float>& lut) const {
+    size_t m = this->header.m;
+    size_t ksub = this->header.ksub;
+    size_t dsub = this->header.dims / m;
+    lut.resize(m * ksub);
+    for (size_t s = 0; s < m; s++) {
+        const float* q = query.data() + s * dsub;
+        const float* cb = this->codebooks.data() + s * ksub * dsub;
+        for (size_t j = 0; j < ksub; j++) {
+            lut[s * ksub + j] = static_cast<float>(kernel_sum_sq_diff(q, cb + j * dsub, dsub));
+        }
+    }
+}
+
+int PqStore::search_adc(const std::vector<float>& query, size_t k, std::vector<ScoredRow>& out) const {
+    if (query.size() != this->dims()) {
+        std::cout << "Query has " << query.size() << " values but the PQ store has " << this->dims() << std::endl;
+        return -1;
+    }
+    size_t m = this->header.m;
+    size_t ksub = this->header.ksub;
+    std::vector<float> lut;
+    this->build_lut(query, lut);
+    TopK top(k);
+    double scale = 1.0 / this->dims();
+    for (size_t r = 0; r < this->rows(); r++) {
+        const uint8_t* c = this->codes.data() + r * m;
+        float d = 0.0f;
+        for (size_t s = 0; s < m; s++) {
+            d += lut[s * ksub + c[s]];
+        }
+        top.push(d * scale, r);
+    }
+    out = top.sorted();
+    return 0;
+}
+
+int PqStore::search(const std::vector<float>& query, size_t k, size_t rerank, std::vector<ScoredRow>& out) const {
+    // Shortlist of rerank x k rows, saturated at the store size so large counts cannot wrap around
+    rerank = std::max<size_t>(1, rerank);
+    size_t n = this->rows();
+    size_t shortlist_rows = k > n / rerank ? n : std::min(n, k * rerank);
+    std::vector<ScoredRow> shortlist;
+    if (this->search_adc(query, shortlist_rows, shortlist) != 0) {
+        return -1;
+    }
+    // Read the shortlist in file order so the disk sees a forward scan.
+    std::ranges::sort(shortlist, [this](const ScoredRow& a, const ScoredRow& b) {
+        return this->row_offsets[a.row] < this->row_offsets[b.row];
+    });
+    FILE* fp = fopen(this->source.string().c_str(), "r");
+    if (!fp) {
+        std::cout << "Unable to open source feature file for re-ranking: " << this->source << std::endl;
+        return -1;
+    }
+    char img_file[256];
+    std::vector<float> v;
+    TopK top(k);
+    for (const ScoredRow& s : shortlist) {
+        if (read_image_data_csv_row(fp, this->row_offsets[s.row], img_file, v) != 0 || v.size() != this->dims()) {
+            std::cout << "Source feature file changed since the PQ store was built: " << this->source << std::endl;
+            fclose(fp);
+            return -1;
+        }
+        top.push(kernel_sum_sq_diff(query.data(), v.data(), v.size()) / v.size(), s.row);
+    }
+    fclose(fp);
+    out = top.sorted();
+    return 0;
+}
+
+int PqStore::search_exact(const std::vector<float>& query, size_t k, std::vector<ScoredRow>& out) const {
+    FILE* fp = fopen(this->source.string().c_str(), "r");
+    if (!fp) {
+        std::cout << "Unable to open source feature file: " << this->source << std::endl;
+        return -1;
+    }
+    char img_file[256];
+    std::vector<float> v;
+    TopK top(k);
+    for (size_t r = 0; r < this->rows(); r++) {
+        if (read_image_data_csv_row(fp, this->row_offsets[r], img_file, v) != 0 || v.size() != query.size()) {
+            std::cout << "Source feature file changed since the PQ store was built: " << this->source << std::endl;
+            fclose(fp);
+            return -1;
+        }
+        top.push(kernel_sum_sq_diff(query.data(), v.data(), v.size()) / v.size(), r);
+    }
+    fclose(fp);
+    out = top.sorted();
+    return 0;
+}
@@ -0,0 +1,139 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Header file for pq.cpp. Product-quantized feature store for large histograms (e.g. the 32768 bin RGB histogram).
+// Every vector is split into M sub-vectors and each sub-vector is replaced by the index of its nearest centroid
+// in a 256 entry codebook, so an image costs M bytes in RAM instead of dims floats. Queries use asymmetric distance
+// computation (exact query against quantized database) through per-query lookup tables. A shortlist is then
+// re-ranked with the original vectors, which are read back from the source CSV by byte offset.
+//
+
+#ifndef PQ_H
+#define PQ_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "topk.h"
+
+namespace fs = std::filesystem;
+
+const char pq_magic[4] = {'P', 'Q', 'F', 'S'};     // First four bytes of every PQ store
+const uint32_t pq_version = 1;                      // Bumped whenever the file layout changes
+const std::string pq_file_format = ".pq";            // Extension of PQ store files
+const size_t pq_max_ksub = 256;                     // Centroids per sub-space (codes are one byte)
+const size_t pq_train_rows = 16384;                 // Most rows sampled from the CSV to train the codebooks
+const size_t pq_block_bytes = 256 << 20;            // Largest block of vectors held while training or encoding
+const size_t pq_default_rerank = 10;                // Shortlist = rerank x K rows re-scored exactly
+
+/**
+ * Fixed-size header at the start of a PQ store. Arrays follow in this order:
+ *   row_offsets   rows x uint64        byte offset of each row in the source CSV
+ *   name_offsets  rows x uint64        offset of each image name in the names block
+ *   codebooks     m x ksub x dsub float
+ *   codes         rows x m uint8
+ *   names         names_bytes chars    NUL terminated image names
+ *   source        source_bytes chars   path of the source CSV (NUL terminated)
+ */
+struct PqHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t dims;         // Length of the original vectors
+    uint32_t m;            // Number of sub-spaces
+    uint32_t ksub;         // Centroids per sub-space
+    char part;             // Part code the features were computed on (p1 spec character)
+    char hist;             // Histogram code (p1 spec character)
+    uint16_t feature_version;  // feature_version of the p1 that wrote the source CSV
+    uint64_t rows;
+    uint64_t names_bytes;
+    uint64_t source_bytes;
+};
+
+/**
+ * Trains codebooks on a sample of a feature CSV, encodes every row and writes a PQ store.
+ * The CSV is streamed row by row. The training sample and every encoding batch are capped at pq_block_bytes of
+ * vectors (2048 rows of a 32768 bin histogram), so peak memory is about pq_block_bytes plus m bytes and the name of
+ * every image.
+ *
+ * @param csv_path feature CSV written by p1 -m-
+ * @param part part code of the features
+ * @param hist histogram code of the features
+ * @param m number of sub-spaces (must divide the vector length)
+ * @param op_path output store file
+ * @return 0 if successful, -1 otherwise
+ */
+int build_pq_store(const fs::path& csv_path, char part, char hist, size_t m, const fs::path& op_path);
+
+/**
+ * A PQ store loaded into memory. Only codes, codebooks and names are resident; original vectors stay in the CSV.
+ */
+class PqStore {
+private:
+    PqHeader header;
+    std::vector<uint64_t> row_offsets;    // Byte offset of each row in the source CSV
+    std::vector<uint64_t> name_offsets;   // Offset of each image name in names
+    std::vector<float> codebooks;         // m x ksub x dsub
+    std::vector<uint8_t> codes;           // rows x m
+    std::vector<char> names;              // NUL terminated image names
+    fs::path source;                      // Source CSV used for re-ranking
+
+    /**
+     * Fills the m x ksub lookup table of squared distances between the query sub-vectors and every centroid.
+     */
+    void build_lut(const std::vector<float>& query, std::vector<float>& lut) const;
+
+public:
+    /**
+     * Loads a store file.
+     *
+     * @param path store file
+     * @return 0 if successful, -1 otherwise
+     */
+    int open(const fs::path& path);
+
+    size_t rows() const { return this->header.rows; }
+    size_t dims() const { return this->header.dims; }
+    char part() const { return this->header.part; }
+    char hist() const { return this->header.hist; }
+
+    /**
+     * Image name of a row.
+     */
+    const char* name(size_t row) const { return this->names.data() + this->name_offsets[row]; }
+
+    /**
+     * Approximate SSD search over the codes only (asymmetric distance, sum of m table lookups per row).
+     *
+     * @param query query vector (dims values)
+     * @param k number of results
+     * @param out output rows, best first; distances are SSD / dims like compute_ssd
+     * @return 0 if successful, -1 if the query length does not match
+     */
+    int search_adc(const std::vector<float>& query, size_t k, std::vector<ScoredRow>& out) const;
+
+    /**
+     * ADC search for a shortlist of rerank x k rows followed by exact SSD against the original vectors.
+     *
+     * @param query query vector (dims values)
+     * @param k number of results
+     * @param rerank shortlist size as a multiple of k
+     * @param out output rows, best first, with exact distances
+     * @return 0 if successful, -1 otherwise
+     */
+    int search(const std::vector<float>& query, size_t k, size_t rerank, std::vector<ScoredRow>& out) const;
+
+    /**
+     * Exact SSD search by streaming the whole source CSV. Used to report recall loss.
+     *
+     * @param query query vector (dims values)
+     * @param k number of results
+     * @param out output rows, best first
+     * @return 0 if successful, -1 otherwise
+     */
+    int search_exact(const std::vector<float>& query, size_t k, std::vector<ScoredRow>& out) const;
+};
+
+#endif //PQ_H
@@ -0,0 +1,232 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Persistent cache of p2 query results and target histograms.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <unistd.h>
+
+#include "query_cache.h"
+
+namespace {
+
+template <typename T>
+void put(std::string& s, const T& v) {
+    s.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+/**
+ * Reads values back out of a payload, failing on anything truncated.
+ */
+class Reader {
+private:
+    const std::string& s;
+    size_t pos = 0;
+
+public:
+    explicit Reader(const std::string& s) : s(s) {}
+
+    template <typename T>
+    bool get(T& v) {
+        if (this->pos + sizeof(T) > this->s.size()) {
+            return false;
+        }
+        std::memcpy(&v, this->s.data() + this->pos, sizeof(T));
+        this->pos += sizeof(T);
+        return true;
+    }
+
+    bool get_bytes(size_t n, std::string& out) {
+        if (this->pos + n > this->s.size()) {
+            return false;
+        }
+        out.assign(this->s, this->pos, n);
+        this->pos += n;
+        return true;
+    }
+
+    bool done() const { return this->pos == this->s.size(); }
+};
+
+std::string hex(uint64_t h) {
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+    return buf;
+}
+
+}  // namespace
+
+
+uint64_t fnv1a(const void* data, size_t n, uint64_t h) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+int hash_file(const fs::path& path, std::string& out) {
+    std::ifstream ip(path, std::ios::binary);
+    if (!ip) {
+        return -1;
+    }
+    uint64_t h = fnv1a(nullptr, 0);
+    std::vector<char> buf(1 << 16);
+    while (ip) {
+        ip.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+        h = fnv1a(buf.data(), static_cast<size_t>(ip.gcount()), h);
+    }
+    if (ip.bad()) {
+        return -1;
+    }
+    out = hex(h);
+    return 0;
+}
+
+std::string store_version(const fs::path& path) {
+    std::error_code ec;
+    fs::path abs = fs::absolute(path, ec);
+    uintmax_t size = fs::file_size(path, ec);
+    if (ec) {
+        return "";
+    }
+    fs::file_time_type mtime = fs::last_write_time(path, ec);
+    if (ec) {
+        return "";
+    }
+    std::stringstream ss;
+    ss << abs.string() << ":" << size << ":" << mtime.time_since_epoch().count();
+    return ss.str();
+}
+
+
+QueryCache::QueryCache(bool enabled, const fs::path& dir) : dir(dir), on(enabled) {}
+
+fs::path QueryCache::entry(const std::string& key) const {
+    return this->dir / (hex(fnv1a(key.data(), key.size())) + ".bin");
+}
+
+bool QueryCache::read(const std::string& key, std::string& payload) const {
+    if (!this->on) {
+        return false;
+    }
+    std::ifstream ip(this->entry(key), std::ios::binary);
+    if (!ip) {
+        return false;
+    }
+    std::stringstream ss;
+    ss << ip.rdbuf();
+    std::string data = ss.str();
+    Reader r(data);
+    std::string magic;
+    std::string stored_key;
+    uint32_t key_len = 0;
+    if (!r.get_bytes(cache_magic.size(), magic) || magic != cache_magic || !r.get(key_len)
+        || !r.get_bytes(key_len, stored_key) || stored_key != key) {
+        return false;  // Another layout or a hash collision
+    }
+    size_t header = cache_magic.size() + sizeof(key_len) + key_len;
+    payload.assign(data, header, std::string::npos);
+    return true;
+}
+
+int QueryCache::write(const std::string& key, const std::string& payload) const {
+    if (!this->on) {
+        return 0;
+    }
+    std::error_code ec;
+    fs::create_directories(this->dir, ec);
+    if (ec) {
+        return -1;
+    }
+    fs::path target = this->entry(key);
+    fs::path tmp = target;
+    tmp += ".tmp" + std::to_string(::getpid());
+    {
+        std::ofstream op(tmp, std::ios::binary | std::ios::trunc);
+        uint32_t key_len = static_cast<uint32_t>(key.size());
+        op.write(cache_magic.data(), static_cast<std::streamsize>(cache_magic.size()));
+        op.write(reinterpret_cast<const char*>(&key_len), sizeof(key_len));
+        op.write(key.data(), static_cast<std::streamsize>(key.size()));
+        op.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        if (!op) {
+            fs::remove(tmp, ec);
+            return -1;
+        }
+    }
+    fs::rename(tmp, target, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return -1;
+    }
+    return 0;
+}
+
+bool QueryCache::load_ranking(const std::string& key, CachedRanking& out) const {
+    std::string payload;
+    if (!this->read(key, payload)) {
+        return false;
+    }
+    Reader r(payload);
+    uint64_t total = 0;
+    uint64_t count = 0;
+    if (!r.get(total) || !r.get(count)) {
+        return false;
+    }
+    CachedRanking ranking;
+    ranking.total = total;
+    for (uint64_t i = 0; i < count; i++) {
+        double dist = 0.0;
+        uint32_t len = 0;
+        std::string name;
+        if (!r.get(dist) || !r.get(len) || !r.get_bytes(len, name)) {
+            return false;
+        }
+        ranking.rows.emplace_back(dist, std::move(name));
+    }
+    if (!r.done()) {
+        return false;
+    }
+    out = std::move(ranking);
+    return true;
+}
+
+int QueryCache::save_ranking(const std::string& key, const CachedRanking& ranking) const {
+    std::string payload;
+    put(payload, static_cast<uint64_t>(ranking.total));
+    put(payload, static_cast<uint64_t>(ranking.rows.size()));
+    for (const std::pair<double, std::string>& row : ranking.rows) {
+        put(payload, row.first);
+        put(payload, static_cast<uint32_t>(row.second.size()));
+        payload += row.second;
+    }
+    return this->write(key, payload);
+}
+
+bool QueryCache::load_histogram(const std::string& key, std::vector<float>& out) const {
+    std::string payload;
+    if (!this->read(key, payload)) {
+        return false;
+    }
+    Reader r(payload);
+    uint64_t n = 0;
+    if (!r.get(n) || payload.size() != sizeof(n) + n * sizeof(float)) {
+        return false;
+    }
+    out.resize(n);
+    std::memcpy(out.data(), payload.data() + sizeof(n), n * sizeof(float));
+    return true;
+}
+
+int QueryCache::save_histogram(const std::string& key, const std::vector<float>& hist) const {
+    std::string payload;
+    put(payload, static_cast<uint64_t>(hist.size()));
+    payload.append(reinterpret_cast<const char*>(hist.data()), hist.size() * sizeof(float));
+    return this->write(key, payload);
+}
@@ -0,0 +1,132 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Header file for query_cache.cpp. Persistent cache of p2 query results and target histograms.
+// Entries live in cache_dir_name under the working directory, one file per entry, named by a hash of the key.
+// Keys name the target by a hash of its file contents and the feature files by path, size and modification time,
+// so re-running p1 on a feature store changes the key and old entries are simply never read again. Deleting the
+// directory is always safe.
+//
+
+#ifndef QUERY_CACHE_H
+#define QUERY_CACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+const std::string cache_dir_name = ".p2_cache";  // Cache directory, relative to the working directory
+const std::string cache_magic = "P2C1";          // First bytes of every entry (bump when the layout changes)
+
+/**
+ * A ranking saved by a previous run: the best images found and the size of the database they were picked from.
+ */
+struct CachedRanking {
+    size_t total = 0;                                        // Number of images in the database
+    std::vector<std::pair<double, std::string>> rows;        // (distance, image), best first
+};
+
+/**
+ * 64-bit FNV-1a hash.
+ *
+ * @param data bytes to hash
+ * @param n number of bytes
+ * @param h running hash (chain calls by passing the previous result)
+ * @return hash
+ */
+uint64_t fnv1a(const void* data, size_t n, uint64_t h = 0xcbf29ce484222325ULL);
+
+/**
+ * Hashes the contents of a file.
+ *
+ * @param path file to hash
+ * @param out hash as 16 hex digits
+ * @return 0 if successful, -1 if the file cannot be read
+ */
+int hash_file(const fs::path& path, std::string& out);
+
+/**
+ * Identifies the current contents of a feature file without reading it: absolute path, size and modification time.
+ *
+ * @param path feature file
+ * @return version string (empty if the file cannot be inspected)
+ */
+std::string store_version(const fs::path& path);
+
+/**
+ * Reads and writes cache entries. Writes go to a temporary file that is renamed into place, so concurrent runs
+ * never see half-written entries. Every failure is treated as a miss; the cache never stops a search.
+ */
+class QueryCache {
+private:
+    fs::path dir;                                 // Cache directory
+    bool on;                                      // False when caching is disabled
+
+    /**
+     * Path of the entry for a key.
+     */
+    fs::path entry(const std::string& key) const;
+
+    /**
+     * Reads an entry and checks that it belongs to key.
+     *
+     * @param key entry key
+     * @param payload output, everything after the header
+     * @return true on a hit
+     */
+    bool read(const std::string& key, std::string& payload) const;
+
+    /**
+     * Writes an entry.
+     *
+     * @param key entry key
+     * @param payload entry contents
+     * @return 0 if successful
+     */
+    int write(const std::string& key, const std::string& payload) const;
+
+public:
+    /**
+     * Constructor for QueryCache.
+     *
+     * @param enabled false to turn every lookup into a miss and every store into a no-op
+     * @param dir cache directory
+     */
+    explicit QueryCache(bool enabled, const fs::path& dir = cache_dir_name);
+
+    bool enabled() const { return this->on; }
+
+    /**
+     * @param key ranking key
+     * @param out output ranking
+     * @return true on a hit
+     */
+    bool load_ranking(const std::string& key, CachedRanking& out) const;
+
+    /**
+     * @param key ranking key
+     * @param ranking ranking to save
+     * @return 0 if successful
+     */
+    int save_ranking(const std::string& key, const CachedRanking& ranking) const;
+
+    /**
+     * @param key histogram key
+     * @param out output histogram
+     * @return true on a hit
+     */
+    bool load_histogram(const std::string& key, std::vector<float>& out) const;
+
+    /**
+     * @param key histogram key
+     * @param hist histogram to save
+     * @return 0 if successful
+     */
+    int save_histogram(const std::string& key, const std::vector<float>& hist) const;
+};
+
+#endif //QUERY_CACHE_H
@@ -0,0 +1,759 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Query server for p2: resident feature stores, JSON line protocol over stdin or a Unix domain socket and a
+// worker pool answering queries concurrently.
+//
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "dist_utils.h"
+#include "p2.h"
+
+namespace cr = std::chrono;
+
+namespace {
+
+const std::string part_codes = "wtTlLaAbBcC";     // Part characters accepted in a -m- spec
+const std::string hist_codes = "BrRhusSgG";       // Histogram characters accepted in a -m- spec
+const std::string metric_codes = "iIqQoOyYpP";    // Metric characters accepted in any spec
+const int json_max_depth = 32;                    // Deepest nesting accepted in a request
+
+/**
+ * Parsed JSON value. Only what the request format needs: objects keep their fields in order, numbers keep their
+ * source text so that ids can be echoed back unchanged.
+ */
+struct JsonValue {
+    enum Kind {NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT};
+    Kind kind = NUL;
+    bool boolean = false;
+    double number = 0.0;
+    std::string text;                                          // String value, or the number as written
+    std::vector<JsonValue> items;                              // Array elements
+    std::vector<std::pair<std::string, JsonValue>> fields;     // Object members
+
+    const JsonValue* find(const std::string& key) const {
+        for (const std::pair<std::string, JsonValue>& f : this->fields) {
+            if (f.first == key) {
+                return &f.second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+/**
+ * Recursive descent JSON parser over one request line.
+ */
+class JsonParser {
+private:
+    const std::string& s;
+    size_t pos;
+
+    void skip_ws() {
+        while (this->pos < this->s.size() && std::isspace(static_cast<unsigned char>(this->s[this->pos]))) {
+            this->pos++;
+        }
+    }
+
+    bool literal(const char* word) {
+        size_t n = std::strlen(word);
+        if (this->s.compare(this->pos, n, word) != 0) {
+            return false;
+        }
+        this->pos += n;
+        return true;
+    }
+
+    static void append_utf8(std::string& out, unsigned cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool hex4(unsigned& cp) {
+        if (this->pos + 4 > this->s.size()) {
+            return false;
+        }
+        cp = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = this->s[this->pos++];
+            cp <<= 4;
+            if (c >= '0' && c <= '9') cp |= c - '0';
+            else if (c >= 'a' && c <= 'f') cp |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') cp |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    bool string(std::string& out) {
+        this->pos++;  // opening quote
+        out.clear();
+        while (this->pos < this->s.size()) {
+            char c = this->s[this->pos++];
+            if (c == '"') {
+                return true;
+            }
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (this->pos >= this->s.size()) {
+                return false;
+            }
+            char e = this->s[this->pos++];
+            switch (e) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned cp;
+                    if (!this->hex4(cp)) {
+                        return false;
+                    }
+                    if (cp >= 0xD800 && cp < 0xDC00 && this->literal("\\u")) {
+                        unsigned lo;
+                        if (!this->hex4(lo) || lo < 0xDC00 || lo >= 0xE000) {
+                            return false;
+                        }
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    }
+                    append_utf8(out, cp);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    bool value(JsonValue& v, int depth) {
+        if (depth > json_max_depth) {
+            return false;
+        }
+        this->skip_ws();
+        if (this->pos >= this->s.size()) {
+            return false;
+        }
+        char c = this->s[this->pos];
+        if (c == '{') {
+            v.kind = JsonValue::OBJECT;
+            this->pos++;
+            this->skip_ws();
+            if (this->pos < this->s.size() && this->s[this->pos] == '}') {
+                this->pos++;
+                return true;
+            }
+            while (true) {
+                this->skip_ws();
+                if (this->pos >= this->s.size() || this->s[this->pos] != '"') {
+                    return false;
+                }
+                std::pair<std::string, JsonValue> field;
+                if (!this->string(field.first)) {
+                    return false;
+                }
+                this->skip_ws();
+                if (this->pos >= this->s.size() || this->s[this->pos] != ':') {
+                    return false;
+                }
+                this->pos++;
+                if (!this->value(field.second, depth + 1)) {
+                    return false;
+                }
+                v.fields.push_back(std::move(field));
+                this->skip_ws();
+                if (this->pos < this->s.size() && this->s[this->pos] == ',') {
+                    this->pos++;
+                    continue;
+                }
+                if (this->pos < this->s.size() && this->s[this->pos] == '}') {
+                    this->pos++;
+                    return true;
+                }
+                return false;
+            }
+        }
+        if (c == '[') {
+            v.kind = JsonValue::ARRAY;
+            this->pos++;
+            this->skip_ws();
+            if (this->pos < this->s.size() && this->s[this->pos] == ']') {
+                this->pos++;
+                return true;
+            }
+            while (true) {
+                v.items.emplace_back();
+                if (!this->value(v.items.back(), depth + 1)) {
+                    return false;
+                }
+                this->skip_ws();
+                if (this->pos < this->s.size() && this->s[this->pos] == ',') {
+                    this->pos++;
+                    continue;
+                }
+                if (this->pos < this->s.size() && this->s[this->pos] == ']') {
+                    this->pos++;
+                    return true;
+                }
+                return false;
+            }
+        }
+        if (c == '"') {
+            v.kind = JsonValue::STRING;
+            return this->string(v.text);
+        }
+        if (this->literal("true")) {
+            v.kind = JsonValue::BOOLEAN;
+            v.boolean = true;
+            return true;
+        }
+        if (this->literal("false")) {
+            v.kind = JsonValue::BOOLEAN;
+            return true;
+        }
+        if (this->literal("null")) {
+            return true;
+        }
+        const char* begin = this->s.c_str() + this->pos;
+        char* end = nullptr;
+        v.number = std::strtod(begin, &end);
+        if (end == begin) {
+            return false;
+        }
+        v.kind = JsonValue::NUMBER;
+        v.text.assign(begin, end - begin);
+        this->pos += end - begin;
+        return true;
+    }
+
+public:
+    explicit JsonParser(const std::string& s) : s(s), pos(0) {}
+
+    /**
+     * Parses the whole line as one value.
+     */
+    bool parse(JsonValue& v) {
+        if (!this->value(v, 0)) {
+            return false;
+        }
+        this->skip_ws();
+        return this->pos == this->s.size();
+    }
+};
+
+/**
+ * Quotes and escapes a string for a JSON response.
+ */
+std::string json_quote(const std::string& in) {
+    std::string out = "\"";
+    for (char c : in) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+/**
+ * Fixed pool of worker threads taking jobs from a queue. The destructor finishes every queued job before joining.
+ */
+class WorkQueue {
+private:
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<std::function<void()>> jobs;
+    bool stopping;
+    std::vector<std::thread> workers;
+
+    void work() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> guard(this->lock);
+                this->ready.wait(guard, [this]() {return this->stopping || !this->jobs.empty();});
+                if (this->jobs.empty()) {
+                    return;
+                }
+                job = std::move(this->jobs.front());
+                this->jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+public:
+    explicit WorkQueue(size_t n) : stopping(false) {
+        for (size_t i = 0; i < n; i++) {
+            this->workers.emplace_back([this]() {this->work();});
+        }
+    }
+
+    ~WorkQueue() {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->stopping = true;
+        }
+        this->ready.notify_all();
+        for (std::thread& t : this->workers) {
+            t.join();
+        }
+    }
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->jobs.push_back(std::move(job));
+        }
+        this->ready.notify_one();
+    }
+};
+
+/**
+ * One client connection (or stdout in stdin mode). The descriptor is closed once the reader and every pending
+ * response are done with it.
+ */
+struct Client {
+    int fd;
+    std::mutex write_lock;    // Responses from different workers must not interleave
+
+    explicit Client(int fd) : fd(fd) {}
+    ~Client() { ::close(this->fd); }
+
+    void send_line(const std::string& line) {
+        std::string out = line + "\n";
+        std::lock_guard<std::mutex> guard(this->write_lock);
+        size_t sent = 0;
+        while (sent < out.size()) {
+            ssize_t n = ::write(this->fd, out.data() + sent, out.size() - sent);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                return;  // client went away
+            }
+            sent += n;
+        }
+    }
+};
+
+bool has_code(const std::string& codes, char c) {
+    return codes.find(c) != std::string::npos;
+}
+
+}  // namespace
+
+
+const FeatureStore* StoreCache::get(const fs::path& path, std::string& err) {
+    fs::path key = fs::absolute(path);
+    std::lock_guard<std::mutex> guard(this->lock);
+    std::map<fs::path, std::unique_ptr<FeatureStore>>::iterator it = this->stores.find(key);
+    if (it != this->stores.end()) {
+        return it->second.get();
+    }
+    std::unique_ptr<FeatureStore> store = std::make_unique<FeatureStore>();
+    std::vector<std::vector<float>> vecs;
+    bool read = fs::is_regular_file(key) && read_image_data_csv(key.string().c_str(), store->names, vecs) == 0;
+    if (read) {
+        store->version = take_feature_version(store->names, vecs);
+    }
+    if (!read || vecs.empty() || build_feature_matrix(vecs, store->matrix) != 0) {
+        err = "Unable to read file containing feature vectors: " + key.string();
+        return nullptr;
+    }
+    std::cout << "Loaded " << store->matrix.rows << " x " << store->matrix.dims << " features from " << key << std::endl;
+    const FeatureStore* loaded = store.get();
+    this->stores.emplace(key, std::move(store));
+    return loaded;
+}
+
+
+QueryServer::QueryServer(size_t threads) : threads(threads) {
+    if (this->threads == 0) {
+        this->threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+int QueryServer::preload(const std::vector<std::string>& files) {
+    int ret = 0;
+    for (const std::string& f : files) {
+        std::string err;
+        if (this->stores.get(f, err) == nullptr) {
+            std::cout << err << std::endl;
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+int QueryServer::run_query(const std::string& spec, const std::vector<std::string>& files, const std::string& target,
+                           const std::vector<float>* vector, size_t k, std::string& results, std::string& err) {
+    if (spec.size() < 4 || spec[0] != '-' || spec[2] != '-') {
+        err = "spec should look like a p2 mode flag, e.g. -m-wri1";
+        return -1;
+    }
+    char mode = spec[1];
+    std::string body = spec.substr(3);
+    if (mode != 'b' && mode != 'm' && mode != 'd') {
+        err = "only -b-, -m- and -d- queries are served";
+        return -1;
+    }
+    size_t num_parts = mode == 'm' ? body.size() / config_size : 1;
+    if ((mode == 'm' && body.size() % config_size != 0) || (mode != 'm' && body.size() != 1) || num_parts == 0) {
+        err = "Specification does not match expected pattern.";
+        return -1;
+    }
+    if (files.size() != num_parts) {
+        err = "Number of configs does not match number of files.";
+        return -1;
+    }
+    if (vector != nullptr && num_parts != 1) {
+        err = "a precomputed vector can only be sent with a single-part spec";
+        return -1;
+    }
+    if (vector == nullptr && target.empty()) {
+        err = "either target or vector is required";
+        return -1;
+    }
+
+    std::vector<const FeatureStore*> part_stores(num_parts);
+    std::vector<std::vector<float>> targets(num_parts);
+    std::vector<DistanceQuery> queries;
+    std::vector<double> weights(num_parts, 1.0);
+    queries.reserve(num_parts);
+    ImagePlanes planes(target);  // Decoded at most once, shared by every part
+    double total_weight = 0.0;
+    for (size_t p = 0; p < num_parts; p++) {
+        const char* cfg = body.c_str() + p * config_size;
+        char metric_code = mode == 'm' ? cfg[2] : body[0];
+        if (!has_code(metric_codes, metric_code)) {
+            err = std::string("Unknown distance metric: ") + metric_code;
+            return -1;
+        }
+        if (mode == 'm' && (!has_code(part_codes, cfg[0]) || !has_code(hist_codes, cfg[1]) || !std::isdigit(static_cast<unsigned char>(cfg[3])))) {
+            err = "Specification does not match expected pattern.";
+            return -1;
+        }
+        part_stores[p] = this->stores.get(files[p], err);
+        if (part_stores[p] == nullptr) {
+            return -1;
+        }
+        const FeatureMatrix& fm = part_stores[p]->matrix;
+        HistogramType hist = HistogramType::BASIC_BOX;
+        std::string part_name = "W";
+        if (mode == 'm') {
+            hist = parse_hist_type(cfg[1]);
+            part_name = parse_part_name(cfg[0]);
+            weights[p] = cfg[3] - '0';
+        }
+        if (mode == 'm' && part_stores[p]->version != feature_version) {
+            err = "feature file was written by a different version of p1, regenerate it with ./p1 -m-: " + files[p];
+            return -1;
+        }
+        if (mode == 'b' && fm.dims != static_cast<size_t>(basic_box_vector_size)) {
+            err = "feature file has no precomputed vectors, re-run ./p1 -b-: " + files[p];
+            return -1;
+        }
+        total_weight += weights[p];
+
+        if (vector != nullptr) {
+            targets[p] = *vector;
+        } else if (mode == 'd') {
+            std::vector<char*> tgt_imgs;
+            std::vector<std::vector<float>> tgt_vecs;
+            if (read_image_data_csv(target.c_str(), tgt_imgs, tgt_vecs) != 0 || tgt_vecs.empty()) {
+                err = "Unable to read Target file containing feature vectors: " + target;
+                return -1;
+            }
+            targets[p] = tgt_vecs[0];
+        } else if (compute_histogram(planes, targets[p], hist, part_name) != 0) {
+            err = "Error computing histogram for target image: " + target;
+            return -1;
+        }
+        if (targets[p].size() != fm.dims) {
+            err = "Target vector does not match the feature file: " + files[p];
+            return -1;
+        }
+        DistanceMetric metric = parse_distance_metric(metric_code);
+        EmdShape shape = mode == 'm' ? emd_shape_for(hist, fm.dims) : EmdShape();
+        queries.emplace_back(targets[p], metric, shape);
+    }
+    if (total_weight <= 0.0) {
+        err = "at least one part needs a non-zero weight";
+        return -1;
+    }
+
+    size_t rows = part_stores[0]->matrix.rows;
+    for (size_t p = 1; p < num_parts; p++) {
+        if (part_stores[p] == part_stores[0]) {
+            continue;
+        }
+        if (part_stores[p]->matrix.rows != rows) {
+            err = "Not all configs have the same number of images!";
+            return -1;
+        }
+        for (size_t i = 0; i < rows; i++) {
+            if (std::strcmp(part_stores[p]->names[i], part_stores[0]->names[i]) != 0) {
+                err = "Image order mismatch at index " + std::to_string(i);
+                return -1;
+            }
+        }
+    }
+
+    std::vector<WeightedPart> parts;
+    for (size_t p = 0; p < num_parts; p++) {
+        parts.push_back({&queries[p], &part_stores[p]->matrix, weights[p] / total_weight});
+    }
+    order_parts_by_cost(parts);
+    std::vector<ScoredRow> best;
+    PruneStats stats;
+    pruned_search(parts, rows, std::min(k, rows), best, stats);
+
+    std::ostringstream os;
+    os << std::setprecision(10) << "[";
+    for (size_t i = 0; i < best.size(); i++) {
+        fs::path img(part_stores[0]->names[best[i].row]);
+        if (mode == 'b') {
+            img = fs::absolute(img);  // as printed by ./p2 -b-
+        }
+        os << (i ? ", " : "") << "{\"path\": " << json_quote(img.string()) << ", \"distance\": ";
+        if (std::isfinite(best[i].dist)) {
+            os << best[i].dist;
+        } else {
+            os << "null";
+        }
+        os << "}";
+    }
+    os << "]";
+    results = os.str();
+    return 0;
+}
+
+std::string QueryServer::answer(const std::string& line) {
+    cr::steady_clock::time_point t0 = cr::steady_clock::now();
+    JsonValue req;
+    std::string id = "null";
+    std::string err;
+    std::string results;
+    if (!JsonParser(line).parse(req) || req.kind != JsonValue::OBJECT) {
+        err = "request is not a JSON object";
+    } else {
+        const JsonValue* v = req.find("id");
+        if (v != nullptr && v->kind == JsonValue::STRING) {
+            id = json_quote(v->text);
+        } else if (v != nullptr && v->kind == JsonValue::NUMBER) {
+            id = v->text;
+        }
+        const JsonValue* spec = req.find("spec");
+        const JsonValue* files = req.find("files");
+        const JsonValue* target = req.find("target");
+        const JsonValue* vec = req.find("vector");
+        const JsonValue* k = req.find("k");
+        std::vector<std::string> file_list;
+        std::vector<float> values;
+        size_t top = top_n;
+        if (spec == nullptr || spec->kind != JsonValue::STRING) {
+            err = "spec (string) is required";
+        } else if (files == nullptr || files->kind != JsonValue::ARRAY) {
+            err = "files (array of feature CSVs) is required";
+        } else if (target != nullptr && target->kind != JsonValue::STRING) {
+            err = "target should be a path";
+        } else if (vec != nullptr && vec->kind != JsonValue::ARRAY) {
+            err = "vector should be an array of numbers";
+        } else if (k != nullptr && (k->kind != JsonValue::NUMBER || k->number < 1 || k->number != std::floor(k->number)
+                                      || k->number > static_cast<double>(serve_max_k))) {
+            err = "k should be a positive integer no larger than " + std::to_string(serve_max_k);
+        }
+        if (err.empty()) {
+            for (const JsonValue& f : files->items) {
+                if (f.kind != JsonValue::STRING) {
+                    err = "files should be an array of paths";
+                    break;
+                }
+                file_list.push_back(f.text);
+            }
+            if (vec != nullptr) {
+                for (const JsonValue& x : vec->items) {
+                    if (x.kind != JsonValue::NUMBER) {
+                        err = "vector should be an array of numbers";
+                        break;
+                    }
+                    values.push_back(static_cast<float>(x.number));
+                }
+            }
+            if (k != nullptr) {
+                top = static_cast<size_t>(k->number);
+            }
+        }
+        if (err.empty()) {
+            this->run_query(spec->text, file_list, target == nullptr ? std::string() : target->text,
+                            vec == nullptr ? nullptr : &values, top, results, err);
+        }
+    }
+    std::ostringstream os;
+    os << "{\"id\": " << id;
+    if (!err.empty()) {
+        os << ", \"ok\": false, \"error\": " << json_quote(err) << "}";
+        return os.str();
+    }
+    double ms = cr::duration<double, std::milli>(cr::steady_clock::now() - t0).count();
+    os << ", \"ok\": true, \"ms\": " << std::setprecision(4) << ms << ", \"results\": " << results << "}";
+    return os.str();
+}
+
+std::string QueryServer::respond(const std::string& line) noexcept {
+    std::string err;
+    try {
+        return this->answer(line);
+    } catch (const std::exception& e) {
+        err = e.what();
+    } catch (...) {
+        err = "unknown error";
+    }
+    try {
+        return "{\"id\": null, \"ok\": false, \"error\": " + json_quote("internal error: " + err) + "}";
+    } catch (...) {
+        return "{\"id\": null, \"ok\": false, \"error\": \"internal error\"}";
+    }
+}
+
+int QueryServer::serve_stdin() {
+    // Responses go to the real stdout; fd 1 (printf in csv_util as well as std::cout) is pointed at stderr.
+    std::cout.flush();
+    std::fflush(stdout);
+    int json_fd = ::dup(STDOUT_FILENO);
+    if (json_fd < 0 || ::dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        std::cout << "Unable to redirect stdout: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    std::shared_ptr<Client> out = std::make_shared<Client>(json_fd);
+    std::cout << "Serving JSON queries on stdin with " << this->threads << " worker threads." << std::endl;
+    {
+        WorkQueue pool(this->threads);
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                continue;
+            }
+            pool.submit([this, line, out]() {out->send_line(this->respond(line));});
+        }
+    }  // pool answers everything still queued before it is destroyed
+    return 0;
+}
+
+int QueryServer::serve_socket(const fs::path& path) {
+    std::string p = path.string();
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (p.size() >= sizeof(addr.sun_path)) {
+        std::cout << "Socket path is too long: " << path << std::endl;
+        return -1;
+    }
+    std::memcpy(addr.sun_path, p.c_str(), p.size() + 1);
+    std::error_code ec;
+    if (fs::is_socket(path, ec)) {
+        ::unlink(p.c_str());  // left behind by a previous server
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, serve_socket_backlog) != 0) {
+        std::cout << "Unable to listen on socket " << path << ": " << std::strerror(errno) << std::endl;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return -1;
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+    std::cout << "Serving JSON queries on " << path << " with " << this->threads << " worker threads." << std::endl;
+
+    WorkQueue pool(this->threads);
+    while (true) {
+        int c = ::accept(fd, nullptr, nullptr);
+        if (c < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            std::cout << "accept failed on " << path << ": " << std::strerror(errno) << std::endl;
+            std::exit(-1);
+        }
+        std::shared_ptr<Client> client = std::make_shared<Client>(c);
+        std::thread([this, client, &pool]() {
+            std::string buf;
+            char chunk[65536];
+            while (true) {
+                ssize_t n = ::read(client->fd, chunk, sizeof(chunk));
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    return;
+                }
+                buf.append(chunk, n);
+                size_t start = 0;
+                size_t nl;
+                while ((nl = buf.find('\n', start)) != std::string::npos) {
+                    std::string line = buf.substr(start, nl - start);
+                    start = nl + 1;
+                    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                        continue;
+                    }
+                    pool.submit([this, client, line]() {client->send_line(this->respond(line));});
+                }
+                buf.erase(0, start);
+                if (buf.size() > serve_max_request_bytes) {
+                    client->send_line("{\"id\": null, \"ok\": false, \"error\": \"request too long\"}");
+                    return;
+                }
+            }
+        }).detach();
+    }
+}
@@ -0,0 +1,132 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Header file for server.cpp. Long-running query server for p2 (./p2 --serve).
+// Feature CSVs are parsed once and stay resident, so a query only pays for the target histograms and the scan.
+// Requests and responses are JSON objects, one per line, read from stdin or from clients of a Unix domain socket.
+// Queries are answered concurrently on a fixed pool of worker threads.
+//
+// Request:
+//   {"id": 7, "spec": "-m-wri2wSO1", "files": ["whole_rg.csv", "whole_sobel.csv"], "target": "dog.jpg", "k": 10}
+//   "spec" and "files" are the mode flag and feature files of a normal p2 command line (-b-, -m- and -d- with
+//   CSV files). "target" is the target image (the target CSV for -d-). A single-part query can send the
+//   precomputed target vector instead: "vector": [0.1, 0.2, ...]. "k" defaults to top_n, may be at most
+//   serve_max_k and is capped at the number of images. "id" is echoed back.
+// Response:
+//   {"id": 7, "ok": true, "ms": 3.1, "results": [{"path": "img1.jpg", "distance": 0.12}, ...]}
+//   {"id": 7, "ok": false, "error": "..."}
+// Responses to different requests may come back out of order; match them by id.
+//
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "dist_kernels.h"
+
+namespace fs = std::filesystem;
+
+const size_t serve_max_request_bytes = 64 << 20;  // Longest request line accepted (a 32768 bin vector is ~0.5 MB)
+const int serve_socket_backlog = 64;              // Pending connections queued by listen()
+const size_t serve_max_k = 1000000;               // Largest k a request may ask for (clamped to the images anyway)
+
+/**
+ * A feature CSV held in memory.
+ */
+struct FeatureStore {
+    std::vector<char*> names;                     // Image name of every row (as read from the CSV)
+    int version = 0;                              // feature_version of a p1 -m- file, 0 if the file has none
+    FeatureMatrix matrix;                         // Feature vectors, one row per image
+};
+
+/**
+ * Feature CSVs loaded on first use and kept for the life of the server. Stores are never modified after loading,
+ * so any number of queries can scan them at once.
+ */
+class StoreCache {
+private:
+    std::mutex lock;                                              // Guards stores
+    std::map<fs::path, std::unique_ptr<FeatureStore>> stores;     // Keyed by absolute path
+
+public:
+    /**
+     * Returns the store for a CSV, loading it the first time it is asked for.
+     *
+     * @param path feature CSV
+     * @param err error message if the file cannot be loaded
+     * @return the store, or nullptr on error
+     */
+    const FeatureStore* get(const fs::path& path, std::string& err);
+};
+
+/**
+ * Answers JSON line queries against resident feature stores.
+ */
+class QueryServer {
+private:
+    StoreCache stores;                            // Resident feature CSVs
+    size_t threads;                               // Worker threads answering queries
+
+    /**
+     * Runs the search described by a parsed request.
+     */
+    int run_query(const std::string& spec, const std::vector<std::string>& files, const std::string& target,
+                  const std::vector<float>* vector, size_t k, std::string& results, std::string& err);
+
+public:
+    /**
+     * @param threads number of worker threads (0 = one per hardware thread)
+     */
+    explicit QueryServer(size_t threads);
+
+    /**
+     * Loads feature CSVs up front so that the first queries do not pay for parsing them.
+     *
+     * @param files feature CSVs
+     * @return 0 if every file loaded, -1 otherwise
+     */
+    int preload(const std::vector<std::string>& files);
+
+    /**
+     * Answers one request. Safe to call from several threads.
+     *
+     * @param line request (one JSON object)
+     * @return response (one JSON object, no trailing newline)
+     */
+    std::string answer(const std::string& line);
+
+    /**
+     * Answers one request on a worker thread. Anything answer() throws (std::exception, cv::Exception) becomes an
+     * error response, so a bad request never takes the server down.
+     *
+     * @param line request (one JSON object)
+     * @return response (one JSON object, no trailing newline)
+     */
+    std::string respond(const std::string& line) noexcept;
+
+    /**
+     * Reads requests from stdin and writes responses to stdout until stdin is closed. Everything else the
+     * program prints is sent to stderr while serving, so stdout carries responses only.
+     *
+     * @return 0 once every request has been answered
+     */
+    int serve_stdin();
+
+    /**
+     * Listens on a Unix domain socket and answers requests from any number of clients until the process is
+     * stopped. Each client sends request lines and receives response lines on the same connection.
+     *
+     * @param path socket path (a stale socket file is replaced)
+     * @return -1 if the socket cannot be set up, does not return otherwise
+     */
+    int serve_socket(const fs::path& path);
+};
+
+#endif //SERVER_H
@@ -0,0 +1,180 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// NUMA node discovery and the shard worker pool.
+//
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "shard_pool.h"
+
+namespace fs = std::filesystem;
+
+/**
+ * Parses a sysfs CPU list such as "0-15,32-47".
+ */
+static std::vector<int> parse_cpu_list(const std::string& text) {
+    std::vector<int> cpus;
+    std::stringstream ss(text);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        size_t dash = range.find('-');
+        try {
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int c = first; c <= last; c++) {
+                cpus.push_back(c);
+            }
+        } catch (const std::exception&) {
+            return {};
+        }
+    }
+    return cpus;
+}
+
+/**
+ * CPUs this process may run on, so that pinning never leaves a cgroup or taskset restriction. Empty if unknown.
+ */
+static std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+            if (CPU_ISSET(c, &set)) {
+                cpus.push_back(c);
+            }
+        }
+    }
+#endif
+    return cpus;
+}
+
+std::vector<NumaNode> numa_nodes() {
+    std::vector<NumaNode> nodes;
+#ifdef __linux__
+    std::vector<int> allowed = allowed_cpus();
+    std::error_code ec;
+    for (const fs::directory_entry& e : fs::directory_iterator("/sys/devices/system/node", ec)) {
+        std::string name = e.path().filename().string();
+        if (name.rfind("node", 0) != 0 || name.size() == 4 || !std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+            continue;
+        }
+        std::ifstream ip(e.path() / "cpulist");
+        std::string text;
+        std::getline(ip, text);
+        NumaNode node{std::stoi(name.substr(4)), {}};
+        for (int c : parse_cpu_list(text)) {
+            if (allowed.empty() || std::binary_search(allowed.begin(), allowed.end(), c)) {
+                node.cpus.push_back(c);
+            }
+        }
+        if (!node.cpus.empty()) {
+            nodes.push_back(node);
+        }
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const NumaNode& a, const NumaNode& b) {return a.id < b.id;});
+#endif
+    if (nodes.empty()) {
+        // Unknown topology: one node holding every hardware thread (pinning is skipped with a single node)
+        NumaNode node{0, allowed_cpus()};
+        if (node.cpus.empty()) {
+            for (unsigned c = 0; c < std::max(1u, std::thread::hardware_concurrency()); c++) {
+                node.cpus.push_back(static_cast<int>(c));
+            }
+        }
+        nodes.push_back(node);
+    }
+    return nodes;
+}
+
+size_t shard_count(size_t rows) {
+    size_t hw = std::max(1u, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min(hw, rows / shard_min_rows));
+}
+
+
+ShardPool::ShardPool(size_t shards) : generation(0), pending(0), stopping(false) {
+    shards = std::max<size_t>(1, shards);
+    std::vector<NumaNode> nodes = numa_nodes();
+    bool pin = nodes.size() > 1;  // On a single node the scheduler already keeps memory local
+    for (size_t s = 0; s < shards; s++) {
+        const NumaNode& n = nodes[s * nodes.size() / shards];
+        this->shard_node.push_back(n.id);
+        this->workers.emplace_back(&ShardPool::work, this, s, pin ? n.cpus : std::vector<int>());
+    }
+}
+
+ShardPool::~ShardPool() {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+    for (std::thread& t : this->workers) {
+        t.join();
+    }
+}
+
+size_t ShardPool::size() const {
+    return this->workers.size();
+}
+
+int ShardPool::node(size_t s) const {
+    return this->shard_node[s];
+}
+
+void ShardPool::work(size_t s, const std::vector<int>& cpus) {
+#ifdef __linux__
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int c : cpus) {
+            CPU_SET(c, &set);
+        }
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);  // Best effort: unpinned still works
+    }
+#endif
+    size_t seen = 0;
+    while (true) {
+        std::function<void(size_t)> fn;
+        {
+            std::unique_lock<std::mutex> guard(this->lock);
+            this->wake.wait(guard, [&] {return this->stopping || this->generation != seen;});
+            if (this->stopping) {
+                return;
+            }
+            seen = this->generation;
+            fn = this->job;
+        }
+        fn(s);
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->pending--;
+        }
+        this->done.notify_one();
+    }
+}
+
+void ShardPool::run(const std::function<void(size_t)>& fn) {
+    std::unique_lock<std::mutex> guard(this->lock);
+    this->job = fn;
+    this->pending = this->workers.size();
+    this->generation++;
+    this->wake.notify_all();
+    this->done.wait(guard, [this] {return this->pending == 0;});
+}
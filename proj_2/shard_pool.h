@@ -0,0 +1,102 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Header file for shard_pool.cpp. A fixed set of worker threads, one per database shard, spread over the NUMA
+// nodes of the machine. Worker s always runs the work of shard s, so memory a worker allocates and fills for its
+// shard (first touch) stays on that worker's node for the life of the pool.
+// Node discovery and thread pinning use Linux sysfs and pthread affinity. Elsewhere all workers share one node and
+// are left to the scheduler.
+//
+
+#ifndef SHARD_POOL_H
+#define SHARD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+const size_t shard_min_rows = 16384;  // Smaller databases are scanned on the calling thread
+
+/**
+ * CPUs of one NUMA node.
+ */
+struct NumaNode {
+    int id;                                       // Node number (sysfs nodeN)
+    std::vector<int> cpus;                        // Online CPUs of the node
+};
+
+/**
+ * Lists the NUMA nodes that have CPUs. Returns a single node holding every hardware thread when the topology
+ * cannot be read (non-Linux, containers without sysfs).
+ *
+ * @return nodes in id order, never empty
+ */
+std::vector<NumaNode> numa_nodes();
+
+/**
+ * Worker threads that each own one shard.
+ */
+class ShardPool {
+private:
+    std::vector<std::thread> workers;             // Worker s runs shard s
+    std::vector<int> shard_node;                  // Node of every worker
+    std::mutex lock;                              // Guards everything below
+    std::condition_variable wake;                 // Signals a new job or shutdown to workers
+    std::condition_variable done;                 // Signals the caller that a job finished
+    std::function<void(size_t)> job;              // Current job, called with the shard number
+    size_t generation;                            // Incremented for every job
+    size_t pending;                               // Workers still running the current job
+    bool stopping;                                // Set by the destructor
+
+    /**
+     * Body of worker s: pins itself to its node, then runs every job for its shard.
+     */
+    void work(size_t s, const std::vector<int>& cpus);
+
+public:
+    /**
+     * Starts the workers. Consecutive shards are placed on the same node, nodes taking equal shares.
+     *
+     * @param shards number of workers (at least 1)
+     */
+    explicit ShardPool(size_t shards);
+
+    /**
+     * Stops and joins the workers.
+     */
+    ~ShardPool();
+
+    ShardPool(const ShardPool&) = delete;
+    ShardPool& operator=(const ShardPool&) = delete;
+
+    /**
+     * @return number of shards (workers)
+     */
+    size_t size() const;
+
+    /**
+     * @param s shard number
+     * @return NUMA node the worker of shard s runs on
+     */
+    int node(size_t s) const;
+
+    /**
+     * Runs fn(s) on the worker of every shard s and waits for all of them. Calls must not overlap.
+     *
+     * @param fn work for one shard
+     */
+    void run(const std::function<void(size_t)>& fn);
+};
+
+/**
+ * Number of shards worth using for a scan: one per hardware thread, but no shard smaller than shard_min_rows.
+ *
+ * @param rows number of database rows
+ * @return number of shards (1 means scan on the calling thread)
+ */
+size_t shard_count(size_t rows);
+
+#endif //SHARD_POOL_H
@@ -0,0 +1,117 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Bounded-heap top-K selection and lazy result paging for p2.
+//
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+#include "topk.h"
+
+
+TopK::TopK(size_t k) : k(k) {
+    this->heap.reserve(std::min(k, topk_max_reserve));
+}
+
+bool TopK::push(double dist, size_t row) {
+    if (this->k == 0) {
+        return false;
+    }
+    ScoredRow s{dist, row};
+    if (this->heap.size() < this->k) {
+        this->heap.push_back(s);
+        std::push_heap(this->heap.begin(), this->heap.end());
+        return true;
+    }
+    if (!(s < this->heap.front())) {
+        return false;
+    }
+    std::pop_heap(this->heap.begin(), this->heap.end());
+    this->heap.back() = s;
+    std::push_heap(this->heap.begin(), this->heap.end());
+    return true;
+}
+
+double TopK::threshold() const {
+    if (!this->full()) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return this->heap.front().dist;
+}
+
+bool TopK::full() const {
+    return this->k > 0 && this->heap.size() == this->k;
+}
+
+void TopK::merge(const TopK& other) {
+    for (const ScoredRow& s : other.heap) {
+        this->push(s.dist, s.row);
+    }
+}
+
+std::vector<ScoredRow> TopK::sorted() const {
+    std::vector<ScoredRow> out = this->heap;
+    std::sort_heap(out.begin(), out.end());
+    return out;
+}
+
+/**
+ * Scans rows [begin, end) into a selector, skipping rows ranked at or before `after`.
+ */
+static void scan_range(const std::vector<double>& dists, size_t begin, size_t end, const ScoredRow* after, TopK& top) {
+    for (size_t i = begin; i < end; i++) {
+        ScoredRow s{dists[i], i};
+        if (after != nullptr && !(*after < s)) {
+            continue;
+        }
+        top.push(s.dist, s.row);
+    }
+}
+
+int select_top_k(const std::vector<double>& dists, size_t k, std::vector<ScoredRow>& out, const ScoredRow* after) {
+    size_t n = dists.size();
+    size_t hw = std::max(1u, std::thread::hardware_concurrency());
+    size_t num_shards = std::min(hw, n / topk_min_rows_per_shard);
+
+    TopK top(k);
+    if (num_shards <= 1) {
+        scan_range(dists, 0, n, after, top);
+    } else {
+        std::vector<TopK> shard_tops(num_shards, TopK(k));
+        std::vector<std::thread> workers;
+        size_t shard_size = (n + num_shards - 1) / num_shards;
+        for (size_t s = 0; s < num_shards; s++) {
+            size_t begin = s * shard_size;
+            size_t end = std::min(n, begin + shard_size);
+            workers.emplace_back(scan_range, std::cref(dists), begin, end, after, std::ref(shard_tops[s]));
+        }
+        for (std::thread& t : workers) {
+            t.join();
+        }
+        for (const TopK& t : shard_tops) {
+            top.merge(t);
+        }
+    }
+    out = top.sorted();
+    return 0;
+}
+
+void RankedPager::reset(const std::vector<double>& dists) {
+    this->dists = &dists;
+    this->started = false;
+}
+
+size_t RankedPager::next(size_t k, std::vector<ScoredRow>& page) {
+    page.clear();
+    if (this->dists == nullptr) {
+        return 0;
+    }
+    select_top_k(*this->dists, k, page, this->started ? &this->last : nullptr);
+    if (!page.empty()) {
+        this->last = page.back();
+        this->started = true;
+    }
+    return page.size();
+}
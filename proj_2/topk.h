@@ -0,0 +1,130 @@
+//
+// Created by Gautam Ajey Khanapuri
+// 18 Oct 2026
+// Header file for topk.cpp. Bounded-heap top-K selection over integer row IDs, used by p2 so that only the
+// winners of a search are ever turned into image paths.
+//
+
+#ifndef TOPK_H
+#define TOPK_H
+
+#include <cstddef>
+#include <vector>
+
+// Below this many rows select_top_k stays on the calling thread; spawning shards costs more than it saves.
+const size_t topk_min_rows_per_shard = 65536;
+// Largest heap reserved up front. A larger k (e.g. a huge --k) grows the heap as rows arrive, so it never holds more
+// than the rows actually pushed.
+const size_t topk_max_reserve = 4096;
+
+/**
+ * A distance paired with the row of the feature matrix it belongs to.
+ * Ordered by distance first and row second so that ties are broken deterministically.
+ */
+struct ScoredRow {
+    double dist;   // Distance to the query (lower = more similar)
+    size_t row;    // Row index in the feature store
+
+    bool operator<(const ScoredRow& other) const {
+        return dist < other.dist || (dist == other.dist && row < other.row);
+    }
+};
+
+/**
+ * Keeps the k smallest ScoredRows seen so far in a max-heap.
+ * push is O(log k) for accepted rows and O(1) for rejected ones, so a full scan costs O(n) instead of the
+ * O(n log n) of sorting every result.
+ */
+class TopK {
+private:
+    size_t k;                         // Maximum number of rows kept
+    std::vector<ScoredRow> heap;      // Max-heap, heap.front() is the worst kept row
+
+public:
+    /**
+     * Constructor for TopK.
+     *
+     * @param k number of rows to keep (any value; memory follows the rows pushed)
+     */
+    explicit TopK(size_t k);
+
+    /**
+     * Offers a row to the selector.
+     *
+     * @param dist distance of the row
+     * @param row row index
+     * @return true if the row is currently among the k best
+     */
+    bool push(double dist, size_t row);
+
+    /**
+     * Distance a new row has to beat to be accepted. Infinity until k rows have been pushed.
+     *
+     * @return current k-th best distance
+     */
+    double threshold() const;
+
+    /**
+     * @return true once k rows are held
+     */
+    bool full() const;
+
+    /**
+     * Pushes every row held by another selector into this one. Used to combine per-shard heaps.
+     *
+     * @param other selector to merge in
+     */
+    void merge(const TopK& other);
+
+    /**
+     * Returns the kept rows in ascending order of distance.
+     *
+     * @return sorted rows (at most k)
+     */
+    std::vector<ScoredRow> sorted() const;
+};
+
+/**
+ * Selects the k smallest distances, optionally only among rows ranked strictly after a given row.
+ * Large inputs are split into shards that each keep a local TopK on their own thread; the shard heaps are merged
+ * at the end.
+ *
+ * @param dists distance of every row
+ * @param k number of rows to select
+ * @param out output, sorted ascending
+ * @param after if not null, only rows ranked after this one are considered (used for paging)
+ * @return 0 if successful
+ */
+int select_top_k(const std::vector<double>& dists, size_t k, std::vector<ScoredRow>& out, const ScoredRow* after = nullptr);
+
+/**
+ * Hands out a ranking one page at a time. Each page is a fresh top-k selection over the rows ranked after the
+ * last row of the previous page, so results nobody looks at are never sorted.
+ */
+class RankedPager {
+private:
+    const std::vector<double>* dists;    // Distances being paged over (owned by the caller)
+    bool started;                        // False until the first page has been handed out
+    ScoredRow last;                      // Last row of the previous page
+
+public:
+    RankedPager() : dists(nullptr), started(false), last{0.0, 0} {}
+
+    /**
+     * Restarts paging over a new set of distances.
+     *
+     * @param dists distance of every row; must outlive the pager
+     */
+    void reset(const std::vector<double>& dists);
+
+    /**
+     * Returns the next page of results.
+     *
+     * @param k page size
+     * @param page output rows, sorted ascending (empty when the ranking is exhausted)
+     * @return number of rows in the page
+     */
+    size_t next(size_t k, std::vector<ScoredRow>& page);
+};
+
+#endif //TOPK_H
@@ -4,6 +4,7 @@
 // Common utility functions that are required for both programs. This file defines these utility functions.
 //
 
+#include <charconv>
 #include <iostream>
 
 #include "utils.h"
@@ -26,3 +27,14 @@ bool check_file(const fs::path& f, const std::set<std::string>& fmts) {
 
     return does_exist && is_regular && !is_it_empty && ext_is_allowed;
 }
+
+bool parse_count(const std::string& s, size_t& val) {
+    const char* end = s.data() + s.size();
+    size_t v = 0;
+    std::from_chars_result res = std::from_chars(s.data(), end, v);
+    if (s.empty() || res.ec != std::errc() || res.ptr != end || v == 0) {
+        return false;
+    }
+    val = v;
+    return true;
+}
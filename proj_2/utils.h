@@ -11,6 +11,7 @@
 #include <chrono>
 #include <filesystem>
 #include <set>
+#include <string>
 
 
 namespace cr = std::chrono;
@@ -19,6 +20,7 @@ namespace fs = std::filesystem;
 
 long long get_time_instant();
 bool check_file(const fs::path& f, const std::set<std::string>& fmts);
+bool parse_count(const std::string& s, size_t& val);  // Positive decimal integer; false on anything else or overflow
 
 
 #endif //UTILS_H
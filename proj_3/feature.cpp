@@ -66,13 +66,28 @@ int Feature::overlay_features(cv::Mat &src, std::vector<RegionStats> &regions) {
 int Classifier::load_db_file() {
     std::vector<char *> temp_labels;
     read_image_data_csv(this->db_path.string().c_str(), temp_labels, this->features);
+    int skipped = 0;
     for (int i = 0; i < temp_labels.size(); i++) {
         this->labels.push_back(temp_labels[i]);
         this->initial_datapoints_count++;
         this->labels_set.insert(temp_labels[i]);
+        if (this->index.insert(this->features[i], i) != 0) {
+            skipped++;
+        }
+    }
+    if (skipped > 0) {
+        std::cout << "Ignoring " << skipped << " training examples without " << num_features << " features" << std::endl;
     }
-    this->recalculate_average();
-    this->recalculate_stddev();
+    if (this->load_stats() != 0) {
+        for (size_t i = 0; i < this->features.size(); i++) {
+            this->add_to_stats(this->labels[i], this->features[i]);
+        }
+        if (this->overall_stats.count() > 0) {
+            this->save_stats();
+        }
+    }
+    this->update_scale();
+    this->index.rebuild();
     return 0;
 }
 
@@ -85,51 +100,155 @@ int Classifier::register_new_label(const std::string &label) {
     return 0;
 }
 
-int Classifier::recalculate_average() {
-    int n_samples = this->features.size();
-    if (n_samples == 0) {
-        return 0;
+int Classifier::add_to_stats(const std::string &label, const std::vector<float> &vec) {
+    if (this->overall_stats.add(vec) != 0) {
+        return -1;
+    }
+    std::map<std::string, RunningStats>::iterator it = this->class_stats.find(label);
+    if (it == this->class_stats.end()) {
+        it = this->class_stats.emplace(label, RunningStats(num_features)).first;
     }
+    it->second.add(vec);
+    return 0;
+}
+
+int Classifier::update_scale() {
+    long n_samples = this->overall_stats.count();
     this->average.assign(num_features, 0.0);
-    for (const std::vector<float> &feature_vec: this->features) {
+    this->stddev.assign(num_features, 1.0);
+    if (n_samples > 0) {
         for (int i = 0; i < num_features; i++) {
-            this->average[i] += feature_vec[i];
+            this->average[i] = this->overall_stats.mean()[i];
         }
     }
-    for (int i = 0; i < num_features; i++) {
-        this->average[i] /= num_features;
+    if (n_samples >= 2) {
+        for (int i = 0; i < num_features; i++) {
+            this->stddev[i] = std::sqrt(this->overall_stats.variance(i));
+            if (this->stddev[i] < 0.0001) {
+                this->stddev[i] = 1.0;
+            }
+        }
     }
-    std::cout << "Recalculated means for " << n_samples << " training examples" << std::endl;
+    this->index.set_scale(this->stddev);
     return 0;
 }
 
-int Classifier::recalculate_stddev() {
-    int n_samples = this->features.size();
-    if (n_samples < 2) {
-        this->stddev.assign(num_features, 1.0);
-        return 0;
+std::vector<float> Classifier::db_fingerprint() const {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    auto mix = [&h](const char *p, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            h ^= static_cast<unsigned char>(p[i]);
+            h *= 0x100000001b3ULL;
+        }
+    };
+    char tmp[256];
+    for (size_t i = 0; i < this->labels.size(); i++) {
+        mix(this->labels[i].c_str(), this->labels[i].size() + 1);
+        for (float v: this->features[i]) {
+            int n = snprintf(tmp, sizeof(tmp), ",%.8f", v); // same text as append_image_data_csv
+            mix(tmp, n);
+        }
+        mix("\n", 1);
+    }
+    std::vector<float> fingerprint;
+    for (int shift = 0; shift < 64; shift += 16) {
+        fingerprint.push_back(static_cast<float>((h >> shift) & 0xffff));
+    }
+    return fingerprint;
+}
+
+int Classifier::load_stats() {
+    if (!fs::exists(this->stats_path)) {
+        return -1;
+    }
+    std::vector<char *> names;
+    std::vector<std::vector<float> > rows;
+    if (read_image_data_csv(this->stats_path.string().c_str(), names, rows) != 0) {
+        return -1;
+    }
+    RunningStats overall;
+    std::map<std::string, RunningStats> per_class;
+    bool have_overall = false;
+    bool fingerprint_matches = false;
+    for (size_t i = 0; i < names.size(); i++) {
+        const std::vector<float> &row = rows[i];
+        if (names[i] == db_fingerprint_key) {
+            fingerprint_matches = row == this->db_fingerprint();
+            continue;
+        }
+        if (row.size() != 1 + 2 * num_features) {
+            return -1;
+        }
+        std::vector<double> mean(row.begin() + 1, row.begin() + 1 + num_features);
+        std::vector<double> variance(row.begin() + 1 + num_features, row.end());
+        RunningStats stats(static_cast<long>(row[0]), mean, variance);
+        if (names[i] == all_classes_key) {
+            overall = stats;
+            have_overall = true;
+        } else {
+            per_class[names[i]] = stats;
+        }
     }
-    this->stddev.assign(num_features, 0.0);
+    // Stale if the database was edited, replaced or extended without updating the statistics
+    if (!have_overall || !fingerprint_matches || overall.count() != static_cast<long>(this->index.size())) {
+        return -1;
+    }
+    this->overall_stats = overall;
+    this->class_stats = per_class;
+    std::cout << "Loaded feature statistics for " << overall.count() << " training examples" << std::endl;
+    return 0;
+}
 
-    for (const std::vector<float> &feature_vec: this->features) {
+int Classifier::save_stats() {
+    int reset = 1;
+    std::vector<std::pair<std::string, const RunningStats *> > all;
+    all.emplace_back(all_classes_key, &this->overall_stats);
+    for (const std::pair<const std::string, RunningStats> &c: this->class_stats) {
+        all.emplace_back(c.first, &c.second);
+    }
+    for (const std::pair<std::string, const RunningStats *> &entry: all) {
+        std::vector<float> row;
+        row.push_back(static_cast<float>(entry.second->count()));
         for (int i = 0; i < num_features; i++) {
-            double diff = feature_vec[i] - this->average[i];
-            this->stddev[i] += diff * diff;
+            row.push_back(static_cast<float>(entry.second->mean()[i]));
         }
+        for (int i = 0; i < num_features; i++) {
+            row.push_back(static_cast<float>(entry.second->variance(i)));
+        }
+        if (append_image_data_csv(this->stats_path.string().c_str(), entry.first.c_str(), row, reset) != 0) {
+            return -1;
+        }
+        reset = 0;
     }
+    std::vector<float> fingerprint = this->db_fingerprint();
+    return append_image_data_csv(this->stats_path.string().c_str(), db_fingerprint_key.c_str(), fingerprint, reset);
+}
 
-    for (int i = 0; i < num_features; i++) {
-        this->stddev[i] = sqrt(this->stddev[i] / n_samples);
-        if (this->stddev[i] < 0.0001) {
-            this->stddev[i] = 1.0;
+const std::map<std::string, RunningStats> &Classifier::get_class_stats() const {
+    return this->class_stats;
+}
+
+int Classifier::pooled_class_variance(std::vector<double> &variance) const {
+    long dof = this->overall_stats.count() - static_cast<long>(this->class_stats.size());
+    if (dof <= 0) {
+        return -1;
+    }
+    variance.assign(num_features, 0.0);
+    for (const std::pair<const std::string, RunningStats> &c: this->class_stats) {
+        for (int i = 0; i < num_features; i++) {
+            variance[i] += c.second.sum_sq(i);
         }
     }
-    std::cout << "Recalculated std dev" << std::endl;
+    for (int i = 0; i < num_features; i++) {
+        variance[i] /= dof;
+    }
     return 0;
 }
 
-Classifier::Classifier(fs::path db_path) {
+Classifier::Classifier(fs::path db_path) : index(num_features) {
     this->db_path = db_path;
+    this->stats_path = db_path.parent_path() / (db_path.stem().string() + stats_file_suffix);
+    this->overall_stats = RunningStats(num_features);
     this->labels.clear();
     this->features.clear();
     this->labels_set.clear();
@@ -145,6 +264,7 @@ int Classifier::write_new_trained_data() {
         for (int i = this->initial_datapoints_count; i < current_size; i++) {
             append_image_data_csv(this->db_path.string().c_str(), this->labels[i].c_str(), this->features[i]);
         }
+        this->save_stats();
     }
     this->initial_datapoints_count = current_size;
     return 0;
@@ -214,45 +334,45 @@ int Classifier::train_on_all_segments(cv::Mat &orig_img, cv::Mat &label_map, std
             std::cout << "Successfully noted down region as: " << user_input_label << std::endl;
             this->labels.push_back(user_input_label);
             this->features.push_back(r.features);
+            this->index.insert(r.features, static_cast<int>(this->features.size()) - 1);
+            this->add_to_stats(user_input_label, r.features);
         }
         counter++;
     }
     cv::destroyWindow(training_img_display_window_name);
     this->write_new_trained_data();
-    this->recalculate_average();
-    this->recalculate_stddev();
+    this->update_scale();
     return 0;
 }
 
 int Classifier::predict(std::vector<RegionStats> &regions) {
     // std::cout << "Entered predicting mode." << std::endl;
     // std::cout << regions.size() << " regions." << std::endl;
+    std::vector<std::pair<float, int> > nearest;
+    std::map<std::string, float> votes;
     for (RegionStats &r: regions) {
-        float min_dist = std::numeric_limits<float>::max();
+        this->index.search(r.features, knn_neighbours, nearest);
+        float min_dist = nearest.empty() ? std::numeric_limits<float>::max() : nearest[0].first;
         std::string min_label = unknown;
-        std::vector<float> this_region_features = r.features;
-        for (int i = 0; i < this->features.size(); i++) {
-            float dist_sum = 0.0;
-            std::string this_label = this->labels[i];
-            std::vector<float> this_features = this->features[i];
-            for (int j = 0; j < num_features; j++) {
-                double diff = this_features[j] - this_region_features[j];
-                double scaled_diff = diff / this->stddev[j];
-                dist_sum += scaled_diff * scaled_diff;
-            }
-            double distance = sqrt(dist_sum);
-            if (distance < min_dist) {
-                min_dist = distance;
-                min_label = this_label;
-            }
-        }
         if (min_dist < label_matching_threshold) {
+            votes.clear();
+            float best_vote = 0.0f;
+            min_label = this->labels[nearest[0].second];
+            for (const std::pair<float, int> &n: nearest) {
+                if (n.first >= label_matching_threshold) {
+                    break;
+                }
+                const std::string &label = this->labels[n.second];
+                float vote = votes[label] += 1.0f / (1.0f + n.first);
+                if (vote > best_vote) {
+                    best_vote = vote;
+                    min_label = label;
+                }
+            }
             // std::cout << min_label << std::endl;
             // std::cout << min_dist << std::endl;
-            r.label = min_label;
-        } else {
-            r.label = unknown;
         }
+        r.label = min_label;
         r.confidence = 1.0f / (1.0 + min_dist);
     }
     return 0;
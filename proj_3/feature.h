@@ -12,11 +12,17 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/core.hpp>
 
+#include <cstdint>
+#include <cstdio>
 #include <filesystem>
 #include <set>
 #include <iostream>
+#include <limits>
+#include <map>
 
 #include "csv_util.h"
+#include "knn_index.h"
+#include "running_stats.h"
 #include "segment.h"
 
 namespace fs = std::filesystem;
@@ -34,6 +40,14 @@ inline const float label_matching_threshold = 1.75;
 // Label assigned when no match found within threshold
 inline const std::string unknown = "Unknown";
 
+// Nearest training examples that vote on a region's label
+inline const int knn_neighbours = 3;
+
+// Running feature statistics saved next to the feature database (<db name>_stats.csv)
+inline const std::string stats_file_suffix = "_stats.csv";
+inline const std::string all_classes_key = "*"; // Row holding the statistics of the whole training set
+inline const std::string db_fingerprint_key = "#db"; // Row holding the fingerprint of the database the statistics describe
+
 /**
  * Feature extraction module.
  * Computes rotation, scale, and translation-invariant features from segmented regions.
@@ -62,8 +76,9 @@ public:
 };
 
 /**
- * Classifier for hand-crafted features using nearest-neighbor with scaled Euclidean distance.
+ * Classifier for hand-crafted features using k nearest neighbours with scaled Euclidean distance.
  * Maintains training database, computes feature statistics, and performs real-time classification.
+ * Lookups go through a KD-tree index (KnnIndex) kept in step with the training set.
  */
 class Classifier {
     fs::path db_path; // Path to feature database CSV file
@@ -71,9 +86,20 @@ class Classifier {
     std::vector<std::vector<float> > features; // Training example feature vectors
     std::vector<float> average; // Mean of each feature across training set
     std::vector<float> stddev; // Standard deviation of each feature
+    fs::path stats_path; // Saved running statistics
+    RunningStats overall_stats; // Running statistics of the whole training set
+    std::map<std::string, RunningStats> class_stats; // Running statistics of every label
+    KnnIndex index; // Nearest-neighbour index over features (rows are indices into labels / features)
     int initial_datapoints_count; // Number of examples loaded from file at startup
     std::set<std::string> labels_set; // Set of unique labels for validation
 
+    /**
+     * Fingerprint of the training examples as the database stores them: a 64-bit FNV-1a hash of every label and
+     * value (formatted as csv_util writes it), split into four 16-bit pieces so it survives the float CSV exactly.
+     * @return four values
+     */
+    std::vector<float> db_fingerprint() const;
+
     /**
      * Loads training examples from CSV file.
      * @return 0 if successful
@@ -95,16 +121,31 @@ class Classifier {
     int register_new_label(const std::string &label);
 
     /**
-     * Recalculates feature means from current training set.
+     * Adds one training example to the overall and per-label running statistics.
+     * @param label example label
+     * @param vec example features
+     * @return 0 if successful
+     */
+    int add_to_stats(const std::string &label, const std::vector<float> &vec);
+
+    /**
+     * Refreshes feature means and standard deviations from the running statistics, in O(num_features).
      * @return 0 if successful
      */
-    int recalculate_average();
+    int update_scale();
 
     /**
-     * Recalculates feature standard deviations from current training set.
+     * Loads the saved running statistics, if their fingerprint matches the examples loaded from the database.
+     * @return 0 if loaded, -1 if missing or stale
+     */
+    int load_stats();
+
+    /**
+     * Saves the running statistics (one row per label plus all_classes_key: count, means, variances) and the
+     * database fingerprint.
      * @return 0 if successful
      */
-    int recalculate_stddev();
+    int save_stats();
 
 public:
     /**
@@ -131,13 +172,28 @@ public:
     int train_on_all_segments(cv::Mat &orig_img, cv::Mat &label_map, std::vector<RegionStats> &regions);
 
     /**
-     * Classifies regions using nearest-neighbor with scaled Euclidean distance.
-     * Assigns labels based on closest match in training database.
+     * Classifies regions using k nearest neighbours with scaled Euclidean distance.
+     * The knn_neighbours closest examples within label_matching_threshold vote, each weighted by 1 / (1 + distance);
+     * ties go to the label of the closest example. Confidence comes from the closest example.
      * @param regions detected regions (labels stored in each RegionStats)
      * @return 0 if successful
      */
     int predict(std::vector<RegionStats> &regions);
 
+    /**
+     * Running statistics of every label, for Mahalanobis / LDA style scoring.
+     * @return map from label to its statistics
+     */
+    const std::map<std::string, RunningStats> &get_class_stats() const;
+
+    /**
+     * Pooled within-class variance of every feature (sum of per-label squared deviations over
+     * examples - labels), the shared diagonal covariance of LDA.
+     * @param variance output per-feature variance
+     * @return 0 if successful, -1 if there are not more examples than labels
+     */
+    int pooled_class_variance(std::vector<double> &variance) const;
+
     /**
      * Checks if training database has any examples.
      * @return true if training data exists
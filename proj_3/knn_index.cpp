@@ -0,0 +1,189 @@
+//
+// Created by Ajey K on 18/10/26.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "knn_index.h"
+
+/**
+ * Offers a candidate to the k best found so far (kept sorted, nearest first).
+ */
+static void offer(std::vector<std::pair<float, int> > &best, int k, float dist, int row) {
+    if (static_cast<int>(best.size()) == k && dist >= best.back().first) {
+        return;
+    }
+    std::pair<float, int> cand(dist, row);
+    best.insert(std::upper_bound(best.begin(), best.end(), cand), cand);
+    if (static_cast<int>(best.size()) > k) {
+        best.pop_back();
+    }
+}
+
+KnnIndex::KnnIndex(int dims) : dims(dims) {
+    this->weights.assign(dims, 1.0f);
+    this->clear();
+}
+
+int KnnIndex::clear() {
+    this->tree_cols.assign(this->dims, std::vector<float>());
+    this->tree_rows.clear();
+    this->nodes.clear();
+    this->pending_cols.assign(this->dims, std::vector<float>());
+    this->pending_rows.clear();
+    return 0;
+}
+
+int KnnIndex::insert(const std::vector<float> &vec, int row) {
+    if (static_cast<int>(vec.size()) != this->dims) {
+        return -1;
+    }
+    for (int j = 0; j < this->dims; j++) {
+        this->pending_cols[j].push_back(vec[j]);
+    }
+    this->pending_rows.push_back(row);
+    const size_t pending = this->pending_rows.size();
+    if (pending > static_cast<size_t>(kd_leaf_size) && pending > kd_rebuild_fraction * this->tree_rows.size()) {
+        this->rebuild();
+    }
+    return 0;
+}
+
+int KnnIndex::set_scale(const std::vector<float> &stddev) {
+    for (int j = 0; j < this->dims; j++) {
+        this->weights[j] = 1.0f / (stddev[j] * stddev[j]);
+    }
+    return 0;
+}
+
+size_t KnnIndex::size() const {
+    return this->tree_rows.size() + this->pending_rows.size();
+}
+
+int KnnIndex::rebuild() {
+    // Gather every point, then lay them out in tree order
+    std::vector<std::vector<float> > cols = this->tree_cols;
+    std::vector<int> rows = this->tree_rows;
+    for (int j = 0; j < this->dims; j++) {
+        cols[j].insert(cols[j].end(), this->pending_cols[j].begin(), this->pending_cols[j].end());
+        this->pending_cols[j].clear();
+    }
+    rows.insert(rows.end(), this->pending_rows.begin(), this->pending_rows.end());
+    this->pending_rows.clear();
+
+    const int n = static_cast<int>(rows.size());
+    this->tree_cols = cols;
+    this->tree_rows = rows;
+    this->nodes.clear();
+    if (n == 0) {
+        return 0;
+    }
+    std::vector<int> order(n);
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    this->build(order, 0, n);
+    for (int j = 0; j < this->dims; j++) {
+        for (int p = 0; p < n; p++) {
+            this->tree_cols[j][p] = cols[j][order[p]];
+        }
+    }
+    for (int p = 0; p < n; p++) {
+        this->tree_rows[p] = rows[order[p]];
+    }
+    return 0;
+}
+
+int KnnIndex::build(std::vector<int> &order, int begin, int end) {
+    // tree_cols still holds the points in insertion order here; order maps tree positions to them
+    const int id = static_cast<int>(this->nodes.size());
+    this->nodes.push_back({-1, 0.0f, -1, -1, begin, end});
+    if (end - begin <= kd_leaf_size) {
+        return id;
+    }
+    int best_dim = -1;
+    float best_spread = 0.0f;
+    for (int j = 0; j < this->dims; j++) {
+        const std::vector<float> &c = this->tree_cols[j];
+        float lo = std::numeric_limits<float>::max();
+        float hi = -std::numeric_limits<float>::max();
+        for (int p = begin; p < end; p++) {
+            lo = std::min(lo, c[order[p]]);
+            hi = std::max(hi, c[order[p]]);
+        }
+        const float spread = (hi - lo) * std::sqrt(this->weights[j]);
+        if (spread > best_spread) {
+            best_spread = spread;
+            best_dim = j;
+        }
+    }
+    if (best_dim < 0) {
+        return id; // All points identical: keep them in one leaf
+    }
+    const std::vector<float> &c = this->tree_cols[best_dim];
+    const int mid = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                     [&c](int a, int b) { return c[a] < c[b]; });
+    const float split = c[order[mid]];
+    const int left = this->build(order, begin, mid);
+    const int right = this->build(order, mid, end);
+    this->nodes[id].dim = best_dim;
+    this->nodes[id].split = split;
+    this->nodes[id].left = left;
+    this->nodes[id].right = right;
+    return id;
+}
+
+void KnnIndex::scan(const std::vector<std::vector<float> > &cols, const std::vector<int> &rows, int begin, int end,
+                    const float *q, int k, std::vector<std::pair<float, int> > &best) const {
+    float dist[kd_leaf_size];
+    for (int p0 = begin; p0 < end; p0 += kd_leaf_size) {
+        const int n = std::min(kd_leaf_size, end - p0);
+        std::fill(dist, dist + n, 0.0f);
+        for (int j = 0; j < this->dims; j++) {
+            const float *c = cols[j].data() + p0;
+            const float w = this->weights[j];
+            const float qj = q[j];
+            for (int p = 0; p < n; p++) {
+                const float d = c[p] - qj;
+                dist[p] += w * d * d;
+            }
+        }
+        for (int p = 0; p < n; p++) {
+            offer(best, k, dist[p], rows[p0 + p]);
+        }
+    }
+}
+
+void KnnIndex::search_node(int node, const float *q, int k, std::vector<std::pair<float, int> > &best) const {
+    const KdNode &nd = this->nodes[node];
+    if (nd.dim < 0) {
+        this->scan(this->tree_cols, this->tree_rows, nd.begin, nd.end, q, k, best);
+        return;
+    }
+    const float diff = q[nd.dim] - nd.split;
+    const int near = diff < 0.0f ? nd.left : nd.right;
+    const int far = diff < 0.0f ? nd.right : nd.left;
+    this->search_node(near, q, k, best);
+    if (static_cast<int>(best.size()) < k || diff * diff * this->weights[nd.dim] < best.back().first) {
+        this->search_node(far, q, k, best);
+    }
+}
+
+int KnnIndex::search(const std::vector<float> &q, int k, std::vector<std::pair<float, int> > &out) const {
+    out.clear();
+    if (k <= 0 || static_cast<int>(q.size()) != this->dims) {
+        return 0;
+    }
+    if (!this->nodes.empty()) {
+        this->search_node(0, q.data(), k, out);
+    }
+    this->scan(this->pending_cols, this->pending_rows, 0, static_cast<int>(this->pending_rows.size()), q.data(), k,
+               out);
+    for (std::pair<float, int> &r: out) {
+        r.first = std::sqrt(r.first);
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+//
+// Created by Ajey K on 18/10/26.
+// Header file for the nearest-neighbour index behind the hand-crafted feature Classifier.
+// Training vectors are stored column by column (structure of arrays) in KD-tree order, and searched with a
+// per-dimension weighted Euclidean distance. The tree is built on the raw features and the weights are applied
+// at query time, so changing the standard deviations never invalidates it; new vectors are scanned by brute force
+// until enough of them accumulate to make a rebuild worthwhile.
+//
+
+#ifndef KNN_INDEX_H
+#define KNN_INDEX_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+inline const int kd_leaf_size = 16; // Points per KD-tree leaf, scanned together
+inline const float kd_rebuild_fraction = 0.25f; // Rebuild once pending points exceed this share of the tree
+
+/**
+ * One KD-tree node. Leaves cover points [begin, end) of the tree-ordered columns.
+ */
+struct KdNode {
+    int dim; // Split dimension, -1 for a leaf
+    float split; // Points with value < split are on the left
+    int left; // Child nodes (unused for leaves)
+    int right;
+    int begin; // Point range
+    int end;
+};
+
+/**
+ * Exact k nearest neighbour search over fixed-length float vectors.
+ */
+class KnnIndex {
+    int dims; // Vector length
+    std::vector<float> weights; // Per-dimension weight, 1 / stddev^2
+    std::vector<std::vector<float> > tree_cols; // tree_cols[j][p] = dimension j of tree point p
+    std::vector<int> tree_rows; // Caller's row of every tree point
+    std::vector<KdNode> nodes; // Node 0 is the root (empty tree: no nodes)
+    std::vector<std::vector<float> > pending_cols; // Points inserted since the last rebuild, same layout
+    std::vector<int> pending_rows;
+
+    /**
+     * Builds the subtree over tree points [begin, end), splitting on the widest weighted dimension at the median.
+     * @return node index
+     */
+    int build(std::vector<int> &order, int begin, int end);
+
+    /**
+     * Weighted squared distances from q to points [begin, end) of cols, added to best.
+     */
+    void scan(const std::vector<std::vector<float> > &cols, const std::vector<int> &rows, int begin, int end,
+              const float *q, int k, std::vector<std::pair<float, int> > &best) const;
+
+    /**
+     * Descends the tree, skipping subtrees that cannot beat the current k-th distance.
+     */
+    void search_node(int node, const float *q, int k, std::vector<std::pair<float, int> > &best) const;
+
+public:
+    /**
+     * Constructor for KnnIndex.
+     * @param dims vector length
+     */
+    explicit KnnIndex(int dims);
+
+    /**
+     * Removes every point.
+     * @return 0 if successful
+     */
+    int clear();
+
+    /**
+     * Adds a point. Rebuilds the tree when the points added since the last rebuild outnumber
+     * kd_rebuild_fraction of it.
+     * @param vec vector of length dims
+     * @param row caller's identifier for the point (returned by search)
+     * @return 0 if successful, -1 if vec has the wrong length
+     */
+    int insert(const std::vector<float> &vec, int row);
+
+    /**
+     * Sets the distance scale: dimension j counts as (difference / stddev[j])^2.
+     * @param stddev per-dimension standard deviations (non-zero)
+     * @return 0 if successful
+     */
+    int set_scale(const std::vector<float> &stddev);
+
+    /**
+     * Rebuilds the tree over every point.
+     * @return 0 if successful
+     */
+    int rebuild();
+
+    /**
+     * @return number of points
+     */
+    size_t size() const;
+
+    /**
+     * Finds the k nearest points.
+     * @param q query vector of length dims
+     * @param k number of neighbours
+     * @param out output (scaled Euclidean distance, row), nearest first; fewer than k if the index is smaller
+     * @return 0 if successful
+     */
+    int search(const std::vector<float> &q, int k, std::vector<std::pair<float, int> > &out) const;
+};
+
+#endif //KNN_INDEX_H
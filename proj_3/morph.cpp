@@ -2,17 +2,205 @@
 // Created by Ajey K on 21/02/26.
 //
 
+#include <cstring>
+
 #include "morph.h"
 
+/**
+ * Word w of a packed row shifted so that bit i holds pixel w * 64 + i + d (|d| < 64).
+ * prev and next are the neighbouring words, or the border value past either end of the row.
+ */
+static inline uint64_t shifted_word(uint64_t prev, uint64_t cur, uint64_t next, int d) {
+    if (d > 0) {
+        return (cur >> d) | (next << (packed_word_bits - d));
+    }
+    if (d < 0) {
+        return (cur << -d) | (prev >> (packed_word_bits + d));
+    }
+    return cur;
+}
+
+int pack_row(const uchar *src, int cols, uint64_t *dst) {
+    const int words = (cols + packed_word_bits - 1) / packed_word_bits;
+    for (int w = 0; w < words; w++) {
+        const uchar *p = src + w * packed_word_bits;
+        const int n = std::min(packed_word_bits, cols - w * packed_word_bits);
+        uint64_t bits = 0;
+        int i = 0;
+        // Eight pixels at a time: flag the non-zero bytes, then gather the flags into one byte.
+        // Assumes a little-endian host (pixel i in byte i of the load), as on x86 and Apple silicon.
+        for (; i + 8 <= n; i += 8) {
+            uint64_t v;
+            std::memcpy(&v, p + i, sizeof(v));
+            const uint64_t nonzero = ((((v & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | v) >> 7) & 0x0101010101010101ULL;
+            bits |= ((nonzero * 0x0102040810204080ULL) >> 56) << i;
+        }
+        for (; i < n; i++) {
+            bits |= static_cast<uint64_t>(p[i] != 0) << i;
+        }
+        dst[w] = bits;
+    }
+    return 0;
+}
+
+int unpack_row(const uint64_t *src, int cols, uchar *dst) {
+    const int words = (cols + packed_word_bits - 1) / packed_word_bits;
+    for (int w = 0; w < words; w++) {
+        uchar *p = dst + w * packed_word_bits;
+        const int n = std::min(packed_word_bits, cols - w * packed_word_bits);
+        const uint64_t bits = src[w];
+        for (int i = 0; i < n; i++) {
+            p[i] = static_cast<uchar>(0 - ((bits >> i) & 1)); // 0 or 255
+        }
+    }
+    return 0;
+}
+
+MorphStage::MorphStage(const cv::Mat &kernel, bool erode, int rows, int cols)
+    : erode(erode), rows(rows), cols(cols), pushed(0), popped(0) {
+    this->words = (cols + packed_word_bits - 1) / packed_word_bits;
+    this->kernel_rows = kernel.rows;
+    const int anchor_x = kernel.cols / 2;
+    const int anchor_y = kernel.rows / 2;
+    this->below = kernel.rows - 1 - anchor_y;
+
+    for (int k = 0; k < kernel.rows; k++) {
+        const uchar *kp = kernel.ptr<uchar>(k);
+        int first = -1;
+        int last = -1;
+        for (int j = 0; j < kernel.cols; j++) {
+            if (kp[j] != 0) {
+                if (first < 0) {
+                    first = j;
+                }
+                last = j;
+            }
+        }
+        if (first < 0) {
+            continue; // Empty kernel row
+        }
+        std::pair<int, int> span(first - anchor_x, last - anchor_x);
+        int s = 0;
+        while (s < static_cast<int>(this->spans.size()) && this->spans[s] != span) {
+            s++;
+        }
+        if (s == static_cast<int>(this->spans.size())) {
+            this->spans.push_back(span);
+        }
+        this->taps.emplace_back(k - anchor_y, s);
+    }
+    this->ring.assign(this->spans.size() * this->kernel_rows * this->words, 0);
+    this->scratch.assign(this->words, 0);
+}
+
+uint64_t *MorphStage::slot(int span, int y) {
+    return this->ring.data() + (span * this->kernel_rows + y % this->kernel_rows) * this->words;
+}
+
+int MorphStage::push(const uint64_t *row) {
+    // Erosion is dilation of the complement, so the ring holds complemented rows when eroding and only OR is
+    // ever needed. Pixels past the right edge then always read as 0: background for dilation and, complemented,
+    // foreground for erosion.
+    const uint64_t flip = this->erode ? ~0ULL : 0ULL;
+    for (int w = 0; w < this->words; w++) {
+        this->scratch[w] = row[w] ^ flip;
+    }
+    const int tail = this->cols % packed_word_bits;
+    if (tail != 0) {
+        this->scratch[this->words - 1] &= (1ULL << tail) - 1;
+    }
+
+    for (int s = 0; s < static_cast<int>(this->spans.size()); s++) {
+        uint64_t *out = this->slot(s, this->pushed);
+        const int first = this->spans[s].first;
+        const int last = this->spans[s].second;
+        for (int w = 0; w < this->words; w++) {
+            const uint64_t prev = w > 0 ? this->scratch[w - 1] : 0;
+            const uint64_t cur = this->scratch[w];
+            const uint64_t next = w + 1 < this->words ? this->scratch[w + 1] : 0;
+            uint64_t acc = 0;
+            for (int d = first; d <= last; d++) {
+                acc |= shifted_word(prev, cur, next, d);
+            }
+            out[w] = acc;
+        }
+    }
+    this->pushed++;
+    return 0;
+}
+
+bool MorphStage::ready() const {
+    return this->popped < this->rows && (this->pushed == this->rows || this->pushed > this->popped + this->below);
+}
+
+int MorphStage::pop(uint64_t *out) {
+    // Rows above and below the image never change the result, so they are simply left out
+    std::fill(out, out + this->words, 0);
+    const int y = this->popped;
+    for (const std::pair<int, int> &tap: this->taps) {
+        const int yy = y + tap.first;
+        if (yy < 0 || yy >= this->rows) {
+            continue;
+        }
+        const uint64_t *h = this->slot(tap.second, yy);
+        for (int w = 0; w < this->words; w++) {
+            out[w] |= h[w];
+        }
+    }
+    if (this->erode) {
+        for (int w = 0; w < this->words; w++) {
+            out[w] = ~out[w];
+        }
+    }
+    this->popped++;
+    return 0;
+}
+
+MorphPipeline::MorphPipeline(int rows, int cols, const PackedRowSink &sink) : sink(sink) {
+    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(kernel_size, kernel_size));
+
+    // Opening (erode, dilate) then closing (dilate, erode)
+    const bool passes[] = {true, false, false, true};
+    for (bool erode: passes) {
+        this->stages.emplace_back(kernel, erode, rows, cols);
+    }
+    const int words = (cols + packed_word_bits - 1) / packed_word_bits;
+    this->bufs.assign(this->stages.size(), std::vector<uint64_t>(words));
+}
+
+void MorphPipeline::drain(size_t s) {
+    while (this->stages[s].ready()) {
+        this->stages[s].pop(this->bufs[s].data());
+        if (s + 1 < this->stages.size()) {
+            this->stages[s + 1].push(this->bufs[s].data());
+            this->drain(s + 1);
+        } else {
+            this->sink(this->bufs[s].data());
+        }
+    }
+}
+
+int MorphPipeline::push(const uint64_t *row) {
+    this->stages[0].push(row);
+    this->drain(0);
+    return 0;
+}
+
 int morph(const cv::Mat &src, cv::Mat &dst) {
     // std::cout << "Start morph" << std::endl;
     // std::cout << "src type: " << src.type() << std::endl;
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(kernel_size, kernel_size));
-
-    // std::cout << "Opening image" << std::endl;
-    cv::morphologyEx(src, dst, cv::MORPH_OPEN, kernel);
-    // std::cout << "Closing image" << std::endl;
-    cv::morphologyEx(dst, dst, cv::MORPH_CLOSE, kernel);
+    // Output row y leaves the pipeline only after input row y has been packed, so dst may be src
+    dst.create(src.rows, src.cols, CV_8UC1);
+    int out_y = 0;
+    MorphPipeline pipeline(src.rows, src.cols, [&dst, &out_y](const uint64_t *row) {
+        unpack_row(row, dst.cols, dst.ptr<uchar>(out_y));
+        out_y++;
+    });
+    std::vector<uint64_t> row((src.cols + packed_word_bits - 1) / packed_word_bits);
+    for (int y = 0; y < src.rows; y++) {
+        pack_row(src.ptr<uchar>(y), src.cols, row.data());
+        pipeline.push(row.data());
+    }
 
     // std::cout << "dst type after morphology: " << dst.type() << std::endl;
     // std::cout << "Morphology done!" << std::endl;
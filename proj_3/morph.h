@@ -2,6 +2,7 @@
 // Created by Ajey K on 21/02/26.
 // Header file for morphological filtering operations.
 // Applies opening and closing operations to clean binary images.
+// Masks are processed packed, 64 pixels per word, through a streaming row pipeline of erosions and dilations.
 //
 
 #ifndef MORPH_H
@@ -12,16 +13,138 @@
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
 // Structuring element kernel size for morphological operations
 inline const int kernel_size = 5;
 
+// Packed binary rows: bit (x % 64) of word (x / 64) is pixel x
+inline const int packed_word_bits = 64; // Pixels per packed word
+
+/**
+ * Packs one row of a binary image (any non-zero pixel is foreground).
+ * @param src row of cols bytes
+ * @param cols number of pixels
+ * @param dst output, (cols + 63) / 64 words; bits past cols are cleared
+ * @return 0 if successful
+ */
+int pack_row(const uchar *src, int cols, uint64_t *dst);
+
+/**
+ * Unpacks one packed row to 0 / 255 bytes.
+ * @param src packed row
+ * @param cols number of pixels
+ * @param dst output row of cols bytes
+ * @return 0 if successful
+ */
+int unpack_row(const uint64_t *src, int cols, uchar *dst);
+
+/**
+ * One erosion or dilation in a streaming row pipeline over packed rows.
+ * The structuring element is kept as one horizontal span per kernel row (true of ellipses, rectangles and crosses);
+ * kernel rows with equal spans share one horizontal pass. Input rows are pushed top to bottom, and each output row
+ * can be popped as soon as every input row under the kernel has arrived, so only a kernel-height ring of rows is
+ * held. Borders match cv::erode / cv::dilate defaults: pixels outside the image never change the result.
+ */
+class MorphStage {
+    bool erode; // Erosion or dilation
+    int rows; // Image height
+    int cols; // Image width
+    int words; // Packed words per row
+    int kernel_rows; // Ring height
+    int below; // Kernel rows below the anchor
+    std::vector<std::pair<int, int> > spans; // Distinct horizontal spans (first dx, last dx)
+    std::vector<std::pair<int, int> > taps; // (dy, span index) for every non-empty kernel row
+    std::vector<uint64_t> ring; // Horizontal results of the last kernel_rows input rows, for every span (complemented when eroding)
+    std::vector<uint64_t> scratch; // Input row being pushed, padding bits cleared
+    int pushed; // Input rows received
+    int popped; // Output rows produced
+
+    /**
+     * Location of the horizontal result of an input row for one span.
+     */
+    uint64_t *slot(int span, int y);
+
+public:
+    /**
+     * Constructor for MorphStage.
+     * @param kernel structuring element (CV_8U, non-zero = member, at most 127 columns), anchored at its centre
+     * @param erode true for erosion, false for dilation
+     * @param rows image height
+     * @param cols image width
+     */
+    MorphStage(const cv::Mat &kernel, bool erode, int rows, int cols);
+
+    /**
+     * Adds the next input row.
+     * @param row packed row
+     * @return 0 if successful
+     */
+    int push(const uint64_t *row);
+
+    /**
+     * @return true if the next output row can be popped
+     */
+    bool ready() const;
+
+    /**
+     * Produces the next output row. Only valid when ready().
+     * @param out output packed row (padding bits are unspecified)
+     * @return 0 if successful
+     */
+    int pop(uint64_t *out);
+};
+
+/**
+ * Receives the rows leaving a MorphPipeline, top to bottom.
+ */
+typedef std::function<void(const uint64_t *)> PackedRowSink;
+
+/**
+ * The opening (erode, dilate) and closing (dilate, erode) used by morph, as one chain of MorphStages.
+ * Rows are pushed packed and handed to the sink as soon as the last stage produces them, so a frame can be
+ * thresholded, cleaned and labelled in one rolling window of rows.
+ */
+class MorphPipeline {
+    std::vector<MorphStage> stages; // Passes in order
+    std::vector<std::vector<uint64_t> > bufs; // Output row of every stage
+    PackedRowSink sink; // Receives the rows of the last stage
+
+    /**
+     * Passes every row stage s can produce down the pipeline, depth first, so no stage receives a row before the
+     * stage after it has taken what it needs from its ring.
+     */
+    void drain(size_t s);
+
+public:
+    /**
+     * Constructor for MorphPipeline.
+     * @param rows image height
+     * @param cols image width
+     * @param sink called once per output row, in order (rows are only valid during the call)
+     */
+    MorphPipeline(int rows, int cols, const PackedRowSink &sink);
+
+    /**
+     * Adds the next input row; any output rows it completes are passed to the sink before returning.
+     * @param row packed row
+     * @return 0 if successful
+     */
+    int push(const uint64_t *row);
+};
+
 /**
  * Applies morphological filtering to clean binary images.
  * Uses opening (erosion → dilation) to remove noise followed by
  * closing (dilation → erosion) to fill holes and connect fragmented regions.
+ * The four passes run as one packed row pipeline; the image is unpacked only as rows leave the last pass.
  *
- * @param src input binary image
- * @param dst output cleaned binary image
+ * @param src input binary image (CV_8U)
+ * @param dst output cleaned binary image (0 / 255)
  * @return 0 if successful
  */
 int morph(const cv::Mat &src, cv::Mat &dst);
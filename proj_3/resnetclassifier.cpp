@@ -11,11 +11,13 @@
   int debug          1: show the image given to the network and print the embedding, 0: don't show extra info
  */
 int ResNetClassifier::getEmbedding(const cv::Mat &src, cv::Mat &embedding, int debug) {
-    const int ORNet_size = 224; // expected network input size
+    const int ORNet_size = resnet_input_size; // expected network input size
     cv::Mat blob;
-    cv::Mat resized;
+    cv::Mat resized = src;
 
-    cv::resize(src, resized, cv::Size(ORNet_size, ORNet_size));
+    if (src.cols != ORNet_size || src.rows != ORNet_size) {
+        cv::resize(src, resized, cv::Size(ORNet_size, ORNet_size));
+    }
 
     cv::dnn::blobFromImage(resized, // input image
                            blob, // output array
@@ -34,13 +36,30 @@ int ResNetClassifier::getEmbedding(const cv::Mat &src, cv::Mat &embedding, int d
     return (0);
 }
 
+int ResNetClassifier::getEmbeddings(const std::vector<cv::Mat> &srcs, int first, int count, cv::Mat &embeddings) {
+    std::vector<cv::Mat> batch(srcs.begin() + first, srcs.begin() + first + count); // headers only
+    cv::dnn::blobFromImages(batch, // input images
+                            this->blob, // output array, N x 3 x 224 x 224
+                            (1.0 / 255.0) * (1 / 0.226), // scale factor
+                            cv::Size(resnet_input_size, resnet_input_size), // already this size
+                            cv::Scalar(124, 116, 104), // subtract mean prior to scaling
+                            true, // swapRB
+                            false, // center crop after scaling short side to size
+                            CV_32F); // output depth/type
+
+    this->net.setInput(this->blob);
+    embeddings = this->net.forward("onnx_node!resnetv22_flatten0_reshape0").reshape(1, count);
+    return 0;
+}
+
 /*
   Given the oriented bounding box information, extracts the region
   from the original image and rotates it so the primary axis is
-  pointing right.
+  pointing right. Rotation, crop and resize to the network input
+  size are a single warpAffine of the ROI's footprint in the frame.
 
   cv::Mat &frame - the original image
-  cv::Mat &embimage - the resulting ROI
+  cv::Mat &embimage - the resulting ROI, resnet_input_size square
   int cx - the x coordinate of the centroid of the region
   int cy - the y coordinate of the centroid of the region
   float theta - the orientation of the primary axis of the region (first eigenvector / least 2nd central moment
@@ -57,36 +76,18 @@ int ResNetClassifier::getEmbedding(const cv::Mat &src, cv::Mat &embedding, int d
 */
 int ResNetClassifier::prepEmbeddingImage(const cv::Mat &frame, cv::Mat &embimage, int cx, int cy, float theta,
                                          float minE1, float maxE1, float minE2, float maxE2, int debug) {
-    // rotate the image to align the primary region with the x-axis
-    cv::Mat rotatedImage;
-    cv::Mat M;
-
-    M = cv::getRotationMatrix2D(cv::Point2f(cx, cy), -theta * 180 / M_PI, 1.0);
+    // rotation that aligns the primary region with the x-axis
+    cv::Mat M = cv::getRotationMatrix2D(cv::Point2f(cx, cy), -theta * 180 / M_PI, 1.0);
     int largest = frame.cols > frame.rows ? frame.cols : frame.rows;
     largest = (int) (1.414 * largest);
-    cv::warpAffine(frame, rotatedImage, M, cv::Size(largest, largest));
-    // cv::warpAffine(frame, rotatedImage, M, frame.size());
-
-
-    if (debug) {
-        cv::imshow("rotated", rotatedImage);
-    }
 
+    // ROI in the rotated frame
     int left = cx + (int) minE1;
     int top = cy - (int) maxE2;
     int width = (int) maxE1 - (int) minE1;
     int height = (int) maxE2 - (int) minE2;
 
-    // printf("Before bounds check:\n");
-    // printf("  cx=%d, cy=%d\n", cx, cy);
-    // printf("  minE1=%.1f, maxE1=%.1f, minE2=%.1f, maxE2=%.1f\n",
-    //        minE1, maxE1, minE2, maxE2);
-    // printf("  Initial: left=%d, top=%d, width=%d, height=%d\n",
-    //        left, top, width, height);
-    // printf("  rotatedImage size: %dx%d\n", rotatedImage.cols, rotatedImage.rows);
-
-
-    // bounds check the ROI
+    // bounds check the ROI against the rotated canvas
     if (left < 0) {
         width += left;
         left = 0;
@@ -95,28 +96,38 @@ int ResNetClassifier::prepEmbeddingImage(const cv::Mat &frame, cv::Mat &embimage
         height += top;
         top = 0;
     }
-    if (left + width >= rotatedImage.cols) {
-        width = (rotatedImage.cols - 1) - left;
+    if (left + width >= largest) {
+        width = (largest - 1) - left;
     }
-    if (top + height >= rotatedImage.rows) {
-        height = (rotatedImage.rows - 1) - top;
+    if (top + height >= largest) {
+        height = (largest - 1) - top;
     }
+    width = std::max(width, 1);
+    height = std::max(height, 1);
 
     if (debug) {
         printf("ROI box: %d %d %d %d\n", left, top, width, height);
     }
 
-    // crop the image to the bounding box of the object
-    cv::Rect objroi(left, top, width, height);
-    cv::rectangle(rotatedImage, cv::Point2d(objroi.x, objroi.y),
-                  cv::Point2d(objroi.x + objroi.width, objroi.y + objroi.height), 200, 4);
+    // One warp straight from the frame to the network input. Output pixel (u, v) samples the rotated frame where
+    // resizing the ROI would (pixel centres aligned), and that point is mapped back through the inverse rotation.
+    const double sx = (double) width / resnet_input_size;
+    const double sy = (double) height / resnet_input_size;
+    cv::Mat inv;
+    cv::invertAffineTransform(M, inv);
+    const double *r0 = inv.ptr<double>(0);
+    const double *r1 = inv.ptr<double>(1);
+    const double ox = left + 0.5 * sx - 0.5; // rotated x of output pixel 0
+    const double oy = top + 0.5 * sy - 0.5;
+    cv::Mat A = (cv::Mat_<double>(2, 3) <<
+                 r0[0] * sx, r0[1] * sy, r0[0] * ox + r0[1] * oy + r0[2],
+                 r1[0] * sx, r1[1] * sy, r1[0] * ox + r1[1] * oy + r1[2]);
+    cv::warpAffine(frame, embimage, A, cv::Size(resnet_input_size, resnet_input_size),
+                   cv::INTER_LINEAR | cv::WARP_INVERSE_MAP);
 
-    // extract the image and get the embedding of the original image
-    cv::Mat extractedImage(rotatedImage, objroi);
     if (debug) {
-        cv::imshow("extracted", extractedImage);
+        cv::imshow("extracted", embimage);
     }
-    extractedImage.copyTo(embimage);
     return 0;
 }
 
@@ -154,13 +165,23 @@ int ResNetClassifier::load_data_from_csv() {
     int result = read_image_data_csv(this->db_file_path.string().c_str(),
                                      temp_labels, temp_features, 0);
 
-    if (result != 0) {
+    if (result != 0 || temp_labels.empty()) {
         std::cout << "No existing ResNet training data" << std::endl;
         return 0;
     }
 
+    // Embeddings only compare with embeddings of crops made the same way
+    if (resnet_version_key != temp_labels[0] || temp_features[0].size() != 1
+        || static_cast<int>(temp_features[0][0]) != resnet_crop_version) {
+        std::cout << "ResNet training data in " << this->db_file_path
+                << " was computed from an older version of the crops and will not be used." << std::endl;
+        std::cout << "Delete or move the file and retrain with 'N'." << std::endl;
+        this->db_stale = true;
+        return 0;
+    }
+
     // Convert vector<float> to Mat for each embedding
-    for (size_t i = 0; i < temp_labels.size(); i++) {
+    for (size_t i = 1; i < temp_labels.size(); i++) {
         this->training_labels.push_back(std::string(temp_labels[i]));
 
         cv::Mat embedding = vector_to_mat(temp_features[i]);
@@ -182,6 +203,15 @@ int ResNetClassifier::write_trained_data_to_csv() {
         // Nothing new to write
         return 0;
     }
+    if (this->db_stale) {
+        std::cout << "Not appending to stale ResNet training data: " << this->db_file_path << std::endl;
+        return 0;
+    }
+    if (this->starting_datapoint_count == 0) {
+        // New file: the version row goes first
+        std::vector<float> version = {static_cast<float>(resnet_crop_version)};
+        append_image_data_csv(this->db_file_path.string().c_str(), resnet_version_key.c_str(), version, 1);
+    }
 
     // Write only new examples (from starting_datapoint_count onwards)
     for (size_t i = this->starting_datapoint_count; i < current_size; i++) {
@@ -205,6 +235,8 @@ ResNetClassifier::ResNetClassifier(const std::string &db_file_path) {
     this->resnet_path = resnet_file_path;
     this->db_file_path = db_file_path;
     this->starting_datapoint_count = 0;
+    this->db_stale = false;
+    this->max_batch = resnet_default_max_batch;
     this->training_embeddings.clear();
     this->training_labels.clear();
 
@@ -330,44 +362,49 @@ int ResNetClassifier::train(const cv::Mat &original_frame, const std::vector<Reg
     return 0;
 }
 
+int ResNetClassifier::set_max_batch(int n) {
+    this->max_batch = std::max(1, n);
+    return 0;
+}
+
 int ResNetClassifier::classify(const cv::Mat &original_frame, std::vector<RegionStats> &regions) {
     // Same preprocessing
     // std::cout << "Entered classification mode for DNN" << std::endl;
-    for (RegionStats &r: regions) {
-        cv::Mat embimage;
-        // std::cout << "Going to prep embedding image" << std::endl;
-        // // Before calling prepEmbeddingImage:
-        // std::cout << "Extents: minE1=" << r.axisExtent.minE1
-        //           << " maxE1=" << r.axisExtent.maxE1
-        //           << " minE2=" << r.axisExtent.minE2
-        //           << " maxE2=" << r.axisExtent.maxE2 << std::endl;
-        //
-        // // Verify:
-        // if (r.axisExtent.minE1 > 0 || r.axisExtent.maxE1 < 0 ||
-        //     r.axisExtent.minE2 > 0 || r.axisExtent.maxE2 < 0) {
-        //     std::cerr << "WARNING: Extent signs are wrong!" << std::endl;
-        //     }
-        prepEmbeddingImage(original_frame, embimage,
+    const int n = static_cast<int>(regions.size());
+    if (this->crops.size() < regions.size()) {
+        this->crops.resize(regions.size());
+    }
+    for (int i = 0; i < n; i++) {
+        const RegionStats &r = regions[i];
+        prepEmbeddingImage(original_frame, this->crops[i],
                            r.centroid.x, r.centroid.y, r.angle,
                            r.axisExtent.minE1, r.axisExtent.maxE1,
                            r.axisExtent.minE2, r.axisExtent.maxE2, 0);
-        cv::Mat query_embedding;
-        getEmbedding(embimage, query_embedding, 0);
-        // Find nearest neighbor (SSD)
-        double min_dist = std::numeric_limits<double>::max();
-        std::string best_label = "Unknown";
-
-        for (size_t i = 0; i < training_embeddings.size(); i++) {
-            double dist = cv::norm(query_embedding, training_embeddings[i], cv::NORM_L2SQR);
-            if (dist < min_dist) {
-                min_dist = dist;
-                best_label = training_labels[i];
+    }
+
+    cv::Mat query_embeddings;
+    for (int first = 0; first < n; first += this->max_batch) {
+        const int count = std::min(this->max_batch, n - first);
+        getEmbeddings(this->crops, first, count, query_embeddings);
+        for (int k = 0; k < count; k++) {
+            cv::Mat query_embedding = query_embeddings.row(k);
+            // Find nearest neighbor (SSD)
+            double min_dist = std::numeric_limits<double>::max();
+            std::string best_label = "Unknown";
+
+            for (size_t i = 0; i < training_embeddings.size(); i++) {
+                double dist = cv::norm(query_embedding, training_embeddings[i], cv::NORM_L2SQR);
+                if (dist < min_dist) {
+                    min_dist = dist;
+                    best_label = training_labels[i];
+                }
+            }
+            RegionStats &r = regions[first + k];
+            if (min_dist < DNN_DISTANCE_THRESHOLD) {
+                r.dnn_label = best_label;
+            } else {
+                r.dnn_label = "Unknown"; // Too far from any training example
             }
-        }
-        if (min_dist < DNN_DISTANCE_THRESHOLD) {
-            r.dnn_label = best_label;
-        } else {
-            r.dnn_label = "Unknown"; // Too far from any training example
         }
     }
     return 0;
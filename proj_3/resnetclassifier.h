@@ -8,6 +8,7 @@
 #define RESNETCLASSIFIER_H
 
 #include <cstdio>
+#include <algorithm>
 #include <cstring>
 #include <filesystem>
 #include "opencv2/opencv.hpp"
@@ -24,6 +25,17 @@ inline const std::string resnet_file_path = "resnet18-v2-7.onnx";
 // Window title for ResNet training mode display
 inline const std::string dnn_training_img_display_window_name = "ResNet18 image training";
 
+// Side of the square image the network takes
+inline const int resnet_input_size = 224;
+
+// Default largest number of regions embedded by one forward pass
+inline const int resnet_default_max_batch = 16;
+
+// Version of the crops fed to the network. Bump whenever prepEmbeddingImage changes what the crops look like.
+// 2: one rotate+crop+scale warp, no ROI rectangle drawn into the crop
+inline const int resnet_crop_version = 2;
+inline const std::string resnet_version_key = "#crop_version"; // Label of the first row of the embeddings CSV
+
 // Distance threshold for ResNet classification (L2 squared distance in embedding space)
 inline const double DNN_DISTANCE_THRESHOLD = 200.0;
 
@@ -50,9 +62,13 @@ class ResNetClassifier {
     fs::path resnet_path; // Path to ONNX model file
     fs::path db_file_path; // Path to embeddings database CSV
     int starting_datapoint_count; // Number of examples loaded from file
+    bool db_stale; // True if the embeddings CSV was written for other crops (never read or appended to)
     std::vector<cv::Mat> training_embeddings; // 512D embedding vectors for training examples
     std::vector<std::string> training_labels; // Labels for training examples
     std::set<std::string> labels_set; // Set of unique labels
+    int max_batch; // Largest number of regions per forward pass
+    std::vector<cv::Mat> crops; // Network inputs of the current frame, one per region (reused across frames)
+    cv::Mat blob; // NCHW input blob (reused across frames)
 
     /**
      * Extracts 512-dimensional embedding from preprocessed 224x224 image.
@@ -64,11 +80,22 @@ class ResNetClassifier {
      */
     int getEmbedding(const cv::Mat &src, cv::Mat &embedding, int debug);
 
+    /**
+     * Embeds a batch of preprocessed images with one forward pass.
+     * @param srcs preprocessed images (224x224)
+     * @param first first image of the batch
+     * @param count number of images in the batch
+     * @param embeddings output, one 512D row per image
+     * @return 0 if successful
+     */
+    int getEmbeddings(const std::vector<cv::Mat> &srcs, int first, int count, cv::Mat &embeddings);
+
     /**
      * Preprocesses object for ResNet input following standard pipeline:
      * Rotates image to align principal axis, extracts ROI, resizes to 224x224.
+     * All three are one warpAffine that samples only the ROI's footprint in the frame.
      * @param frame original color image
-     * @param embimage output preprocessed image
+     * @param embimage output preprocessed image (224x224)
      * @param cx centroid x-coordinate
      * @param cy centroid y-coordinate
      * @param theta principal axis angle in radians
@@ -84,12 +111,14 @@ class ResNetClassifier {
 
     /**
      * Loads training embeddings and labels from CSV file.
+     * A file whose first row is not resnet_version_key with the current resnet_crop_version is refused as stale.
      * @return 0 if successful
      */
     int load_data_from_csv();
 
     /**
-     * Appends newly collected training examples to CSV file.
+     * Appends newly collected training examples to CSV file, starting a new file with the version row.
+     * Nothing is written to a stale file.
      * @return 0 if successful
      */
     int write_trained_data_to_csv();
@@ -141,8 +170,16 @@ public:
      */
     int train(const cv::Mat &original_frame, const std::vector<RegionStats> &regions);
 
+    /**
+     * Sets how many regions may share one forward pass.
+     * @param n maximum batch size (at least 1)
+     * @return 0 if successful
+     */
+    int set_max_batch(int n);
+
     /**
      * Classifies regions using nearest-neighbor in ResNet embedding space.
+     * All regions of the frame are preprocessed first and embedded in batches of up to max_batch.
      * @param original_frame original color frame
      * @param regions detected regions (dnn_label assigned to each)
      * @return 0 if successful
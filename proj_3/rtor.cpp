@@ -102,11 +102,8 @@ int RTObectRecognizer::run() {
             std::cout << "White screen captured! Starting object recognition..." << std::endl;
         }
 
-        this->threshold.threshold(this->main_frame, this->bin_frame, this->threshold_mode);
-        morph(this->bin_frame, this->morph_frame);
-
         std::vector<RegionStats> region_stats;
-        this->segment.make_segments(this->morph_frame, this->label_map, region_stats);
+        this->process_frame(region_stats);
         this->feature.calculate_basic_2d_features(region_stats);
 
         if (this->classifier.has_training_data()) {
@@ -140,6 +137,48 @@ int RTObectRecognizer::run() {
     return 0;
 }
 
+int RTObectRecognizer::process_frame(std::vector<RegionStats> &regions) {
+    const int rows = this->main_frame.rows;
+    const int cols = this->main_frame.cols;
+    const bool keep_binary = this->show_binary;
+    const bool keep_morph = this->show_morphology;
+    if (keep_binary) {
+        this->bin_frame.create(rows, cols, CV_8UC1);
+    }
+    if (keep_morph) {
+        this->morph_frame.create(rows, cols, CV_8UC1);
+    }
+
+    this->threshold.begin_frame(this->main_frame, this->threshold_mode);
+    this->segment.begin_frame(rows, cols);
+    int morph_y = 0;
+    MorphPipeline pipeline(rows, cols, [&](const uint64_t *row) {
+        if (keep_morph) {
+            unpack_row(row, cols, this->morph_frame.ptr<uchar>(morph_y));
+        }
+        morph_y++;
+        this->segment.add_row(row);
+    });
+
+    std::vector<uint64_t> packed((cols + packed_word_bits - 1) / packed_word_bits);
+    for (int first = 0; first < rows; first += strip_rows) {
+        const int end = std::min(rows, first + strip_rows);
+        cv::Mat bin_rows;
+        if (keep_binary) {
+            bin_rows = this->bin_frame.rowRange(first, end);
+        } else {
+            this->strip.create(strip_rows, cols, CV_8UC1);
+            bin_rows = this->strip.rowRange(0, end - first);
+        }
+        this->threshold.threshold_rows(this->main_frame, first, end, bin_rows);
+        for (int y = 0; y < end - first; y++) {
+            pack_row(bin_rows.ptr<uchar>(y), cols, packed.data());
+            pipeline.push(packed.data());
+        }
+    }
+    return this->segment.finish_frame(regions);
+}
+
 int RTObectRecognizer::handle_key(int key, std::vector<RegionStats> &regions) {
     switch (key) {
         case 'r': // Will enable predictions by the model in addition to normal predictions
@@ -174,6 +213,7 @@ int RTObectRecognizer::handle_key(int key, std::vector<RegionStats> &regions) {
             break;
 
         case 'n': // Train the classic classifier on the regions available in the frame.
+            this->segment.paint_labels(this->label_map);
             this->classifier.train_on_all_segments(this->main_frame, this->label_map, regions);
             break;
 
@@ -208,6 +248,15 @@ int RTObectRecognizer::handle_key(int key, std::vector<RegionStats> &regions) {
             const std::string overlay_image_path = overlay_image_filename + time_now_str + image_save_format;
             cv::imwrite(overlay_image_path, this->display_frame);
 
+            // The streaming front end skips the images whose window is hidden. Rebuild only those, with the
+            // thresholder already fitted to this frame, so they match what the regions were segmented from.
+            if (!this->show_binary) {
+                this->bin_frame.create(this->main_frame.rows, this->main_frame.cols, CV_8UC1);
+                this->threshold.threshold_rows(this->main_frame, 0, this->main_frame.rows, this->bin_frame);
+            }
+            if (!this->show_morphology) {
+                morph(this->bin_frame, this->morph_frame);
+            }
             const std::string threshold_image_path = threshold_image_filename + time_now_str + image_save_format;
             cv::imwrite(threshold_image_path, this->bin_frame);
 
@@ -34,6 +34,9 @@ inline const std::string cleaned_morph_window = "Morphology-Cleaned up image";
 // Default thresholding mode (0 = k-means, 1 = white background subtraction)
 inline const int starter_threshold_mode = 0;
 
+// Rows thresholded at a time by the streaming front end
+inline const int strip_rows = 16;
+
 // Filename prefixes for saving captured frames
 inline const std::string main_image_filename = "original_";
 inline const std::string overlay_image_filename = "overlayed_";
@@ -61,9 +64,10 @@ class RTObectRecognizer {
     cv::Mat main_frame; // Original color frame from camera
     cv::Mat display_frame; // Frame with overlays for display
     bool white_screen_set; // Flag for white background captured
-    cv::Mat bin_frame; // Binary thresholded image
-    cv::Mat morph_frame; // Morphologically cleaned image
-    cv::Mat label_map; // Region labels from connected components
+    cv::Mat bin_frame; // Binary thresholded image (only filled while shown or when saving)
+    cv::Mat morph_frame; // Morphologically cleaned image (only filled while shown or when saving)
+    cv::Mat strip; // Thresholded rows of the current strip when bin_frame is not filled
+    cv::Mat label_map; // Region labels from connected components (painted on demand)
 
     const fs::path &db_filepath; // Path to hand-crafted features database
 
@@ -90,6 +94,15 @@ class RTObectRecognizer {
      */
     int resnet_setup();
 
+    /**
+     * Streaming front end: thresholds the frame strip by strip, pushes each binary row through the packed
+     * morphology pipeline and labels cleaned rows as they leave it, so regions come out of one rolling window of
+     * rows. bin_frame / morph_frame are written only while their windows are shown.
+     * @param regions output region statistics
+     * @return 0 if successful
+     */
+    int process_frame(std::vector<RegionStats> &regions);
+
     /**
      * Handles keyboard input for training, display toggles, and mode switching.
      * @param key pressed key code
@@ -0,0 +1,60 @@
+//
+// Created by Ajey K on 18/10/26.
+//
+
+#include <algorithm>
+#include <cmath>
+
+#include "running_stats.h"
+
+RunningStats::RunningStats(int dims) {
+    this->mu.assign(dims, 0.0);
+    this->m2.assign(dims, 0.0);
+}
+
+RunningStats::RunningStats(long count, const std::vector<double> &mean, const std::vector<double> &variance) {
+    this->n = count;
+    this->mu = mean;
+    this->m2.resize(variance.size());
+    for (size_t j = 0; j < variance.size(); j++) {
+        this->m2[j] = variance[j] * count;
+    }
+}
+
+int RunningStats::add(const std::vector<float> &x) {
+    if (x.size() != this->mu.size()) {
+        return -1;
+    }
+    this->n++;
+    for (size_t j = 0; j < x.size(); j++) {
+        const double delta = x[j] - this->mu[j];
+        this->mu[j] += delta / this->n;
+        this->m2[j] += delta * (x[j] - this->mu[j]);
+    }
+    return 0;
+}
+
+long RunningStats::count() const {
+    return this->n;
+}
+
+const std::vector<double> &RunningStats::mean() const {
+    return this->mu;
+}
+
+double RunningStats::variance(int j) const {
+    return this->n > 0 ? this->m2[j] / this->n : 0.0;
+}
+
+double RunningStats::sum_sq(int j) const {
+    return this->m2[j];
+}
+
+double RunningStats::mahalanobis(const std::vector<float> &x, double min_variance) const {
+    double sum = 0.0;
+    for (size_t j = 0; j < this->mu.size() && j < x.size(); j++) {
+        const double diff = x[j] - this->mu[j];
+        sum += diff * diff / std::max(this->variance(static_cast<int>(j)), min_variance);
+    }
+    return std::sqrt(sum);
+}
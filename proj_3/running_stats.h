@@ -0,0 +1,74 @@
+//
+// Created by Ajey K on 18/10/26.
+// Header file for running (Welford) feature statistics.
+// Means and variances are updated in O(dims) per added sample, so the Classifier never rescans its training set.
+//
+
+#ifndef RUNNING_STATS_H
+#define RUNNING_STATS_H
+
+#include <vector>
+
+/**
+ * Welford accumulator for the per-dimension mean and variance of a stream of feature vectors.
+ */
+class RunningStats {
+    long n = 0; // Samples added
+    std::vector<double> mu; // Running mean of each dimension
+    std::vector<double> m2; // Running sum of squared deviations from the mean
+
+public:
+    RunningStats() {
+    };
+
+    /**
+     * Constructor for RunningStats.
+     * @param dims vector length
+     */
+    explicit RunningStats(int dims);
+
+    /**
+     * Restores a saved state.
+     * @param count number of samples
+     * @param mean per-dimension means
+     * @param variance per-dimension population variances
+     */
+    RunningStats(long count, const std::vector<double> &mean, const std::vector<double> &variance);
+
+    /**
+     * Adds one sample.
+     * @param x feature vector (same length as the accumulator)
+     * @return 0 if successful, -1 if x has the wrong length
+     */
+    int add(const std::vector<float> &x);
+
+    /**
+     * @return number of samples
+     */
+    long count() const;
+
+    /**
+     * @return per-dimension means
+     */
+    const std::vector<double> &mean() const;
+
+    /**
+     * Population variance of one dimension (0 before any sample).
+     */
+    double variance(int j) const;
+
+    /**
+     * Sum of squared deviations of one dimension, for pooling variances across classes.
+     */
+    double sum_sq(int j) const;
+
+    /**
+     * Diagonal Mahalanobis distance of x from the mean.
+     * @param x feature vector
+     * @param min_variance floor for each variance, so that constant dimensions do not dominate
+     * @return distance
+     */
+    double mahalanobis(const std::vector<float> &x, double min_variance) const;
+};
+
+#endif //RUNNING_STATS_H
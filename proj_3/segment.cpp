@@ -2,29 +2,229 @@
 // Created by Ajey K on 21/02/26.
 //
 
+#include <algorithm>
+#include <bit>
+#include <climits>
+
 #include "segment.h"
 
-int Segment::make_segments(const cv::Mat &src, cv::Mat &label_map, std::vector<RegionStats> &regions) {
-    // std::cout << "Entered Segment::make_segments" << std::endl;
-    cv::Mat stats;
-    cv::Mat centroids;
+int RunLabeller::find(int l) {
+    while (this->parent[l] != l) {
+        this->parent[l] = this->parent[this->parent[l]];
+        l = this->parent[l];
+    }
+    return l;
+}
+
+int RunLabeller::unite(int a, int b) {
+    a = this->find(a);
+    b = this->find(b);
+    if (a == b) {
+        return a;
+    }
+    if (b < a) {
+        std::swap(a, b);
+    }
+    this->parent[b] = a;
+    RegionAccumulator &to = this->acc[a];
+    const RegionAccumulator &from = this->acc[b];
+    to.m00 += from.m00;
+    to.m10 += from.m10;
+    to.m01 += from.m01;
+    to.m20 += from.m20;
+    to.m11 += from.m11;
+    to.m02 += from.m02;
+    to.m30 += from.m30;
+    to.m21 += from.m21;
+    to.m12 += from.m12;
+    to.m03 += from.m03;
+    to.min_x = std::min(to.min_x, from.min_x);
+    to.min_y = std::min(to.min_y, from.min_y);
+    to.max_x = std::max(to.max_x, from.max_x);
+    to.max_y = std::max(to.max_y, from.max_y);
+    return a;
+}
 
-    const int num_regions = cv::connectedComponentsWithStats(src, label_map, stats, centroids);
+int RunLabeller::begin(int rows, int cols) {
+    this->rows = rows;
+    this->next_row = 0;
+    this->runs.clear();
+    this->prev_begin = 0;
+    this->prev_end = 0;
+    this->parent.clear();
+    this->acc.clear();
+    if (cols != this->cols || this->sx1.empty()) {
+        // Every partial sum is an integer below 2^53, so they are exact.
+        this->cols = cols;
+        this->sx1.assign(cols + 1, 0.0);
+        this->sx2.assign(cols + 1, 0.0);
+        this->sx3.assign(cols + 1, 0.0);
+        for (int x = 0; x < cols; x++) {
+            const double fx = x;
+            this->sx1[x + 1] = this->sx1[x] + fx;
+            this->sx2[x + 1] = this->sx2[x] + fx * fx;
+            this->sx3[x + 1] = this->sx3[x] + fx * fx * fx;
+        }
+    }
+    return 0;
+}
+
+void RunLabeller::add_run(int x0, int x1, size_t &j) {
+    // 8-connectivity: a run of the previous row touches [x0, x1] if it reaches into [x0 - 1, x1 + 1]
+    while (j < this->prev_end && this->runs[j].x1 < x0 - 1) {
+        j++;
+    }
+    int label = -1;
+    for (size_t k = j; k < this->prev_end && this->runs[k].x0 <= x1 + 1; k++) {
+        label = label < 0 ? this->find(this->runs[k].label) : this->unite(label, this->runs[k].label);
+    }
+    if (label < 0) {
+        label = static_cast<int>(this->parent.size());
+        this->parent.push_back(label);
+        RegionAccumulator empty = {};
+        empty.min_x = INT_MAX;
+        empty.min_y = INT_MAX;
+        empty.max_x = -1;
+        empty.max_y = -1;
+        this->acc.push_back(empty);
+    }
+    const int y = this->next_row;
+    this->runs.push_back({y, x0, x1, label});
+
+    RegionAccumulator &a = this->acc[label];
+    const double fy = y;
+    const double n = x1 - x0 + 1;
+    const double s1 = this->sx1[x1 + 1] - this->sx1[x0];
+    const double s2 = this->sx2[x1 + 1] - this->sx2[x0];
+    const double s3 = this->sx3[x1 + 1] - this->sx3[x0];
+    a.m00 += n;
+    a.m10 += s1;
+    a.m01 += n * fy;
+    a.m20 += s2;
+    a.m11 += s1 * fy;
+    a.m02 += n * fy * fy;
+    a.m30 += s3;
+    a.m21 += s2 * fy;
+    a.m12 += s1 * fy * fy;
+    a.m03 += n * fy * fy * fy;
+    a.min_x = std::min(a.min_x, x0);
+    a.max_x = std::max(a.max_x, x1);
+    a.min_y = std::min(a.min_y, y);
+    a.max_y = y;
+}
+
+int RunLabeller::push_row(const uint64_t *row) {
+    const size_t row_begin = this->runs.size();
+    const int words = (this->cols + packed_word_bits - 1) / packed_word_bits;
+    const int tail = this->cols % packed_word_bits;
+    size_t j = this->prev_begin;
+    int start = -1; // First column of the run being read, -1 between runs
+    for (int w = 0; w < words; w++) {
+        uint64_t bits = row[w];
+        if (w == words - 1 && tail != 0) {
+            bits &= (1ULL << tail) - 1;
+        }
+        int pos = 0;
+        while (pos < packed_word_bits) {
+            if (start < 0) {
+                const uint64_t ones = bits >> pos;
+                if (ones == 0) {
+                    break;
+                }
+                pos += std::countr_zero(ones);
+                start = w * packed_word_bits + pos;
+            }
+            const uint64_t zeros = ~bits >> pos; // Top bits shift in as 0, i.e. the run may go on in the next word
+            if (zeros == 0) {
+                break;
+            }
+            pos += std::countr_zero(zeros);
+            this->add_run(start, w * packed_word_bits + pos - 1, j);
+            start = -1;
+        }
+    }
+    if (start >= 0) {
+        this->add_run(start, this->cols - 1, j);
+    }
+    this->prev_begin = row_begin;
+    this->prev_end = this->runs.size();
+    this->next_row++;
+    return 0;
+}
+
+int RunLabeller::finish(std::vector<RegionAccumulator> &regions) {
+    std::vector<int> region_of(this->parent.size(), 0);
+    regions.assign(1, RegionAccumulator{}); // Background
+    for (PixelRun &r: this->runs) {
+        const int root = this->find(r.label);
+        if (region_of[root] == 0) {
+            region_of[root] = static_cast<int>(regions.size());
+            regions.push_back(this->acc[root]);
+        }
+        r.label = region_of[root];
+    }
+    return static_cast<int>(regions.size());
+}
+
+const std::vector<PixelRun> &RunLabeller::get_runs() const {
+    return this->runs;
+}
+
+int RunLabeller::paint(cv::Mat &label_map) const {
+    label_map.create(this->rows, this->cols, CV_32S);
+    label_map.setTo(cv::Scalar(0));
+    for (const PixelRun &r: this->runs) {
+        int *ptr = label_map.ptr<int>(r.y);
+        std::fill(ptr + r.x0, ptr + r.x1 + 1, r.label);
+    }
+    return 0;
+}
+
+int Segment::begin_frame(int rows, int cols) {
+    return this->labeller.begin(rows, cols);
+}
+
+int Segment::add_row(const uint64_t *row) {
+    return this->labeller.push_row(row);
+}
+
+int Segment::finish_frame(std::vector<RegionStats> &regions) {
+    // std::cout << "Entered Segment::finish_frame" << std::endl;
+    std::vector<RegionAccumulator> acc;
+    const int num_regions = this->labeller.finish(acc);
     // std::cout << "Detected Regions: " << num_regions << std::endl;
+
+    // Group the runs by region (counting sort, raster order kept within a region)
+    const std::vector<PixelRun> &runs = this->labeller.get_runs();
+    std::vector<size_t> offsets(num_regions + 1, 0);
+    for (const PixelRun &r: runs) {
+        offsets[r.label + 1]++;
+    }
+    for (int i = 0; i < num_regions; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    std::vector<PixelRun> by_region(runs.size());
+    std::vector<size_t> fill_pos(offsets.begin(), offsets.end() - 1);
+    for (const PixelRun &r: runs) {
+        by_region[fill_pos[r.label]++] = r;
+    }
+
     // region id = 0 is background. Skipping it.
     for (int i = 1; i < num_regions; i++) {
-        cv::Mat mask = (label_map == i);
-        const cv::Moments mi = cv::moments(mask, true);
-
-        // std::cout << "Moment area " << i << ": " << mi.m00 << std::endl;
-        if (mi.m00 < min_area_pix) {
+        const RegionAccumulator &a = acc[i];
+        // std::cout << "Moment area " << i << ": " << a.m00 << std::endl;
+        if (a.m00 < min_area_pix) {
             continue;
         }
+        const cv::Moments mi(a.m00, a.m10, a.m01, a.m20, a.m11, a.m02, a.m30, a.m21, a.m12, a.m03);
+        const PixelRun *first = by_region.data() + offsets[i];
+        const PixelRun *last = by_region.data() + offsets[i + 1];
 
         RegionStats r;
         r.region_id = i;
         r.moments = mi;
         r.centroid = cv::Point2f(mi.m10 / mi.m00, mi.m01 / mi.m00);
+        r.bbox = cv::Rect(a.min_x, a.min_y, a.max_x - a.min_x + 1, a.max_y - a.min_y + 1);
         r.dnn_label = "";
 
         double mu20 = mi.mu20 / mi.m00;
@@ -32,7 +232,7 @@ int Segment::make_segments(const cv::Mat &src, cv::Mat &label_map, std::vector<R
         double mu11 = mi.mu11 / mi.m00;
         r.angle = 0.5 * std::atan2(2 * mu11, mu20 - mu02); // in radians
 
-        r.axisExtent = compute_extents(label_map, i, r.centroid, r.angle);
+        r.axisExtent = compute_extents(first, last, r.centroid, r.angle);
         // std::cout << "minE1 should be negative, maxE1 should be positive" << std::endl;
         // std::cout << "Computed extents: minE1=" << r.axisExtent.minE1
         //   << " maxE1=" << r.axisExtent.maxE1 << std::endl;
@@ -43,7 +243,14 @@ int Segment::make_segments(const cv::Mat &src, cv::Mat &label_map, std::vector<R
         // cv::findNonZero(mask, pts);
         // r.oriented_box = cv::minAreaRect(pts);
         r.contours.clear();
-        cv::findContours(mask, r.contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+        // Only this region is drawn in the mask, so tracing inside the box finds the same contours as the full
+        // frame. The offset moves them back to frame coordinates.
+        cv::Mat mask = cv::Mat::zeros(r.bbox.height, r.bbox.width, CV_8UC1);
+        for (const PixelRun *run = first; run != last; run++) {
+            uchar *ptr = mask.ptr<uchar>(run->y - r.bbox.y);
+            std::fill(ptr + run->x0 - r.bbox.x, ptr + run->x1 - r.bbox.x + 1, 255);
+        }
+        cv::findContours(mask, r.contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE, r.bbox.tl());
 
         regions.push_back(r);
         // std::cout << "Computed extents at end: minE1=" << r.axisExtent.minE1
@@ -51,11 +258,26 @@ int Segment::make_segments(const cv::Mat &src, cv::Mat &label_map, std::vector<R
         // std::cout << "Computed extents: minE2=" << r.axisExtent.minE2
         //   << " maxE2=" << r.axisExtent.maxE2 << std::endl;
     }
-    // std::cout << "Completed Segment::make_segments" << std::endl;
+    // std::cout << "Completed Segment::finish_frame" << std::endl;
     return 0;
 }
 
-AxisExtent Segment::compute_extents(const cv::Mat &label_map, int region_id,
+int Segment::paint_labels(cv::Mat &label_map) {
+    return this->labeller.paint(label_map);
+}
+
+int Segment::make_segments(const cv::Mat &src, cv::Mat &label_map, std::vector<RegionStats> &regions) {
+    this->begin_frame(src.rows, src.cols);
+    std::vector<uint64_t> row((src.cols + packed_word_bits - 1) / packed_word_bits);
+    for (int y = 0; y < src.rows; y++) {
+        pack_row(src.ptr<uchar>(y), src.cols, row.data());
+        this->add_row(row.data());
+    }
+    this->finish_frame(regions);
+    return this->paint_labels(label_map);
+}
+
+AxisExtent Segment::compute_extents(const PixelRun *first, const PixelRun *last,
                                     const cv::Point2f &centroid, float angle_rad) {
     AxisExtent ext;
     ext.minE1 = FLT_MAX;
@@ -66,15 +288,14 @@ AxisExtent Segment::compute_extents(const cv::Mat &label_map, int region_id,
     float cos_theta = cos(angle_rad);
     float sin_theta = sin(angle_rad);
 
-    // Project ALL pixels in this region
-    for (int i = 0; i < label_map.rows; i++) {
-        const int *ptr = label_map.ptr<int>(i);
-        for (int j = 0; j < label_map.cols; j++) {
-            if (ptr[j] != region_id) continue; // Skip other regions
-
+    // Project ALL pixels in this region. Along a run both projections are monotonic in x, so the extreme values
+    // are at its two ends.
+    for (const PixelRun *run = first; run != last; run++) {
+        const int ends[2] = {run->x0, run->x1};
+        for (int j: ends) {
             // Vector from centroid to this pixel
             float dx = j - centroid.x;
-            float dy = i - centroid.y;
+            float dy = run->y - centroid.y;
 
             // Project onto major axis
             float proj_major = dx * cos_theta + dy * sin_theta;
@@ -2,6 +2,7 @@
 // Created by Ajey K on 21/02/26.
 // Header file for Segmentation and Region Tracking modules.
 // Implements connected components analysis, region property computation, and temporal tracking.
+// Labelling is run-length and streams packed rows from the morphology pipeline.
 //
 
 #ifndef SEGMENT_H
@@ -11,7 +12,11 @@
 #include <opencv2/imgproc.hpp>
 
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <vector>
+
+#include "morph.h"
 
 // Minimum region area (pixels) for object detection - filters out noise
 inline const int min_area_pix = 4000;
@@ -34,6 +39,100 @@ struct AxisExtent {
     float maxE2; // Maximum extent along minor axis (positive value)
 };
 
+/**
+ * Running sums for one label, accumulated run by run while the frame is labelled.
+ * Raw moments up to third order (enough for cv::Moments to derive central and Hu moments) and the bounding box.
+ */
+struct RegionAccumulator {
+    double m00, m10, m01; // Pixel count and first order raw moments
+    double m20, m11, m02; // Second order raw moments
+    double m30, m21, m12, m03; // Third order raw moments
+    int min_x, min_y, max_x, max_y; // Bounding box (inclusive)
+};
+
+/**
+ * A horizontal run of foreground pixels in one row.
+ */
+struct PixelRun {
+    int y; // Row
+    int x0; // First column
+    int x1; // Last column (inclusive)
+    int label; // Provisional label while labelling, region id after RunLabeller::finish
+};
+
+/**
+ * Streaming run-length connected components labelling (8-connectivity, like cv::connectedComponents).
+ * Rows arrive packed and top to bottom. Each row is split into runs, runs touching runs of the previous row are
+ * joined with union-find, and every run adds its moment sums to its label straight away, merging sums when two
+ * labels join. Only the runs are kept; a label map is painted from them on request.
+ */
+class RunLabeller {
+    int rows = 0; // Image height
+    int cols = 0; // Image width
+    int next_row = 0; // Row the next push_row call labels
+    std::vector<PixelRun> runs; // All runs so far, in raster order
+    size_t prev_begin = 0; // Runs of the previous row are runs[prev_begin, prev_end)
+    size_t prev_end = 0;
+    std::vector<int> parent; // Union-find forest over provisional labels
+    std::vector<RegionAccumulator> acc; // Sums of every provisional label (complete at roots)
+    std::vector<double> sx1; // Prefix sums of x, x^2 and x^3 along a row
+    std::vector<double> sx2;
+    std::vector<double> sx3;
+
+    /**
+     * Root of a provisional label, halving paths on the way.
+     */
+    int find(int l);
+
+    /**
+     * Joins two provisional labels; the older root survives and takes the other's sums.
+     * @return surviving root
+     */
+    int unite(int a, int b);
+
+    /**
+     * Appends a run of the current row and connects it to the previous row.
+     * @param j first run of the previous row that may still touch this or later runs (advanced in place)
+     */
+    void add_run(int x0, int x1, size_t &j);
+
+public:
+    /**
+     * Starts a new frame.
+     * @param rows image height
+     * @param cols image width
+     * @return 0 if successful
+     */
+    int begin(int rows, int cols);
+
+    /**
+     * Labels the next row.
+     * @param row packed binary row (see morph.h)
+     * @return 0 if successful
+     */
+    int push_row(const uint64_t *row);
+
+    /**
+     * Resolves labels after the last row. Regions are numbered from 1 in raster order of their first pixel, as
+     * cv::connectedComponents numbers them, and every run is relabelled with its region id.
+     * @param regions output sums indexed by region id (index 0, the background, is empty)
+     * @return number of labels including the background
+     */
+    int finish(std::vector<RegionAccumulator> &regions);
+
+    /**
+     * @return runs of the frame, in raster order
+     */
+    const std::vector<PixelRun> &get_runs() const;
+
+    /**
+     * Paints the label map of the finished frame.
+     * @param label_map output CV_32S image (0 = background)
+     * @return 0 if successful
+     */
+    int paint(cv::Mat &label_map) const;
+};
+
 /**
  * Complete statistics and properties for a detected region.
  * Stores geometric, moment-based, and classification information.
@@ -42,6 +141,7 @@ struct RegionStats {
     int region_id; // Region label from connected components
     cv::Moments moments; // Image moments (spatial, central, normalized)
     cv::Point centroid; // Center of mass
+    cv::Rect bbox; // Axis-aligned bounding box
     float angle; // Principal axis angle in radians
     cv::RotatedRect oriented_box; // Oriented bounding box
     std::vector<std::vector<cv::Point> > contours; // Region boundary contours
@@ -56,12 +156,47 @@ struct RegionStats {
 /**
  * Segmentation module using connected components analysis.
  * Extracts regions, computes moments, principal axes, and extent values.
+ * A frame is either segmented whole (make_segments) or streamed: begin_frame, add_row for every cleaned row as
+ * it becomes available, then finish_frame.
  */
 class Segment {
+    RunLabeller labeller; // Runs and region sums of the current frame
+
 public:
     Segment() {
     };
 
+    /**
+     * Starts labelling a streamed frame.
+     * @param rows image height
+     * @param cols image width
+     * @return 0 if successful
+     */
+    int begin_frame(int rows, int cols);
+
+    /**
+     * Labels the next row of a streamed frame.
+     * @param row packed binary row
+     * @return 0 if successful
+     */
+    int add_row(const uint64_t *row);
+
+    /**
+     * Computes region properties once every row has been added.
+     * Small regions are filtered out; extents come from the end points of each region's runs and contours are
+     * traced in a mask of its bounding box.
+     * @param regions output vector of region statistics
+     * @return 0 if successful
+     */
+    int finish_frame(std::vector<RegionStats> &regions);
+
+    /**
+     * Paints the label map of the last finished frame, for consumers that need it (classic training).
+     * @param label_map output region map (each region has unique ID)
+     * @return 0 if successful
+     */
+    int paint_labels(cv::Mat &label_map);
+
     /**
      * Performs connected components analysis and computes region properties.
      * Filters small regions, computes moments, principal axes, and extents.
@@ -74,14 +209,16 @@ public:
 
     /**
      * Computes actual object extents by projecting all region pixels onto principal axes.
-     * Provides precise measurements for asymmetric or irregular shapes.
-     * @param label_map region label map
-     * @param region_id ID of region to analyze
+     * Provides precise measurements for asymmetric or irregular shapes. Projections are linear along a row, so
+     * only the end points of each run need projecting.
+     * @param first first run of the region
+     * @param last one past the last run of the region
      * @param centroid center of mass
      * @param angle_rad principal axis angle in radians
      * @return AxisExtent with min/max projections along both axes
      */
-    AxisExtent compute_extents(const cv::Mat &label_map, int region_id, const cv::Point2f &centroid, float angle_rad);
+    AxisExtent compute_extents(const PixelRun *first, const PixelRun *last, const cv::Point2f &centroid,
+                               float angle_rad);
 
     /**
      * Creates oriented bounding box from computed extents.
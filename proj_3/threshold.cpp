@@ -4,101 +4,130 @@
 
 #include "threshold.h"
 
-int Threshold::dynamic_threshold(cv::Mat &src, cv::Mat &dst) {
-    std::vector<cv::Vec3b> pixels;
-    for (int i = 0; i < src.rows; i += 4) {
-        cv::Vec3b *ptr = src.ptr<cv::Vec3b>(i);
-        for (int j = 0; j < src.cols; j += 4) {
-            pixels.push_back(ptr[j]);
-        }
-    }
+/**
+ * Squared colour distance between two pixels.
+ */
+static long sq_dist(const cv::Vec3b &a, const cv::Vec3b &b) {
+    long d0 = a[0] - b[0];
+    long d1 = a[1] - b[1];
+    long d2 = a[2] - b[2];
+    return d0 * d0 + d1 * d1 + d2 * d2;
+}
 
-    // K means
-    cv::Vec3b mean1(0, 0, 0); // Center of fg
-    cv::Vec3b mean2(255, 255, 255); // Center of bg
+void Threshold::update_means() {
+    cv::Vec3b mean1 = this->warm ? this->fg_mean : cv::Vec3b(0, 0, 0); // Center of fg
+    cv::Vec3b mean2 = this->warm ? this->bg_mean : cv::Vec3b(255, 255, 255); // Center of bg
+    bool empty_cluster = false;
 
     for (int i = 0; i < kmeans_max_iter; i++) {
-        float cluster1_b = 0.0, cluster2_b = 0.0;
-        float cluster1_g = 0.0, cluster2_g = 0.0;
-        float cluster1_r = 0.0, cluster2_r = 0.0;
-        int cluster1_count = 0;
-        int cluster2_count = 0;
+        long cluster1[3] = {0, 0, 0};
+        long cluster2[3] = {0, 0, 0};
+        long cluster1_count = 0;
+        long cluster2_count = 0;
 
-        for (cv::Vec3b &pt: pixels) {
-            long dist_from_mean1 = (mean1[0] - pt[0]) * (mean1[0] - pt[0]) + (mean1[1] - pt[1]) * (mean1[1] - pt[1]) + (
-                                       mean1[2] - pt[2]) * (mean1[2] - pt[2]);
-            long dist_from_mean2 = (mean2[0] - pt[0]) * (mean2[0] - pt[0]) + (mean2[1] - pt[1]) * (mean2[1] - pt[1]) + (
-                                       mean2[2] - pt[2]) * (mean2[2] - pt[2]);
-            if (dist_from_mean1 <= dist_from_mean2) {
-                cluster1_b += pt[0];
-                cluster1_g += pt[1];
-                cluster1_r += pt[2];
+        for (const cv::Vec3b &pt: this->samples) {
+            if (sq_dist(mean1, pt) <= sq_dist(mean2, pt)) {
+                cluster1[0] += pt[0];
+                cluster1[1] += pt[1];
+                cluster1[2] += pt[2];
                 cluster1_count++;
             } else {
-                cluster2_b += pt[0];
-                cluster2_g += pt[1];
-                cluster2_r += pt[2];
+                cluster2[0] += pt[0];
+                cluster2[1] += pt[1];
+                cluster2[2] += pt[2];
                 cluster2_count++;
             }
         }
-        auto c1_b = static_cast<uchar>(cluster1_b / cluster1_count);
-        auto c1_g = static_cast<uchar>(cluster1_g / cluster1_count);
-        auto c1_r = static_cast<uchar>(cluster1_r / cluster1_count);
-
-        auto c2_b = static_cast<uchar>(cluster2_b / cluster2_count);
-        auto c2_g = static_cast<uchar>(cluster2_g / cluster2_count);
-        auto c2_r = static_cast<uchar>(cluster2_r / cluster2_count);
-
-        cv::Vec3b new_mean1 = cv::Vec3b(c1_b, c1_g, c1_r);
-        cv::Vec3b new_mean2 = cv::Vec3b(c2_b, c2_g, c2_r);
+        empty_cluster = cluster1_count == 0 || cluster2_count == 0;
+        cv::Vec3b new_mean1 = mean1;
+        cv::Vec3b new_mean2 = mean2;
+        for (int c = 0; c < 3; c++) {
+            if (cluster1_count > 0) {
+                new_mean1[c] = static_cast<uchar>(cluster1[c] / cluster1_count);
+            }
+            if (cluster2_count > 0) {
+                new_mean2[c] = static_cast<uchar>(cluster2[c] / cluster2_count);
+            }
+        }
 
-        long ch1 = (mean1[0] - new_mean1[0]) * (mean1[0] - new_mean1[0]) + (mean1[1] - new_mean1[1]) * (
-                       mean1[1] - new_mean1[1]) + (mean1[2] - new_mean1[2]) * (mean1[2] - new_mean1[2]);
-        long ch2 = (mean2[0] - new_mean2[0]) * (mean2[0] - new_mean2[0]) + (mean2[1] - new_mean2[1]) * (
-                       mean2[1] - new_mean2[1]) + (mean2[2] - new_mean2[2]) * (mean2[2] - new_mean2[2]);
-        bool m1_stop = ch1 <= kmeans_stop_threshold;
-        bool m2_stop = ch2 <= kmeans_stop_threshold;
+        bool m1_stop = sq_dist(mean1, new_mean1) <= kmeans_stop_threshold;
+        bool m2_stop = sq_dist(mean2, new_mean2) <= kmeans_stop_threshold;
         mean1 = new_mean1;
         mean2 = new_mean2;
-        // std::cout << cluster1_count << " " << cluster2_count << std::endl;
         if (m1_stop && m2_stop) {
             // std::cout << "Kmeans converged in " << i << " iterations" << std::endl;
             break;
         }
     }
+    this->fg_mean = mean1;
+    this->bg_mean = mean2;
+    this->warm = !empty_cluster;
 
     // std::cout << "FG Center: (" << (int)mean1[0] << ", " << (int)mean1[1] << ", " << (int)mean1[2] << ")" << std::endl;
     // std::cout << "BG Center: (" << (int)mean2[0] << ", " << (int)mean2[1] << ", " << (int)mean2[2] << ")" << std::endl;
+}
+
+void Threshold::update_lut() {
+    long *w = this->plane_w; // 2 (bg - fg)
+    long &c = this->plane_c; // |bg|^2 - |fg|^2
+    c = 0;
+    for (int k = 0; k < 3; k++) {
+        w[k] = 2 * (this->bg_mean[k] - this->fg_mean[k]);
+        c += static_cast<long>(this->bg_mean[k]) * this->bg_mean[k] - static_cast<long>(this->fg_mean[k]) * this->fg_mean[k];
+    }
+    if (!this->lut.empty() && this->lut_fg_mean == this->fg_mean && this->lut_bg_mean == this->bg_mean) {
+        return;
+    }
+    this->lut.resize(lut_side * lut_side * lut_side);
+    int cell = 1 << lut_cell_bits;
+    uchar *out = this->lut.data();
+    for (int b = 0; b < lut_side; b++) {
+        for (int g = 0; g < lut_side; g++) {
+            for (int r = 0; r < lut_side; r++) {
+                // Smallest and largest w . p over the cell's box
+                int lo[3] = {b * cell, g * cell, r * cell};
+                long min_dot = 0;
+                long max_dot = 0;
+                for (int k = 0; k < 3; k++) {
+                    long a0 = w[k] * lo[k];
+                    long a1 = w[k] * (lo[k] + cell - 1);
+                    min_dot += std::min(a0, a1);
+                    max_dot += std::max(a0, a1);
+                }
+                *out++ = max_dot <= c ? lut_fg : (min_dot > c ? lut_bg : lut_mixed);
+            }
+        }
+    }
+    this->lut_fg_mean = this->fg_mean;
+    this->lut_bg_mean = this->bg_mean;
+}
 
-    dst.create(src.rows, src.cols, CV_8UC1);
-    for (int i = 0; i < src.rows; i++) {
-        cv::Vec3b *ptr = src.ptr<cv::Vec3b>(i);
-        uchar *dst_ptr = dst.ptr<uchar>(i);
+int Threshold::dynamic_threshold(const cv::Mat &src, int first, int end, cv::Mat &dst) {
+    // Foreground is the side of the plane nearer mean1 (dark objects), ties included. Background pixels
+    // (nearer the white mean2) get 0.
+    const long *w = this->plane_w;
+    const long c = this->plane_c;
+    const uchar *lut = this->lut.data();
+    dst.create(end - first, src.cols, CV_8UC1);
+    for (int i = first; i < end; i++) {
+        const uchar *ptr = src.ptr<uchar>(i);
+        uchar *dst_ptr = dst.ptr<uchar>(i - first);
         for (int j = 0; j < src.cols; j++) {
-            long dist_1 = (mean1[0] - ptr[j][0]) * (mean1[0] - ptr[j][0]) + (mean1[1] - ptr[j][1]) * (
-                              mean1[1] - ptr[j][1]) + (mean1[2] - ptr[j][2]) * (mean1[2] - ptr[j][2]);
-            long dist_2 = (mean2[0] - ptr[j][0]) * (mean2[0] - ptr[j][0]) + (mean2[1] - ptr[j][1]) * (
-                              mean2[1] - ptr[j][1]) + (mean2[2] - ptr[j][2]) * (mean2[2] - ptr[j][2]);
-            if (dist_1 <= dist_2) {
-                // If dist_1 <= dist_2  ==> It means the pt is closer to mean1 than mean2.
-                // mean1 was the center for black/darker objects. So it is a part of the fg.
-                // Assign 255
-                dst_ptr[j] = 255;
-            } else {
-                // Here dist2 > dist1. ==> Closer to mean2 than mean1.
-                // mean2 was white when initialized, so it will be the center of background pixels.
-                // Assign 0
-                dst_ptr[j] = 0;
+            const uchar *px = ptr + 3 * j;
+            uchar v = lut[((px[0] >> lut_cell_bits) * lut_side + (px[1] >> lut_cell_bits)) * lut_side + (px[2] >> lut_cell_bits)];
+            if (v == lut_mixed) {
+                v = w[0] * px[0] + w[1] * px[1] + w[2] * px[2] <= c ? lut_fg : lut_bg;
             }
+            dst_ptr[j] = v;
         }
     }
     // std::cout << "Thresholding done!" << std::endl;
     return 0;
 }
 
-int Threshold::white_screen_threshold(cv::Mat &src, cv::Mat &dst) {
+int Threshold::white_screen_threshold(const cv::Mat &src, int first, int end, cv::Mat &dst) {
     cv::Mat diff;
-    cv::absdiff(this->bg, src, diff);
+    cv::absdiff(this->bg.rowRange(first, end), src.rowRange(first, end), diff);
     cv::Mat grey_diff;
     cv::cvtColor(diff, grey_diff, cv::COLOR_RGB2GRAY);
     cv::threshold(grey_diff, dst, 10, 255, cv::THRESH_BINARY);
@@ -118,12 +147,30 @@ bool Threshold::pickup_white_screen(const cv::Mat &src) {
     }
 }
 
+int Threshold::begin_frame(const cv::Mat &src, const int mode) {
+    this->mode = this->callbacks.count(mode) != 0 ? mode : 0;
+    if (this->mode != 0) {
+        return 0;
+    }
+    this->samples.clear();
+    for (int i = 0; i < src.rows; i += kmeans_sample_step) {
+        const cv::Vec3b *ptr = src.ptr<cv::Vec3b>(i);
+        for (int j = 0; j < src.cols; j += kmeans_sample_step) {
+            this->samples.push_back(ptr[j]);
+        }
+    }
+    this->update_means();
+    this->update_lut();
+    return 0;
+}
+
+int Threshold::threshold_rows(const cv::Mat &src, int first, int end, cv::Mat &dst) {
+    return this->callbacks.at(this->mode)(src, first, end, dst);
+}
+
 int Threshold::threshold(cv::Mat &src, cv::Mat &dst, const int mode) {
     // cv::Mat tmp_blur;
     // cv::blur(src, tmp_blur, cv::Size(blurring_kernel_size, blurring_kernel_size));
-    std::map<int, ThresholdCallback>::const_iterator it = this->callbacks.find(mode);
-    if (it == this->callbacks.end()) {
-        return dynamic_threshold(src, dst);
-    }
-    return it->second(src, dst);
+    this->begin_frame(src, mode);
+    return this->threshold_rows(src, 0, src.rows, dst);
 }
@@ -16,13 +16,21 @@
 
 /**
  * Function pointer type for thresholding callback functions.
- * Takes source image and outputs binary image.
+ * Takes source image and a range of its rows [first, end), and outputs the binary image of those rows.
  */
-typedef std::function<int(cv::Mat &, cv::Mat &)> ThresholdCallback;
+typedef std::function<int(const cv::Mat &, int, int, cv::Mat &)> ThresholdCallback;
 
 // K-means algorithm parameters
 inline const int kmeans_max_iter = 10; // Maximum iterations for k-means convergence
 inline const int kmeans_stop_threshold = 1; // Convergence threshold (squared color distance)
+inline const int kmeans_sample_step = 4; // Every 4th row and column is sampled for k-means
+
+// Colour lookup table for the full-frame pass
+inline const int lut_cell_bits = 3; // Each LUT cell covers 8 values per channel (32x32x32 cells)
+inline const int lut_side = 256 >> lut_cell_bits; // Cells per channel
+inline const uchar lut_fg = 255; // Whole cell is closer to the foreground centre
+inline const uchar lut_bg = 0; // Whole cell is closer to the background centre
+inline const uchar lut_mixed = 1; // Cell straddles the decision plane, pixels are tested exactly
 
 // White background validation parameters
 inline const int white_highness = 245; // Minimum brightness for valid white background
@@ -40,31 +48,61 @@ inline const std::string bg_display_window_title = "Captured Bacground - Confirm
  */
 class Threshold {
     cv::Mat bg; // Reference background color for white screen method
+    cv::Vec3b fg_mean; // Foreground (dark) k-means centre of the previous frame
+    cv::Vec3b bg_mean; // Background (light) k-means centre of the previous frame
+    bool warm = false; // fg_mean / bg_mean hold a usable previous result
+    std::vector<cv::Vec3b> samples; // Sampled pixels, reused across frames
+    std::vector<uchar> lut; // lut_side^3 cells: lut_fg, lut_bg or lut_mixed
+    cv::Vec3b lut_fg_mean; // Centres the LUT was built for
+    cv::Vec3b lut_bg_mean;
+    long plane_w[3] = {0, 0, 0}; // 2 (bg - fg), normal of the decision plane
+    long plane_c = 0; // |bg|^2 - |fg|^2
+    int mode = 0; // Method chosen by begin_frame
+
+    /**
+     * Runs 2-means on the sampled pixels, starting from the previous frame's centres when there are any and from
+     * black / white otherwise. Consecutive frames barely change, so a warm start usually converges at once.
+     * A frame that leaves a cluster empty falls back to the black / white seeds on the next frame.
+     */
+    void update_means();
+
+    /**
+     * Rebuilds the colour LUT when the centres have moved. A pixel p is foreground when
+     * |p - fg|^2 <= |p - bg|^2, i.e. 2 (bg - fg) . p <= |bg|^2 - |fg|^2, a plane in colour space. Cells entirely on
+     * one side take that side's label; cells the plane cuts are marked lut_mixed. The plane itself is kept in
+     * plane_w / plane_c for those pixels.
+     */
+    void update_lut();
 
     /**
      * Dynamic k-means thresholding (mode 0).
-     * Samples 1/16 of pixels and clusters into foreground/background using k-means.
+     * Labels rows through the colour LUT (exact plane test for pixels in mixed cells). The clusters come from
+     * begin_frame, which samples 1/16 of the pixels and runs k-means on them.
      * @param src input color image
-     * @param dst output binary image (foreground = 255, background = 0)
+     * @param first first row to label
+     * @param end one past the last row to label
+     * @param dst output binary rows, end - first rows (foreground = 255, background = 0)
      * @return 0 if successful
      */
-    int dynamic_threshold(cv::Mat &src, cv::Mat &dst);
+    int dynamic_threshold(const cv::Mat &src, int first, int end, cv::Mat &dst);
 
     /**
      * White background subtraction thresholding (mode 1).
      * Classifies pixels by color distance from captured background reference.
      * @param src input color image
-     * @param dst output binary image
+     * @param first first row to label
+     * @param end one past the last row to label
+     * @param dst output binary rows, end - first rows
      * @return 0 if successful
      */
-    int white_screen_threshold(cv::Mat &src, cv::Mat &dst);
+    int white_screen_threshold(const cv::Mat &src, int first, int end, cv::Mat &dst);
 
     /**
      * Dispatch map for selecting thresholding method based on mode.
      */
     const std::map<int, ThresholdCallback> callbacks = {
-        {0, [this](cv::Mat &src, cv::Mat &dst) { return dynamic_threshold(src, dst); }},
-        {1, [this](cv::Mat &src, cv::Mat &dst) { return white_screen_threshold(src, dst); }}
+        {0, [this](const cv::Mat &src, int first, int end, cv::Mat &dst) { return dynamic_threshold(src, first, end, dst); }},
+        {1, [this](const cv::Mat &src, int first, int end, cv::Mat &dst) { return white_screen_threshold(src, first, end, dst); }}
     };
 
 public:
@@ -82,9 +120,27 @@ public:
      */
     bool pickup_white_screen(const cv::Mat &src);
 
+    /**
+     * Prepares a frame for threshold_rows: picks the method and, for k-means, fits the clusters and the LUT.
+     * @param src input color image
+     * @param mode thresholding method (0 = k-means, 1 = background subtraction; anything else falls back to 0)
+     * @return 0 if successful
+     */
+    int begin_frame(const cv::Mat &src, const int mode = 0);
+
+    /**
+     * Thresholds a range of rows of the frame given to begin_frame, so callers can stream the frame in strips.
+     * @param src input color image (the one passed to begin_frame)
+     * @param first first row
+     * @param end one past the last row
+     * @param dst output binary rows, end - first rows; an existing ROI of the right size is written in place
+     * @return 0 if successful
+     */
+    int threshold_rows(const cv::Mat &src, int first, int end, cv::Mat &dst);
+
     /**
      * Main thresholding dispatcher. Applies Gaussian blur then calls
-     * appropriate thresholding method based on mode.
+     * appropriate thresholding method based on mode, on the whole frame.
      * @param src input color image
      * @param dst output binary image
      * @param mode thresholding method (0 = k-means, 1 = background subtraction)